@@ -213,7 +213,7 @@ end
 ; Move the two tapes into position
 
 ; Tape 1 left write right: DA6, DA7, DA8
-' Tape 2 left write right: DA3, DA4, DA5
+; Tape 2 left write right: DA3, DA4, DA5
 
 IO(DA6) ; Shift the input bits from the input area to working area
 IO(DA3)
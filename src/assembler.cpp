@@ -2,35 +2,48 @@
 #include <string>
 #include <unordered_map>
 #include <sstream>
+#include <algorithm>
 #include "assembler.h"
+#include "thread_pool.h"
 
+#if defined(__unix__) || defined(__APPLE__)
+#include <unistd.h>
+#endif
 
+namespace {
 
-Assembler::Assembler(const std::string& inputFile) {
-    // Initialize the opcode table
-    opcodeTable = {
-        {"NOT", "13"},
-        {"SKZ", "cat"},
-        {"OR", "blocks"},
-        {"LD", "chirp"},
-        {"XOR", "far"},
-        {"OUT", "mall"},
-        {"AND", "mellohi"},
-        {"DA1", "stal"},
-        {"DA2", "strad"},
-        {"DA3", "ward"},
-        {"DA4", "11"},
-        {"DA5", "wait"},
-        {"DA6", "pigstep"},
-        {"DA7", "otherside"},
-        {"DA8", "5"}
-    };
+// Bytes of physical memory, or 0 where the platform does not say
+uint64_t physicalMemory() {
+#if defined(_SC_PHYS_PAGES) && defined(_SC_PAGE_SIZE)
+    long pages = sysconf(_SC_PHYS_PAGES);
+    long pageSize = sysconf(_SC_PAGE_SIZE);
+    if (pages > 0 && pageSize > 0) {
+        return static_cast<uint64_t>(pages) * static_cast<uint64_t>(pageSize);
+    }
+#endif
+    return 0;
+}
+
+}  // namespace
+
+
+
+Assembler::SymbolId Assembler::SymbolTable::intern(std::string_view text) {
+    auto it = ids.find(text);
+    if (it != ids.end()) {
+        return it->second;
+    }
+    SymbolId id = static_cast<SymbolId>(arena.size());
+    arena.emplace_back(text);
+    ids.emplace(std::string_view(arena.back()), id);
+    infos.push_back(SymbolInfo());
+    infos.back().opcode = isa::findOpcode(text);
+    return id;
+}
 
-    // Read the assembly file
-    if (Assembler::readAssemblyFile(inputFile)) {
-        std::cout << "File read successfully." << std::endl;
-    } else {
-        std::cerr << "Error reading file." << std::endl;
+Assembler::Assembler(const std::string& inputFile) {
+    // Read the assembly file; a missing file has already been reported
+    if (!Assembler::readAssemblyFile(inputFile)) {
         return;
     }
     // Assemble the instructions
@@ -38,131 +51,339 @@ Assembler::Assembler(const std::string& inputFile) {
 }
 
 Assembler::Assembler() {
-    // Initialize the opcode table
-    opcodeTable = {
-        {"NOT", "13"},
-        {"SKZ", "cat"},
-        {"OR", "blocks"},
-        {"LD", "chirp"},
-        {"XOR", "far"},
-        {"OUT", "mall"},
-        {"AND", "mellohi"},
-        {"DA1", "stal"},
-        {"DA2", "strad"},
-        {"DA3", "ward"},
-        {"DA4", "11"},
-        {"DA5", "wait"},
-        {"DA6", "pigstep"},
-        {"DA7", "otherside"},
-        {"DA8", "5"}
-    };
+}
+
+const std::vector<std::string>& Assembler::getInstructions() const {
+    // Spelled out on demand; the assembler itself only deals in opcodes
+    if (instructionText.size() != discInstructions.size()) {
+        instructionText.clear();
+        instructionText.reserve(discInstructions.size());
+        for (Opcode opcode : discInstructions) {
+            instructionText.push_back(isa::mnemonic(opcode));
+        }
+    }
+    return instructionText;
 }
 
 bool Assembler::readAssemblyFile(const std::string& inputFile) {
-    std::ifstream file(inputFile);
-    if (!file) {
-        std::cerr << "File not found: " << inputFile << std::endl;
+    // Lines are views into the mapped file, with comments and whitespace
+    // stripped in the same scan that finds them
+    std::unique_ptr<SourceFile> source(new SourceFile());
+    if (!source->open(inputFile)) {
+        SourceLocation location;
+        location.file = inputFile;
+        diagnostics.report(SEVERITY_ERROR, "File not found", location);
+        diagnostics.flush();
+        return false;
+    }
+    SourceFile::scanLines(source->text(), assemblyFile, source.get());
+    sources.push_back(std::move(source));
+    return true;
+}
+
+bool Assembler::assemble(){
+    defineMacros();
+    if (!withinBudget(sizeof(Opcode))) {
+        diagnostics.flush();
+        return false;
+    }
+    
+    // Expand with the output in discInstructions, so repeated expansions
+    // can be copied from it
+    ExpansionCursor cursor;
+    startCursor(cursor, diagnostics);
+    cursor.output = &discInstructions;
+    // A replayed span would skip the trace of its lines
+    if (!cursor.trace) {
+        cursor.cache = &expansionCache;
+    }
+    cursor.stats = &cacheStats;
+    Opcode opcode;
+    while (nextInstruction(cursor, opcode)) {
+        discInstructions.push_back(opcode);
+    }
+    assembled = true;
+    diagnostics.flush();
+    return true;
+}
+
+bool Assembler::assemble(ThreadPool& pool) {
+    defineMacros();
+    
+    // Chunks are only worth it for long top-level programs
+    const size_t MIN_CHUNK_LINES = 1024;
+    size_t chunkCount = std::min<size_t>(pool.size() * 4, programLines.size() / MIN_CHUNK_LINES);
+    if (chunkCount < 2) {
+        return assemble();
+    }
+    // Chunk outputs and the joined program are held at the same time
+    if (!withinBudget(2 * sizeof(Opcode))) {
+        diagnostics.flush();
         return false;
     }
-    std::string line;
-    while (std::getline(file, line)) {
-        removeComments(line);
-        trimWhitespace(line);
-        if (!line.empty()) {
-            assemblyFile.push_back(line);
+    resolveAllSymbols();
+    
+    // Split evenly, but never between an SKZ and the invocation it applies to
+    std::vector<size_t> bounds(1, 0);
+    for (size_t c = 1; c < chunkCount; ++c) {
+        size_t bound = std::max(bounds.back(), programLines.size() * c / chunkCount);
+        if (bound > 0 && bound < programLines.size() && symbols.info(programLines[bound - 1]).opcode == OP_SKZ &&
+            symbols.info(programLines[bound]).invocation) {
+            bound++;
+        }
+        bounds.push_back(bound);
+    }
+    bounds.push_back(programLines.size());
+    
+    // Each chunk expands into its own output, cache and diagnostics buffer
+    struct Chunk {
+        std::vector<Opcode> output;
+        ExpansionCache cache;
+        ExpansionCacheStats stats;
+        DiagnosticSink diagnostics{nullptr, nullptr};
+    };
+    std::vector<Chunk> chunks(chunkCount);
+    for (size_t c = 0; c < chunkCount; ++c) {
+        chunks[c].diagnostics.setThreshold(diagnostics.getThreshold());
+        pool.submit([this, &chunks, &bounds, c] {
+            Chunk& chunk = chunks[c];
+            ExpansionCursor cursor;
+            startCursor(cursor, chunk.diagnostics);
+            cursor.nextLine = bounds[c];
+            cursor.endLine = bounds[c + 1];
+            cursor.padded = true;
+            cursor.output = &chunk.output;
+            // Each chunk's cache starts cold, so tracing must not replay
+            // anything the serial run would have traced
+            if (!cursor.trace) {
+                cursor.cache = &chunk.cache;
+            }
+            cursor.stats = &chunk.stats;
+            cursor.concurrent = true;
+            Opcode opcode;
+            while (nextInstruction(cursor, opcode)) {
+                chunk.output.push_back(opcode);
+            }
+        });
+    }
+    pool.wait();
+    
+    // Join in program order; cached spans move with their chunk's output
+    size_t total = 0;
+    for (const Chunk& chunk : chunks) {
+        total += chunk.output.size();
+    }
+    discInstructions.reserve(total + 27);
+    for (Chunk& chunk : chunks) {
+        diagnostics.append(chunk.diagnostics);
+        size_t offset = discInstructions.size();
+        discInstructions.insert(discInstructions.end(), chunk.output.begin(), chunk.output.end());
+        for (const auto& entry : chunk.cache) {
+            expansionCache.emplace(entry.first, std::make_pair(entry.second.first + offset, entry.second.second + offset));
         }
+        cacheStats.hits += chunk.stats.hits;
+        cacheStats.misses += chunk.stats.misses;
+        cacheStats.copiedInstructions += chunk.stats.copiedInstructions;
     }
-    file.close();
+    discInstructions.insert(discInstructions.end(), paddingFor(discInstructions.size()), OP_NOT);
+    assembled = true;
+    diagnostics.flush();
     return true;
 }
 
-void Assembler::assemble(){
+void Assembler::resolveAllSymbols() {
+    // Settle every lazily resolved symbol and call target up front, so
+    // concurrent expansions never write to shared state
+    for (SymbolId id = 0; id < symbols.size(); ++id) {
+        resolveSymbol(id);
+    }
+    for (auto& entry : macroTable) {
+        for (BodyLine& line : entry.second.code) {
+            if (line.kind == LINE_CALL && !line.target) {
+                line.target = resolveSymbol(line.callee).macro;
+            }
+        }
+    }
+}
 
-    // First pass: parse macro definitions, remove comments, and trim whitespace
+size_t Assembler::paddingFor(size_t instructionCount) {
+    // Enforce ISA constraint: program must be a multiple of 27 instructions
+    const size_t INSTRUCTION_MULTIPLE = 27;
+    size_t remainder = instructionCount % INSTRUCTION_MULTIPLE;
+    if (remainder == 0) {
+        return 0;
+    }
+    size_t nopsNeeded = INSTRUCTION_MULTIPLE - remainder;
+    if (diagnostics.wants(SEVERITY_NOTE)) {
+        diagnostics.report(SEVERITY_NOTE, "Program padded from " + std::to_string(instructionCount) + " to " +
+                           std::to_string(instructionCount + nopsNeeded) + " instructions (" +
+                           std::to_string(nopsNeeded) + " NOPs added)");
+    }
+    return nopsNeeded;
+}
+
+void Assembler::defineMacros() {
+    if (macrosDefined) {
+        return;
+    }
+    macrosDefined = true;
+
+    // First pass: parse macro definitions; comments and whitespace were
+    // already stripped when the file was scanned
     auto end = assemblyFile.end();
     auto it = assemblyFile.begin();
-    std::vector<std::string> newAssemblyFile;
+    std::vector<SourceLine> newAssemblyFile;
     while (it != end) {
-        std::string line = *it;
-        removeComments(line);
-        trimWhitespace(line);
-        if (!line.empty()) {
-            if (line.substr(0, 4) == "def ") {
-                parseMacroDefinition(it, end);
-                // Don't increment it here - parseMacroDefinition already moved it
-            } else {
-                newAssemblyFile.push_back(line);
-                ++it;  // Only increment for non-macro lines
-            }
+        if (it->text.substr(0, 4) == "def ") {
+            parseMacroDefinition(it, end);
+            // Don't increment it here - parseMacroDefinition already moved it
         } else {
-            ++it;  // Increment for empty lines
+            newAssemblyFile.push_back(*it);
+            ++it;  // Only increment for non-macro lines
         }
     }
-    assemblyFile = newAssemblyFile;  // Update the assembly file with the new lines
+    assemblyFile.swap(newAssemblyFile);  // Update the assembly file with the new lines
 
-    std::cout << "Second pass: parsing macro invocations and generating instructions." << std::endl;
-    // Second pass: parse macro invocations
-    bool containsMacroInvocation = true;
-    int nestedMacroDepth = 0;
-    // Loop until no more macro invocations are found, to handle nested macros
-    while(containsMacroInvocation && nestedMacroDepth < MAX_NESTED_MACRO_DEPTH) {
-        std::vector<std::string> instructions;
-        containsMacroInvocation = false;
-        
-        for (size_t i = 0; i < assemblyFile.size(); ++i) {
-            const std::string& line = assemblyFile[i];
+    diagnostics.report(SEVERITY_NOTE, "Second pass: parsing macro invocations and generating instructions.");
+    programLines.reserve(assemblyFile.size());
+    for (const auto& line : assemblyFile) {
+        programLines.push_back(symbols.intern(line.text));
+    }
+    reportRecursiveMacros();
+    measureProgram();
+    diagnostics.flush();
+}
+
+Assembler::InstructionStream Assembler::streamInstructions() {
+    defineMacros();
+    // Streaming holds no output, so only the instruction budget applies
+    if (!assembled) {
+        withinBudget(0);
+    }
+    InstructionStream stream(*this);
+    startCursor(stream.cursor, diagnostics);
+    return stream;
+}
+
+void Assembler::startCursor(ExpansionCursor& cursor, DiagnosticSink& sink) {
+    cursor.diagnostics = &sink;
+    cursor.trace = sink.wants(SEVERITY_TRACE);
+}
+
+bool Assembler::InstructionStream::next(Opcode& opcode) {
+    if (assembler->overBudget) {
+        return false;
+    }
+    if (assembler->assembled) {
+        if (index == assembler->discInstructions.size()) {
+            return false;
+        }
+        opcode = assembler->discInstructions[index++];
+        return true;
+    }
+    if (!assembler->nextInstruction(cursor, opcode)) {
+        assembler->diagnostics.flush();
+        return false;
+    }
+    return true;
+}
+
+bool Assembler::nextInstruction(ExpansionCursor& cursor, Opcode& opcode) {
+    // Second pass: expand macro invocations depth-first, yielding each final
+    // instruction as soon as it is known
+    while (true) {
+        if (cursor.copyNext < cursor.copyEnd) {
+            opcode = (*cursor.output)[cursor.copyNext++];
+            cursor.emitted++;
+            return true;
+        }
+        if (!cursor.expansion.frames.empty()) {
+            if (expandStep(cursor, opcode)) {
+                cursor.emitted++;
+                return true;
+            }
+            continue;
+        }
+        size_t endLine = std::min(cursor.endLine, programLines.size());
+        if (cursor.nextLine < endLine) {
+            cursor.currentLine = cursor.nextLine;
+            SymbolId line = programLines[cursor.nextLine++];
             
             // Check for SKZ followed by macro invocation pattern
-            if (line == "SKZ" && i + 1 < assemblyFile.size() && isValidMacroInvocation(assemblyFile[i + 1])) {
+            if (symbols.info(line).opcode == OP_SKZ && cursor.nextLine < endLine &&
+                resolveSymbol(programLines[cursor.nextLine]).invocation) {
                 // Skip the SKZ line and process the macro with SKZ insertion
-                ++i; // Move to the macro line
-                parseMacroInvocation(assemblyFile[i], instructions, true);
-                containsMacroInvocation = true;
+                size_t index = cursor.nextLine++;
+                cursor.currentLine = index;
+                if (checkExpansionSize(index, cursor)) {
+                    pushInvocation(programLines[index], true, cursor);
+                }
             }
             // Check if the line is a macro invocation
-            else if (isValidMacroInvocation(line)) {
-                parseMacroInvocation(line, instructions, false);
-                containsMacroInvocation = true;
-            } else {
-                // Check if the line is a valid opcode
-                if (isValidOpcode(line)) {
-                    instructions.push_back(line);
-                } else {
-                    std::cerr << "Error: Invalid opcode or macro invocation: " << line << std::endl;
+            else if (resolveSymbol(line).invocation) {
+                if (checkExpansionSize(cursor.nextLine - 1, cursor)) {
+                    pushInvocation(line, false, cursor);
                 }
+            } else if (emitInstruction(line, opcode, cursor)) {
+                cursor.emitted++;
+                return true;
             }
+            continue;
         }
-        assemblyFile = instructions;  // Use the generated instructions for the next pass
-        ++nestedMacroDepth;
-    }
-    if (nestedMacroDepth == MAX_NESTED_MACRO_DEPTH) {
-        std::cerr << "Error: Maximum nested macro depth exceeded." << std::endl;
-    }
-    // Generate the final instructions
-    for (const auto& line : assemblyFile) {
-        // Check if the line is a valid opcode
-        if (isValidOpcode(line)) {
-            discInstructions.push_back(line);
-        } else {
-            std::cerr << "Error: Invalid opcode or macro invocation: " << line << std::endl;
+        
+        if (!cursor.padded) {
+            cursor.padded = true;
+            cursor.padding = paddingFor(cursor.emitted);
         }
-    }
-    
-    // Enforce ISA constraint: program must be a multiple of 27 instructions
-    const int INSTRUCTION_MULTIPLE = 27;
-    
-    int currentSize = discInstructions.size();
-    int remainder = currentSize % INSTRUCTION_MULTIPLE;
-    
-    if (remainder != 0) {
-        int nopsNeeded = INSTRUCTION_MULTIPLE - remainder;
-        for (int i = 0; i < nopsNeeded; ++i) {
-            discInstructions.push_back("NOT");
+        if (cursor.padding > 0) {
+            cursor.padding--;
+            opcode = OP_NOT;
+            return true;
         }
-        std::cout << "Program padded from " << currentSize << " to " << (currentSize + nopsNeeded) << " instructions (" << nopsNeeded << " NOPs added)" << std::endl;
+        return false;
     }
 }
 
+bool Assembler::optimize() {
+    if (!assembled || diagnostics.errorCount() > 0) {
+        return false;
+    }
+    // Cached expansions are spans of the unoptimized program, but nothing
+    // is expanded once the program is assembled
+    bool shorter = optimizer.optimize(discInstructions);
+    instructionText.clear();
+    if (diagnostics.wants(SEVERITY_NOTE)) {
+        const PeepholeOptimizer::Stats& stats = optimizer.getStats();
+        diagnostics.report(SEVERITY_NOTE, "Peephole optimizer: " + std::to_string(stats.instructionsBefore) + " -> " +
+                           std::to_string(stats.instructionsAfter) + " instructions after " +
+                           std::to_string(stats.rounds) + " round(s)");
+        diagnostics.flush();
+    }
+    return shorter;
+}
+
+void Assembler::printOptimizationStats() const {
+    const PeepholeOptimizer::Stats& stats = optimizer.getStats();
+    std::cout << "=== Peephole Optimizer ===" << std::endl;
+    std::cout << "Instructions: " << stats.instructionsBefore << " -> " << stats.instructionsAfter << std::endl;
+    std::cout << "Redundant Removed: " << stats.redundant << std::endl;
+    std::cout << "Dead Removed: " << stats.dead << std::endl;
+    std::cout << "No-Effect Removed: " << stats.noEffect << std::endl;
+    std::cout << "Rewrites Saved: " << stats.rewritten << std::endl;
+    std::cout << "Padding Added: " << stats.padding << std::endl;
+    std::cout << "Instructions Saved: " << stats.instructionsSaved() << std::endl;
+    std::cout << "Ticks Saved Per Pass: " << stats.ticksSaved() << std::endl;
+    std::cout << "Shulkers Saved: " << stats.shulkersSaved() << std::endl;
+}
+
+void Assembler::printExpansionCacheStats() const {
+    std::cout << "=== Macro Expansion Cache ===" << std::endl;
+    std::cout << "Hits: " << cacheStats.hits << std::endl;
+    std::cout << "Misses: " << cacheStats.misses << std::endl;
+    std::cout << "Cached Expansions: " << expansionCache.size() << std::endl;
+    std::cout << "Instructions Copied: " << cacheStats.copiedInstructions << std::endl;
+}
+
 void Assembler::removeComments(std::string& line) {
     size_t commentPos = line.find(';');
     if (commentPos != std::string::npos) {
@@ -177,8 +398,7 @@ void Assembler::trimWhitespace(std::string& line) {
 
 bool Assembler::isValidOpcode(const std::string& line) {
     // checks across opcode table and macro table
-    auto it = opcodeTable.find(line);
-    if (it != opcodeTable.end()) {
+    if (isa::findOpcode(line) != OP_NONE) {
         return true;  // Found in opcode table
     }
     // Check if it's a macro name
@@ -222,64 +442,54 @@ bool Assembler::isMacroInvocation(const std::string& line) {
 }
 
 void Assembler::writeOutput(const std::string& outputFile) {
-    std::ofstream file(outputFile);
-    if (!file) {
-        std::cerr << "Error creating output file." << std::endl;
-        return;
-    }
-    for (const auto& instruction : discInstructions) {
-        auto it = opcodeTable.find(instruction);
-        file << it->second << std::endl;
-    }
-    file.close();
+    writeOutput(outputFile, FORMAT_NUMERIC);
 }
 
 void Assembler::writeOutputCommand(const std::string& outputFile) {
-    std::ofstream file(outputFile);
+    writeOutput(outputFile, FORMAT_COMMANDS);
+}
+
+bool Assembler::writeOutput(const std::string& outputFile, OutputFormat format) {
+    bool text = format == FORMAT_NUMERIC || format == FORMAT_COMMANDS;
+    std::ofstream file(outputFile, text ? std::ios::out : std::ios::out | std::ios::binary);
     if (!file) {
-        std::cerr << "Error creating output file." << std::endl;
-        return;
+        SourceLocation location;
+        location.file = outputFile;
+        diagnostics.report(SEVERITY_ERROR, "Error creating output file", location);
+        diagnostics.flush();
+        return false;
     }
-    
-    const int MAX_ITEMS_PER_SHULKER = 27;
-    int totalInstructions = discInstructions.size();
-    int shulkerCount = (totalInstructions + MAX_ITEMS_PER_SHULKER - 1) / MAX_ITEMS_PER_SHULKER;
-    
-    for (int shulkerIndex = 0; shulkerIndex < shulkerCount; ++shulkerIndex) {
-        int startIdx = shulkerIndex * MAX_ITEMS_PER_SHULKER;
-        int endIdx = std::min(startIdx + MAX_ITEMS_PER_SHULKER, totalInstructions);
-        
-        std::string shulkerName = "Program";
-        if (shulkerCount > 1) {
-            shulkerName += "_Part_" + std::to_string(shulkerIndex + 1);
-        }
-        
-        file << "/give @p shulker_box{display:{Name:'{\"text\":\"" << shulkerName << "\"}'},BlockEntityTag:{Items:[";
-        
-        for (int i = startIdx; i < endIdx; ++i) {
-            auto it = opcodeTable.find(discInstructions[i]);
-            if (it != opcodeTable.end()) {
-                if (i > startIdx) file << ",";
-                file << "{Slot:" << (i - startIdx) << "b,id:\"minecraft:music_disc_" << it->second << "\",Count:1b}";
-            }
-        }
-        
-        file << "]}}" << std::endl;
+    std::unique_ptr<ProgramEmitter> emitter = ProgramEmitter::create(format, file);
+    if (!emit(*emitter)) {
+        SourceLocation location;
+        location.file = outputFile;
+        diagnostics.report(SEVERITY_ERROR, "Error writing output file", location);
     }
-    
-    file.close();
+    diagnostics.flush();
+    return diagnostics.errorCount() == 0;
 }
 
-void Assembler::parseMacroDefinition(std::vector<std::string>::iterator& currentLine, 
-                                    const std::vector<std::string>::iterator& end) {
+bool Assembler::emit(ProgramEmitter& emitter) {
+    // Streamed, so the emitter sees each instruction as it is expanded
+    InstructionStream stream = streamInstructions();
+    Opcode opcode;
+    while (stream.next(opcode)) {
+        emitter.emit(opcode);
+    }
+    return emitter.finish();
+}
+
+void Assembler::parseMacroDefinition(std::vector<SourceLine>::iterator& currentLine, 
+                                    const std::vector<SourceLine>::iterator& end) {
     // Extract the macro name and parameters from the def directive line
     // Format: def macroName(param1, param2, param3)
-    std::string line = *currentLine;
+    std::string line(currentLine->text);
+    SourceLocation definition = locate(*currentLine);
     
     // Check if line starts with "def "
     if (line.substr(0, 4) != "def ") {
         // Not a macro definition, skip it
-        std::cerr << "Error: Invalid macro definition format. Expected: def macroName(param1, param2, ...)" << std::endl;
+        diagnostics.report(SEVERITY_ERROR, "Invalid macro definition format. Expected: def macroName(param1, param2, ...)", definition);
         ++currentLine;
         return;
     }
@@ -290,19 +500,20 @@ void Assembler::parseMacroDefinition(std::vector<std::string>::iterator& current
     // Find the opening parenthesis
     size_t openParenPos = defLine.find('(');
     if (openParenPos == std::string::npos) {
-        std::cerr << "Error: Invalid macro definition format. Expected: def macroName(param1, param2, ...)" << std::endl;
+        diagnostics.report(SEVERITY_ERROR, "Invalid macro definition format. Expected: def macroName(param1, param2, ...)", definition);
         return;
     }
     
     // Extract the macro name
     MacroDefinition macro;
+    macro.definition = *currentLine;
     macro.name = defLine.substr(0, openParenPos);
     trimWhitespace(macro.name);
     
     // Find the closing parenthesis
     size_t closeParenPos = defLine.find(')', openParenPos);
     if (closeParenPos == std::string::npos) {
-        std::cerr << "Error: Missing closing parenthesis in macro definition" << std::endl;
+        diagnostics.report(SEVERITY_ERROR, "Missing closing parenthesis in macro definition", definition);
         return;
     }
     
@@ -322,26 +533,30 @@ void Assembler::parseMacroDefinition(std::vector<std::string>::iterator& current
     // Collect the macro body until "end"
     ++currentLine;  // Move past the def line
     while (currentLine != end) {
-        if (*currentLine == "end") {
-            std::cout << "End of macro definition: " << macro.name << std::endl;
+        std::string bodyLine(currentLine->text);
+        if (bodyLine == "end") {
+            diagnostics.report(SEVERITY_NOTE, "End of macro definition: " + macro.name);
             break;  // End of macro definition
         }
         // Check and make sure line is either a parameter or a valid instruction
-        if (!isValidMacroParameter(*currentLine, macro) && !isValidOpcode(*currentLine) && !isMacroInvocation(*currentLine)) {
-            std::cerr << "Error: Invalid instruction in macro body: " << *currentLine << std::endl;
+        if (!isValidMacroParameter(bodyLine, macro) && !isValidOpcode(bodyLine) && !isMacroInvocation(bodyLine)) {
+            diagnostics.report(SEVERITY_ERROR, "Invalid instruction in macro body: " + bodyLine, locate(*currentLine));
             return;
         }
-        macro.body.push_back(*currentLine);
+        macro.body.push_back(bodyLine);
+        macro.sourceLines.push_back(*currentLine);
         ++currentLine;
     }
     
     // Make sure we found the "end" marker
     if (currentLine == end) {
-        std::cerr << "Error: Missing 'end' marker for macro definition" << std::endl;
+        diagnostics.report(SEVERITY_ERROR, "Missing 'end' marker for macro definition " + macro.name, definition);
         return;
     }
     
     // Add to macro table
+    macro.symbol = symbols.intern(macro.name);
+    compileMacroBody(macro);
     macroTable[macro.name] = macro;
     
     // Skip the "end" line
@@ -365,96 +580,557 @@ void Assembler::findParameters(const std::string& line, std::vector<std::string>
     }
 }
 
-void Assembler::parseMacroInvocation(const std::string& line, std::vector<std::string>& instructions, bool insertSKZ) {
-    // Implementation for parsing macro invocations
-    std::string macroName = line.substr(0, line.find('('));
-    auto it = macroTable.find(macroName);
-    if (it != macroTable.end()) {
-        MacroDefinition& macro = it->second;
-        std::vector<std::string> arguments;
-        findParameters(line, arguments);
+bool Assembler::emitInstruction(SymbolId line, Opcode& opcode, ExpansionCursor& cursor) {
+    // Check if the line is a valid opcode
+    opcode = symbols.info(line).opcode;
+    if (opcode != OP_NONE) {
+        return true;
+    }
+    reportExpansionError(cursor, "Invalid opcode or macro invocation: " + symbols.text(line));
+    return false;
+}
 
-        // trim whitespace from arguments and make sure they match the macro parameters
-        for (auto& arg : arguments) {
-            trimWhitespace(arg);
-            if (arguments.size() > macro.parameters.size()) {
-                std::cerr << "Error: Too many arguments for macro " << macroName << std::endl;
-                return;
+SourceLocation Assembler::locate(const SourceLine& line) const {
+    SourceLocation location;
+    if (line.file) {
+        location.file = line.file->path();
+    }
+    location.line = line.line;
+    location.column = line.column;
+    return location;
+}
+
+void Assembler::reportExpansionError(ExpansionCursor& cursor, const std::string& message) {
+    // Located at the innermost line being expanded, with each enclosing
+    // invocation out to the top-level line listed beneath it
+    Diagnostic diagnostic;
+    diagnostic.severity = SEVERITY_ERROR;
+    diagnostic.message = message;
+    SourceLocation site;
+    if (cursor.currentLine < assemblyFile.size()) {
+        site = locate(assemblyFile[cursor.currentLine]);
+    }
+    const std::vector<ExpansionFrame>& frames = cursor.expansion.frames;
+    for (size_t i = 0; i < frames.size(); ++i) {
+        // frames[i] was invoked from the line frames[i - 1] was expanding
+        if (i == 0 || frames.size() - i < MAX_BACKTRACE) {
+            diagnostic.backtrace.push_back(ExpansionSite{frames[i].macro->name, site});
+        } else {
+            diagnostic.omittedSites++;
+        }
+        const MacroDefinition& macro = *frames[i].macro;
+        site = locate(frames[i].nextLine > 0 ? macro.sourceLines[frames[i].nextLine - 1] : macro.definition);
+    }
+    std::reverse(diagnostic.backtrace.begin(), diagnostic.backtrace.end());
+    diagnostic.location = site;
+    cursor.diagnostics->report(std::move(diagnostic));
+}
+
+Assembler::SymbolInfo& Assembler::resolveSymbol(SymbolId id) {
+    if (!symbols.info(id).resolved) {
+        const std::string& text = symbols.text(id);
+        MacroDefinition* macro = nullptr;
+        MacroDefinition* invocation = nullptr;
+        std::vector<SymbolId> arguments;
+        
+        auto it = macroTable.find(text);
+        if (it != macroTable.end()) {
+            macro = &it->second;
+        }
+        if (isValidMacroInvocation(text)) {
+            invocation = &macroTable.find(text.substr(0, text.find('(')))->second;
+            std::vector<std::string> argumentTexts;
+            findParameters(text, argumentTexts);
+            for (const auto& argumentText : argumentTexts) {
+                arguments.push_back(symbols.intern(argumentText));
             }
-            else if (arguments.size() < macro.parameters.size()) {
-                std::cerr << "Error: Not enough arguments for macro " << macroName << std::endl;
-                return;
+        }
+        
+        // Interning the arguments may have moved the info
+        SymbolInfo& info = symbols.info(id);
+        info.resolved = true;
+        info.macro = macro;
+        info.invocation = invocation;
+        info.arguments.swap(arguments);
+        // Allow opcodes, macro invocations, or macro names as arguments
+        info.validArgument = info.opcode != OP_NONE || macro || invocation;
+    }
+    return symbols.info(id);
+}
+
+void Assembler::compileMacroBody(MacroDefinition& macro) {
+    macro.code.clear();
+    for (const auto& text : macro.body) {
+        BodyLine line;
+        line.text = symbols.intern(text);
+        line.opcode = symbols.info(line.text).opcode;
+        
+        // 1. Exact parameter match (e.g., "LEFT" -> "DA6")
+        // 2. Parameter with () (e.g., "one_val()" -> "HIGH()")
+        for (size_t i = 0; i < macro.parameters.size(); ++i) {
+            if (text == macro.parameters[i]) {
+                line.kind = LINE_PARAM;
+                line.param = static_cast<int>(i);
+                break;
+            } else if (text == macro.parameters[i] + "()") {
+                line.kind = LINE_PARAM_CALL;
+                line.param = static_cast<int>(i);
+                break;
             }
-            // Allow opcodes, macro invocations, or macro names as arguments
-            if (!isValidOpcode(arg) && !isValidMacroInvocation(arg) && macroTable.find(arg) == macroTable.end()) {
-                std::cerr << "Error: Invalid argument for macro " << macroName << ": " << arg << std::endl;
-                return;
+        }
+        
+        // 3. Nested call, with each argument either a parameter slot or a symbol
+        if (line.kind == LINE_TEXT && isMacroInvocation(text)) {
+            line.kind = LINE_CALL;
+            line.callee = symbols.intern(text.substr(0, text.find('(')));
+            std::vector<std::string> argumentTexts;
+            findParameters(text, argumentTexts);
+            for (const auto& argumentText : argumentTexts) {
+                CallArgument argument = {-1, symbols.intern(argumentText)};
+                for (size_t j = 0; j < macro.parameters.size(); ++j) {
+                    if (macro.parameters[j] == argumentText) {
+                        argument.param = static_cast<int>(j);
+                        break;
+                    }
+                }
+                line.arguments.push_back(argument);
             }
         }
+        macro.code.push_back(line);
+    }
+}
 
-        // Replace parameters in the macro body with arguments
-        std::vector<std::string> expandedBody = macro.body; // Work with a copy
-        for(auto& bodyLine : expandedBody) {
-            // For each line, replace parameters with arguments
-            for (size_t i = 0; i < macro.parameters.size(); ++i) {
-                std::string param = macro.parameters[i];
-                std::string arg = arguments[i];
-                
-                // Handle different cases:
-                // 1. Exact parameter match (e.g., "LEFT" -> "DA6")
-                if (bodyLine == param) {
-                    bodyLine = arg;
-                }
-                // 2. Parameter with () (e.g., "one_val()" -> "HIGH()")
-                else if (bodyLine == param + "()") {
-                    bodyLine = arg + "()";
+bool Assembler::pushInvocation(SymbolId line, bool insertSKZ, ExpansionCursor& cursor) {
+    const SymbolInfo& info = resolveSymbol(line);
+    if (!info.invocation) {
+        const std::string& text = symbols.text(line);
+        reportExpansionError(cursor, "Unknown macro: " + text.substr(0, text.find('(')));
+        return false;
+    }
+    std::vector<SymbolId>& arguments = cursor.expansion.arguments;
+    arguments.insert(arguments.end(), info.arguments.begin(), info.arguments.end());
+    return pushExpansionFrame(*info.invocation, insertSKZ, true, cursor);
+}
+
+bool Assembler::pushExpansionFrame(MacroDefinition& macro, bool insertSKZ, bool checkArguments, ExpansionCursor& cursor) {
+    // The macro's arguments have already been pushed onto expansion.arguments
+    Expansion& expansion = cursor.expansion;
+    size_t base = expansion.frames.empty() ? 0 :
+        expansion.frames.back().argumentBase + expansion.frames.back().macro->parameters.size();
+    size_t argumentCount = expansion.arguments.size() - base;
+    
+    std::string error;
+    if (static_cast<int>(expansion.frames.size()) >= MAX_NESTED_MACRO_DEPTH) {
+        error = "Maximum nested macro depth exceeded expanding " + macro.name;
+    } else if (argumentCount > macro.parameters.size()) {
+        error = "Too many arguments for macro " + macro.name;
+    } else if (argumentCount < macro.parameters.size()) {
+        error = "Not enough arguments for macro " + macro.name;
+    }
+    for (size_t i = base; error.empty() && checkArguments && i < expansion.arguments.size(); ++i) {
+        if (!resolveSymbol(expansion.arguments[i]).validArgument) {
+            error = "Invalid argument for macro " + macro.name + ": " + symbols.text(expansion.arguments[i]);
+        }
+    }
+    if (!error.empty()) {
+        expansion.arguments.resize(base);
+        reportExpansionError(cursor, error);
+        return false;
+    }
+    
+    ExpansionFrame frame;
+    if (cursor.cache) {
+        // Equal argument text interns to the same symbol, wherever it came from;
+        // the argument count is fixed per macro, so the SKZ flag can go last
+        std::u32string key(1, macro.symbol);
+        key.append(expansion.arguments.begin() + base, expansion.arguments.end());
+        key.push_back(insertSKZ ? 1 : 0);
+        
+        auto cached = cursor.cache->find(key);
+        if (cached != cursor.cache->end()) {
+            // Replay the earlier expansion from the output
+            cursor.copyNext = cached->second.first;
+            cursor.copyEnd = cached->second.second;
+            cursor.stats->hits++;
+            cursor.stats->copiedInstructions += cursor.copyEnd - cursor.copyNext;
+            expansion.arguments.resize(base);
+            return true;
+        }
+        cursor.stats->misses++;
+        frame.cacheKey.swap(key);
+    }
+    
+    frame.macro = &macro;
+    frame.argumentBase = base;
+    frame.insertSKZ = insertSKZ;
+    frame.outputStart = cursor.emitted;
+    frame.errorsAtStart = cursor.diagnostics->errorCount();
+    expansion.frames.push_back(frame);
+    return true;
+}
+
+bool Assembler::expandStep(ExpansionCursor& cursor, Opcode& opcode) {
+    // Depth-first expansion with an explicit stack: each frame walks one
+    // compiled macro body, and a nested call pushes a frame instead of
+    // recursing. One step yields at most one opcode.
+    Expansion& expansion = cursor.expansion;
+    ExpansionFrame& frame = expansion.frames.back();
+    const std::vector<BodyLine>& code = frame.macro->code;
+    
+    if (frame.lineOpen) {
+        // Insert SKZ between lines if requested (but not after the last line)
+        frame.lineOpen = false;
+        if (frame.insertSKZ && frame.nextLine < code.size()) {
+            if (cursor.trace) {
+                cursor.diagnostics->report(SEVERITY_TRACE, "Adding SKZ between macro lines");
+            }
+            opcode = OP_SKZ;
+            return true;
+        }
+        return false;
+    }
+    if (frame.nextLine == code.size()) {
+        if (cursor.cache && cursor.diagnostics->errorCount() == frame.errorsAtStart) {
+            (*cursor.cache)[frame.cacheKey] = std::make_pair(frame.outputStart, cursor.emitted);
+        }
+        expansion.arguments.resize(frame.argumentBase);
+        expansion.frames.pop_back();
+        return false;
+    }
+    
+    // frame is invalidated once a nested frame is pushed
+    BodyLine& bodyLine = frame.macro->code[frame.nextLine];
+    size_t argumentBase = frame.argumentBase;
+    bool nestedInsertSKZ = frame.insertSKZ;
+    frame.nextLine++;
+    frame.lineOpen = true;
+    
+    bool pushed = true;
+    switch (bodyLine.kind) {
+        case LINE_TEXT:
+            if (cursor.trace) {
+                cursor.diagnostics->report(SEVERITY_TRACE, "Adding line to instructions: " + symbols.text(bodyLine.text));
+            }
+            if (bodyLine.opcode != OP_NONE) {
+                opcode = bodyLine.opcode;
+                return true;
+            }
+            return emitInstruction(bodyLine.text, opcode, cursor);
+        case LINE_PARAM: {
+            SymbolId arg = expansion.arguments[argumentBase + bodyLine.param];
+            if (cursor.trace) {
+                cursor.diagnostics->report(SEVERITY_TRACE, "Adding line to instructions: " + symbols.text(arg));
+            }
+            if (!resolveSymbol(arg).invocation) {
+                return emitInstruction(arg, opcode, cursor);
+            }
+            pushed = pushInvocation(arg, nestedInsertSKZ, cursor);
+            break;
+        }
+        case LINE_PARAM_CALL: {
+            SymbolId arg = expansion.arguments[argumentBase + bodyLine.param];
+            if (cursor.trace) {
+                cursor.diagnostics->report(SEVERITY_TRACE, "Adding line to instructions: " + symbols.text(arg) + "()");
+            }
+            MacroDefinition* macro = resolveSymbol(arg).macro;
+            if (!macro) {
+                reportExpansionError(cursor, "Invalid opcode or macro invocation: " + symbols.text(arg) + "()");
+                return false;
+            }
+            pushed = pushExpansionFrame(*macro, nestedInsertSKZ, false, cursor);
+            break;
+        }
+        case LINE_CALL: {
+            if (!bodyLine.target && !cursor.concurrent) {
+                bodyLine.target = resolveSymbol(bodyLine.callee).macro;
+            }
+            if (!bodyLine.target) {
+                // Not a known macro, so the line is left as written
+                if (cursor.trace) {
+                    cursor.diagnostics->report(SEVERITY_TRACE, "Adding line to instructions: " + symbols.text(bodyLine.text));
                 }
+                return emitInstruction(bodyLine.text, opcode, cursor);
             }
-            
-            // Handle parameter replacement within macro calls
-            if (isValidMacroInvocation(bodyLine)) {
-                std::vector<std::string> nestedParamNames;
-                findParameters(bodyLine, nestedParamNames);
-                for (size_t i = 0; i < nestedParamNames.size(); ++i) {
-                    std::string nestedParam = nestedParamNames[i];
-                    // Find this parameter in the macro's parameter list
-                    for (size_t j = 0; j < macro.parameters.size(); ++j) {
-                        if (macro.parameters[j] == nestedParam) {
-                            std::string arg = arguments[j];
-                            // Replace the parameter in the macro call
-                            size_t paramStart = bodyLine.find(nestedParam, bodyLine.find('('));
-                            if (paramStart != std::string::npos) {
-                                bodyLine.replace(paramStart, nestedParam.length(), arg);
-                                break; // Found and replaced, move to next parameter
-                            }
-                        }
-                    }
+            std::string traced;
+            for (size_t i = 0; i < bodyLine.arguments.size(); ++i) {
+                const CallArgument& argument = bodyLine.arguments[i];
+                SymbolId bound = argument.param >= 0 ?
+                    expansion.arguments[argumentBase + argument.param] : argument.symbol;
+                if (cursor.trace) {
+                    traced += (i > 0 ? ", " : "") + symbols.text(bound);
                 }
-                
+                expansion.arguments.push_back(bound);
+            }
+            if (cursor.trace) {
+                cursor.diagnostics->report(SEVERITY_TRACE, "Adding line to instructions: " +
+                                           symbols.text(bodyLine.callee) + "(" + traced + ")");
+            }
+            // Slot arguments were checked when the caller was pushed, so
+            // only the literal ones need checking, and only the first time
+            pushed = pushExpansionFrame(*bodyLine.target, nestedInsertSKZ, !bodyLine.checked, cursor);
+            if (!cursor.concurrent) {
+                bodyLine.checked = bodyLine.checked || pushed;
             }
+            break;
         }
+    }
+    
+    if (!pushed && static_cast<int>(expansion.frames.size()) >= MAX_NESTED_MACRO_DEPTH) {
+        // Runaway recursion: give up on the whole invocation
+        expansion.frames.clear();
+        expansion.arguments.clear();
+    }
+    return false;
+}
 
-        // Add the expanded macro body to the instructions
-        for (size_t i = 0; i < expandedBody.size(); ++i) {
-            const auto& bodyLine = expandedBody[i];
-            std::cout << "Adding line to instructions: " << bodyLine << std::endl;
-            
-            // Check if this line is a nested macro call
-            if (isValidMacroInvocation(bodyLine)) {
-                // Recursively expand nested macro with the same insertSKZ flag
-                parseMacroInvocation(bodyLine, instructions, insertSKZ);
-            } else {
-                instructions.push_back(bodyLine);
+namespace {
+
+uint64_t saturatingAdd(uint64_t a, uint64_t b) {
+    return a > UINT64_MAX - b ? UINT64_MAX : a + b;
+}
+
+}  // namespace
+
+void Assembler::reportRecursiveMacros() {
+    // Static call graph over nested calls; a back edge in the depth-first
+    // walk is a cycle, which would expand forever once invoked
+    std::vector<MacroDefinition*> macros;
+    for (auto& entry : macroTable) {
+        macros.push_back(&entry.second);
+    }
+    std::sort(macros.begin(), macros.end(), [](const MacroDefinition* a, const MacroDefinition* b) {
+        return a->name < b->name;
+    });
+    
+    enum VisitState { UNVISITED, ON_PATH, DONE };
+    std::unordered_map<const MacroDefinition*, VisitState> state;
+    struct Visit {
+        MacroDefinition* macro;
+        size_t nextLine;
+    };
+    for (MacroDefinition* root : macros) {
+        if (state[root] != UNVISITED) {
+            continue;
+        }
+        std::vector<Visit> path(1, Visit{root, 0});
+        state[root] = ON_PATH;
+        while (!path.empty()) {
+            Visit& visit = path.back();
+            if (visit.nextLine == visit.macro->code.size()) {
+                state[visit.macro] = DONE;
+                path.pop_back();
+                continue;
             }
-            
-            // Insert SKZ between lines if requested (but not after the last line)
-            if (insertSKZ && i < expandedBody.size() - 1) {
-                std::cout << "Adding SKZ between macro lines" << std::endl;
-                instructions.push_back("SKZ");
+            BodyLine& line = visit.macro->code[visit.nextLine++];
+            if (line.kind != LINE_CALL) {
+                continue;
+            }
+            if (!line.target) {
+                line.target = resolveSymbol(line.callee).macro;
             }
+            if (!line.target) {
+                continue;
+            }
+            VisitState& calleeState = state[line.target];
+            if (calleeState == ON_PATH) {
+                // Only a warning: the cycle is harmless until something invokes it
+                std::string cycle;
+                size_t start = 0;
+                while (path[start].macro != line.target) {
+                    ++start;
+                }
+                for (size_t i = start; i < path.size(); ++i) {
+                    cycle += path[i].macro->name + " -> ";
+                }
+                cycle += line.target->name;
+                diagnostics.report(SEVERITY_WARNING, "Recursive macro: " + cycle,
+                                   locate(visit.macro->sourceLines[visit.nextLine - 1]));
+            } else if (calleeState == UNVISITED) {
+                calleeState = ON_PATH;
+                path.push_back(Visit{line.target, 0});
+            }
+        }
+    }
+}
+
+void Assembler::measureProgram() {
+    // Pair SKZ with the invocation after it exactly as expansion does
+    lineStatus.assign(programLines.size(), SIZE_OK);
+    uint64_t total = 0;
+    for (size_t i = 0; i < programLines.size(); ++i) {
+        bool insertSKZ = false;
+        if (symbols.info(programLines[i]).opcode == OP_SKZ && i + 1 < programLines.size() &&
+            resolveSymbol(programLines[i + 1]).invocation) {
+            insertSKZ = true;
+            ++i;
+        }
+        const SymbolInfo& info = resolveSymbol(programLines[i]);
+        if (!info.invocation) {
+            total = saturatingAdd(total, info.opcode != OP_NONE ? 1 : 0);
+            continue;
+        }
+        MacroDefinition& macro = *info.invocation;
+        std::vector<SymbolId> arguments = info.arguments;
+        SizeEntry size = measureExpansion(macro, arguments, insertSKZ, 0);
+        lineStatus[i] = size.status;
+        if (size.status == SIZE_OK) {
+            total = saturatingAdd(total, size.instructions);
+        }
+    }
+    const uint64_t INSTRUCTION_MULTIPLE = 27;
+    expandedSize = saturatingAdd(total, (INSTRUCTION_MULTIPLE - total % INSTRUCTION_MULTIPLE) % INSTRUCTION_MULTIPLE);
+}
+
+Assembler::SizeEntry Assembler::measureExpansion(MacroDefinition& macro, const std::vector<SymbolId>& arguments,
+                                                 bool insertSKZ, int depth) {
+    // Mirrors pushExpansionFrame() and expandStep(), counting instructions
+    // instead of yielding them. Entries are keyed like the expansion cache;
+    // a key met again while still being measured is a recursion.
+    SizeEntry result;
+    if (depth >= MAX_NESTED_MACRO_DEPTH) {
+        result.status = SIZE_TOO_DEEP;
+        result.failDepth = depth;
+        return result;
+    }
+    if (arguments.size() != macro.parameters.size()) {
+        return result;  // Reported when expanded; yields nothing
+    }
+    for (SymbolId argument : arguments) {
+        if (!resolveSymbol(argument).validArgument) {
+            return result;
+        }
+    }
+    
+    std::u32string key(1, macro.symbol);
+    key.append(arguments.begin(), arguments.end());
+    key.push_back(insertSKZ ? 1 : 0);
+    auto memo = sizeMemo.find(key);
+    if (memo != sizeMemo.end()) {
+        const SizeEntry& entry = memo->second;
+        if (entry.status == SIZE_PENDING) {
+            result.status = SIZE_RECURSIVE;
+            return result;
+        }
+        if (entry.status == SIZE_OK && depth + entry.height > MAX_NESTED_MACRO_DEPTH) {
+            result.status = SIZE_TOO_DEEP;
+            result.failDepth = depth;
+            return result;
+        }
+        // Too deep from an earlier depth says nothing about shallower ones
+        if (entry.status != SIZE_TOO_DEEP || depth >= entry.failDepth) {
+            return entry;
         }
-    } else {
-        std::cerr << "Unknown macro: " << macroName << std::endl;
     }
+    sizeMemo[key].status = SIZE_PENDING;
     
-}
\ No newline at end of file
+    uint64_t total = 0;
+    int height = 0;
+    std::vector<SymbolId> nestedArguments;
+    for (const BodyLine& line : macro.code) {
+        MacroDefinition* callee = nullptr;
+        nestedArguments.clear();
+        switch (line.kind) {
+            case LINE_TEXT:
+                total = saturatingAdd(total, line.opcode != OP_NONE ? 1 : 0);
+                break;
+            case LINE_PARAM: {
+                const SymbolInfo& info = resolveSymbol(arguments[line.param]);
+                if (info.invocation) {
+                    callee = info.invocation;
+                    nestedArguments = info.arguments;
+                } else {
+                    total = saturatingAdd(total, info.opcode != OP_NONE ? 1 : 0);
+                }
+                break;
+            }
+            case LINE_PARAM_CALL:
+                callee = resolveSymbol(arguments[line.param]).macro;
+                break;
+            case LINE_CALL:
+                callee = line.target ? line.target : resolveSymbol(line.callee).macro;
+                for (const CallArgument& argument : line.arguments) {
+                    nestedArguments.push_back(argument.param >= 0 ? arguments[argument.param] : argument.symbol);
+                }
+                break;
+        }
+        if (!callee) {
+            continue;
+        }
+        SizeEntry nested = measureExpansion(*callee, nestedArguments, insertSKZ, depth + 1);
+        if (nested.status != SIZE_OK) {
+            result = nested;
+            break;
+        }
+        total = saturatingAdd(total, nested.instructions);
+        height = std::max(height, nested.height);
+    }
+    if (result.status == SIZE_OK) {
+        result.instructions = saturatingAdd(total, insertSKZ && !macro.code.empty() ? macro.code.size() - 1 : 0);
+        result.height = height + 1;
+    } else if (result.status == SIZE_TOO_DEEP) {
+        result.failDepth = depth;
+    }
+    sizeMemo[key] = result;
+    return result;
+}
+
+bool Assembler::checkExpansionSize(size_t index, ExpansionCursor& cursor) {
+    // Invocations that would never finish are refused before any output
+    switch (lineStatus[index]) {
+        case SIZE_RECURSIVE:
+            reportExpansionError(cursor, "Recursive macro invocation skipped: " + symbols.text(programLines[index]));
+            break;
+        case SIZE_TOO_DEEP:
+            reportExpansionError(cursor, "Maximum nested macro depth exceeded expanding " + symbols.text(programLines[index]));
+            break;
+        default:
+            return true;
+    }
+    return false;
+}
+
+bool Assembler::withinBudget(size_t bytesPerInstruction) {
+    if (instructionBudget != 0 && expandedSize > instructionBudget) {
+        diagnostics.report(SEVERITY_ERROR, "Program expands to " + std::to_string(expandedSize) +
+                           " instructions, over the budget of " + std::to_string(instructionBudget));
+        overBudget = true;
+    } else if (memoryBudget != 0 && bytesPerInstruction != 0 && expandedSize > memoryBudget / bytesPerInstruction) {
+        diagnostics.report(SEVERITY_ERROR, "Assembling " + std::to_string(expandedSize) + " instructions needs over " +
+                           std::to_string(memoryBudget) + " bytes, the memory budget");
+        overBudget = true;
+    } else if (memoryBudget == 0 && bytesPerInstruction != 0) {
+        // Without a budget, still refuse what could never be stored
+        uint64_t memory = physicalMemory();
+        if (expandedSize > discInstructions.max_size() / bytesPerInstruction ||
+            (memory != 0 && expandedSize > memory / bytesPerInstruction)) {
+            diagnostics.report(SEVERITY_ERROR, "Assembling " + std::to_string(expandedSize) +
+                               " instructions needs more memory than this machine has");
+            overBudget = true;
+        }
+    }
+    return !overBudget;
+}
+
+bool Assembler::checkInstructionBudget() {
+    defineMacros();
+    bool fits = withinBudget(0);
+    diagnostics.flush();
+    return fits;
+}
+
+uint64_t Assembler::getExpandedSize() {
+    defineMacros();
+    return expandedSize;
+}
+
+uint64_t Assembler::measureInvocation(const std::string& invocation, bool insertSKZ) {
+    defineMacros();
+    const SymbolInfo& info = resolveSymbol(symbols.intern(invocation));
+    if (!info.invocation) {
+        return info.opcode != OP_NONE ? 1 : 0;
+    }
+    MacroDefinition& macro = *info.invocation;
+    std::vector<SymbolId> arguments = info.arguments;
+    SizeEntry size = measureExpansion(macro, arguments, insertSKZ, 0);
+    return size.status == SIZE_OK ? size.instructions : UINT64_MAX;
+}
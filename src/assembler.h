@@ -1,11 +1,22 @@
 #pragma once
 
+#include <cstdint>
 #include <iostream>
 #include <fstream>
 #include <string>
+#include <deque>
 #include <unordered_map>
 #include <vector> 
 #include <filesystem>
+#include <memory>
+#include <string_view>
+#include "diagnostics.h"
+#include "emitter.h"
+#include "isa.h"
+#include "optimizer.h"
+#include "source_file.h"
+
+class ThreadPool;
 
 class Assembler {
     public:
@@ -13,39 +24,246 @@ class Assembler {
         Assembler();
         ~Assembler() = default;
         bool readAssemblyFile(const std::string& inputFile);
-        void assemble();
+        // Both return false, without expanding anything, when the program
+        // is over its instruction or memory budget
+        bool assemble();
+        // Expands chunks of the top-level program on the pool and joins them
+        // in order; output and diagnostics match a serial assemble()
+        bool assemble(ThreadPool& pool);
         void writeOutput(const std::string& outputFile);
         void writeOutputCommand(const std::string& outputFile);
-        const std::vector<std::string>& getInstructions() const { 
+        // Writes the program in any format; false if anything went wrong,
+        // including errors reported while assembling
+        bool writeOutput(const std::string& outputFile, OutputFormat format);
+        // Feeds the program through an emitter and finishes it
+        bool emit(ProgramEmitter& emitter);
+        // Runs the peephole optimizer over the assembled program; false if
+        // there is no assembled program or nothing could be saved
+        bool optimize();
+        const PeepholeOptimizer::Stats& getOptimizationStats() const { return optimizer.getStats(); }
+        void printOptimizationStats() const;
+        // Lets optimize() apply a superoptimizer rewrite table, or none
+        void setRewriteTable(const RewriteTable* table) { optimizer.setRewrites(table); }
+        // The program as opcodes; getInstructions() spells it out as mnemonics
+        const std::vector<Opcode>& getOpcodes() const { 
             return discInstructions; 
         }
+        const std::vector<std::string>& getInstructions() const;
+        
+        // Pull-based expansion: yields the final opcodes one at a time,
+        // padding included. Before assemble() it expands on demand, keeping
+        // only the macro expansion stack in memory and skipping the
+        // expansion cache; afterwards it walks the assembled program.
+        class InstructionStream;
+        InstructionStream streamInstructions();
         
         int getMacroCount() const { 
             return macroTable.size(); 
         }
         
+        // Everything the assembler has to say goes through this sink. By
+        // default only warnings and errors are kept; lower the threshold for
+        // pass progress (SEVERITY_NOTE) or per-line tracing (SEVERITY_TRACE).
+        DiagnosticSink& getDiagnostics() { return diagnostics; }
+        size_t getErrorCount() const { return diagnostics.errorCount(); }
+        
+        // Sizes are counted over the compiled macro bodies before anything is
+        // expanded. An instruction budget of 0 means no limit; a memory budget
+        // of 0 still refuses programs larger than physical memory. Memory
+        // counts the stored program.
+        void setInstructionBudget(uint64_t instructions) { instructionBudget = instructions; }
+        void setMemoryBudget(uint64_t bytes) { memoryBudget = bytes; }
+        // Instructions the program expands to, padding included
+        uint64_t getExpandedSize();
+        // Instruction budget check for streaming, where memory stays bounded by nesting depth
+        bool checkInstructionBudget();
+        // Exact size of one invocation such as "twice(DA3)"; UINT64_MAX if it never finishes
+        uint64_t measureInvocation(const std::string& invocation, bool insertSKZ = false);
+        
+        // Expansions of a macro with the same arguments and SKZ mode are
+        // expanded once and copied afterwards
+        struct ExpansionCacheStats {
+            size_t hits = 0;
+            size_t misses = 0;
+            size_t copiedInstructions = 0;  // Instructions copied on hits instead of expanded
+        };
+        const ExpansionCacheStats& getExpansionCacheStats() const { return cacheStats; }
+        void printExpansionCacheStats() const;
+        
         // Make these public for unit testing
         void removeComments(std::string& line);
         void trimWhitespace(std::string& line);
 
     private:
-        void parseMacroDefinition(std::vector<std::string>::iterator& currentLine, 
-                                  const std::vector<std::string>::iterator& end);
-        void parseMacroInvocation(const std::string& line, std::vector<std::string>& instructions, bool insertSKZ = false);
+        void parseMacroDefinition(std::vector<SourceLine>::iterator& currentLine, 
+                                  const std::vector<SourceLine>::iterator& end);
+
+        struct MacroDefinition;
+
+        // Macro names, parameters, arguments and source lines are interned once
+        // and handled as ids from then on
+        typedef uint32_t SymbolId;
+
+        // What a symbol's text means; resolved on first use in the second
+        // pass, once every macro is defined
+        struct SymbolInfo {
+            Opcode opcode = OP_NONE;
+            bool resolved = false;
+            MacroDefinition* macro = nullptr;       // The symbol names this macro
+            MacroDefinition* invocation = nullptr;  // The symbol is a call "name(...)" to this macro
+            std::vector<SymbolId> arguments;        // Arguments of that call
+            bool validArgument = false;             // Opcode, macro name or macro invocation
+        };
+
+        class SymbolTable {
+            public:
+                SymbolId intern(std::string_view text);
+                const std::string& text(SymbolId id) const { return arena[id]; }
+                SymbolInfo& info(SymbolId id) { return infos[id]; }
+                size_t size() const { return arena.size(); }
+            private:
+                // Each symbol's text is stored once in the arena; the map's
+                // keys view those strings, which a deque never moves
+                std::deque<std::string> arena;
+                std::unordered_map<std::string_view, SymbolId> ids;
+                std::vector<SymbolInfo> infos;
+        };
+
+        // Macro bodies are compiled once, when defined, into these lines, so an
+        // invocation binds arguments to slots instead of rewriting strings
+        enum BodyLineKind {
+            LINE_TEXT,        // Emitted as written (opcodes)
+            LINE_PARAM,       // A parameter on its own, e.g. "LEFT"
+            LINE_PARAM_CALL,  // A call through a parameter, e.g. "one_val()"
+            LINE_CALL         // A nested call, e.g. "abc(b, c, DA3)"
+        };
+
+        struct CallArgument {
+            int param;        // Parameter slot, or -1 to pass the symbol itself
+            SymbolId symbol;
+        };
+
+        struct BodyLine {
+            BodyLineKind kind = LINE_TEXT;
+            SymbolId text = 0;                    // The source line
+            Opcode opcode = OP_NONE;              // LINE_TEXT lines that are opcodes
+            int param = -1;                       // Slot for LINE_PARAM and LINE_PARAM_CALL
+            SymbolId callee = 0;                  // Macro called by LINE_CALL
+            std::vector<CallArgument> arguments;  // Arguments of LINE_CALL
+            MacroDefinition* target = nullptr;    // Callee, looked up on first expansion
+            bool checked = false;                 // Call has expanded once with valid arguments
+        };
 
         // Struct definition goes inside the class if it's only used by this class
         struct MacroDefinition {
             std::string name;
+            SymbolId symbol = 0;
             std::vector<std::string> parameters;  // Formal parameters in the macro definition
             std::vector<std::string> body;        // The macro body lines
+            std::vector<BodyLine> code;           // The body compiled by compileMacroBody()
+            SourceLine definition;                // The "def" line
+            std::vector<SourceLine> sourceLines;  // Where each body line was written
+        };
+
+        // One macro being expanded; the expansion stack replaces recursion
+        struct ExpansionFrame {
+            MacroDefinition* macro;
+            size_t argumentBase;     // First of this frame's arguments in Expansion::arguments
+            size_t nextLine = 0;     // Next body line to expand
+            bool lineOpen = false;   // Body line nextLine - 1 still needs its trailing SKZ
+            bool insertSKZ = false;  // Interleave SKZ between body lines
+            std::u32string cacheKey; // Where the expansion is cached once the frame pops
+            size_t outputStart = 0;  // First instruction this frame emitted
+            size_t errorsAtStart = 0;
+        };
+
+        // Working state of one top-level invocation
+        struct Expansion {
+            std::vector<ExpansionFrame> frames;
+            std::vector<SymbolId> arguments;  // Bound arguments of every frame, stacked
         };
 
+        // Resumable second pass: the next top-level line, the macro stack,
+        // and any cached span still being copied
+        typedef std::unordered_map<std::u32string, std::pair<size_t, size_t>> ExpansionCache;
+
+        struct ExpansionCursor {
+            size_t nextLine = 0;     // Next entry of programLines
+            size_t endLine = SIZE_MAX;
+            Expansion expansion;
+            size_t copyNext = 0;     // Cached span of *output being replayed
+            size_t copyEnd = 0;
+            size_t emitted = 0;      // Opcodes yielded so far, padding excluded
+            size_t padding = 0;      // NOPs still to yield
+            bool padded = false;     // Padding has been worked out (or is not wanted)
+            // Where yields are stored; with a cache, expansions are cached as spans
+            // of it. Tracing runs without one, so every line is traced.
+            std::vector<Opcode>* output = nullptr;
+            ExpansionCache* cache = nullptr;
+            ExpansionCacheStats* stats = nullptr;
+            size_t currentLine = SIZE_MAX;  // Top-level line being expanded
+            // Where errors and tracing go; expansions with errors are not cached
+            DiagnosticSink* diagnostics = nullptr;
+            bool trace = false;      // Tracing is wanted, so the messages are worth building
+            bool concurrent = false; // Other cursors are running: shared state is read-only
+        };
+
+        // Outcome of measuring an expansion
+        enum SizeStatus : uint8_t {
+            SIZE_OK,
+            SIZE_RECURSIVE,  // Expands itself again, so never finishes
+            SIZE_TOO_DEEP,   // Nests past MAX_NESTED_MACRO_DEPTH
+            SIZE_PENDING     // Still being measured
+        };
+        struct SizeEntry {
+            uint64_t instructions = 0;  // Saturates at UINT64_MAX
+            int height = 0;             // Deepest stack of frames the expansion pushes
+            int failDepth = 0;          // SIZE_TOO_DEEP: depth it was measured from
+            SizeStatus status = SIZE_OK;
+        };
+
+        void defineMacros();
+        void reportRecursiveMacros();
+        void measureProgram();
+        SizeEntry measureExpansion(MacroDefinition& macro, const std::vector<SymbolId>& arguments, bool insertSKZ, int depth);
+        bool checkExpansionSize(size_t index, ExpansionCursor& cursor);
+        bool withinBudget(size_t bytesPerInstruction);
+        void resolveAllSymbols();
+        size_t paddingFor(size_t instructionCount);
+        void compileMacroBody(MacroDefinition& macro);
+        SymbolInfo& resolveSymbol(SymbolId id);
+        bool nextInstruction(ExpansionCursor& cursor, Opcode& opcode);
+        bool expandStep(ExpansionCursor& cursor, Opcode& opcode);
+        bool pushInvocation(SymbolId line, bool insertSKZ, ExpansionCursor& cursor);
+        bool pushExpansionFrame(MacroDefinition& macro, bool insertSKZ, bool checkArguments, ExpansionCursor& cursor);
+        bool emitInstruction(SymbolId line, Opcode& opcode, ExpansionCursor& cursor);
+        void startCursor(ExpansionCursor& cursor, DiagnosticSink& sink);
+        SourceLocation locate(const SourceLine& line) const;
+        void reportExpansionError(ExpansionCursor& cursor, const std::string& message);
+
         // Member variables
         std::unordered_map<std::string, MacroDefinition> macroTable;
+        SymbolTable symbols;
+        // Span of discInstructions holding each cached expansion, keyed by the
+        // macro's symbol, its argument symbols and the SKZ mode
+        ExpansionCache expansionCache;
+        ExpansionCacheStats cacheStats;
+        DiagnosticSink diagnostics;
+        PeepholeOptimizer optimizer;
 
-        std::unordered_map<std::string, std::string> opcodeTable;
-        std::vector<std::string> discInstructions;
-        std::vector<std::string> assemblyFile;
+        std::vector<SymbolId> programLines;  // Top-level lines left after the first pass
+        bool macrosDefined = false;           // First pass has run
+        bool assembled = false;               // discInstructions holds the whole program
+        std::vector<uint8_t> lineStatus;      // SizeStatus of each top-level invocation
+        std::unordered_map<std::u32string, SizeEntry> sizeMemo;
+        uint64_t expandedSize = 0;
+        uint64_t instructionBudget = 0;
+        uint64_t memoryBudget = 0;
+        bool overBudget = false;
+        std::vector<Opcode> discInstructions;
+        mutable std::vector<std::string> instructionText;  // Built by getInstructions()
+        std::vector<std::unique_ptr<SourceFile>> sources;  // Files assemblyFile points into
+        std::vector<SourceLine> assemblyFile;
 
         bool isValidOpcode(const std::string& opcode);
         bool isValidMacroParameter(const std::string& line, const MacroDefinition& macro);
@@ -53,4 +271,20 @@ class Assembler {
         bool isMacroInvocation(const std::string& line);
         void findParameters(const std::string& line, std::vector<std::string>& parameters);
         const int MAX_NESTED_MACRO_DEPTH = 1024;
+        // Invocations listed under an error from deep inside an expansion
+        const size_t MAX_BACKTRACE = 8;
+};
+
+class Assembler::InstructionStream {
+    public:
+        // Sets opcode to the next instruction; false once the program is done
+        bool next(Opcode& opcode);
+
+    private:
+        friend class Assembler;
+        explicit InstructionStream(Assembler& assembler) : assembler(&assembler) {}
+
+        Assembler* assembler;
+        size_t index = 0;         // Position in an assembled program
+        ExpansionCursor cursor;   // Expansion state otherwise
 };
\ No newline at end of file
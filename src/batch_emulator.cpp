@@ -0,0 +1,451 @@
+#include "batch_emulator.h"
+#include "bit_utils.h"
+#include <algorithm>
+#include <iostream>
+
+const int BatchEmulator::LANES_PER_WORD;
+
+BatchEmulator::BatchEmulator(int laneCount)
+    : laneCount(0), words(0), tapeMode(false), programCounter(0), cycles(0) {
+    words = (laneCount + LANES_PER_WORD - 1) / LANES_PER_WORD;
+    if (words < 1) {
+        words = 1;
+    }
+    this->laneCount = words * LANES_PER_WORD;
+
+    reg.assign(words, 0);
+    for (int i = 0; i < 2; ++i) {
+        memory[i].assign(words, 0);
+    }
+    for (int i = 0; i < 8; ++i) {
+        input[i].assign(words, 0);
+        output[i].assign(words, 0);
+        selected[i].assign(words, 0);
+    }
+    skipNext.assign(words, 0);
+    halted.assign(words, 0);
+    active.assign(words, 0);
+    value.assign(words, 0);
+    scratch.assign(words, 0);
+    haltCycle.assign(this->laneCount, 0);
+    reset();
+}
+
+bool BatchEmulator::loadProgram(const std::vector<uint8_t>& decodedProgram) {
+    if (decodedProgram.empty()) {
+        std::cerr << "No instructions found in program." << std::endl;
+        return false;
+    }
+    program = decodedProgram;
+    reset();
+    return true;
+}
+
+void BatchEmulator::reset() {
+    // Like Emulator::reset(), this also clears inputs and turns tape mode off
+    programCounter = 0;
+    cycles = 0;
+    tapeMode = false;
+    for (int w = 0; w < words; ++w) {
+        reg[w] = 0;
+        memory[0][w] = 0;
+        memory[1][w] = 0;
+        skipNext[w] = 0;
+        halted[w] = 0;
+        for (int i = 0; i < 8; ++i) {
+            input[i][w] = 0;
+            output[i][w] = 0;
+            selected[i][w] = 0;
+        }
+        selected[0][w] = ~Word(0);  // DA1 selected at reset
+    }
+    std::fill(haltCycle.begin(), haltCycle.end(), 0);
+    tape1.clear(words, laneCount);
+    tape2.clear(words, laneCount);
+}
+
+uint64_t BatchEmulator::run(uint64_t maxCycles) {
+    uint64_t startCycles = cycles;
+    while (maxCycles == 0 || cycles - startCycles < maxCycles) {
+        if (programCounter >= static_cast<int>(program.size())) {
+            // End of pass: lanes with the HALT flag (DA2) set stop, the rest loop
+            for (int w = 0; w < words; ++w) {
+                scratch[w] = memory[1][w] & ~halted[w];
+            }
+            haltLanes(scratch);
+            programCounter = 0;
+        }
+        if (allHalted() || program.empty()) {
+            break;
+        }
+        stepAll();
+    }
+    return cycles - startCycles;
+}
+
+bool BatchEmulator::allHalted() const {
+    for (int w = 0; w < words; ++w) {
+        if (~halted[w]) {
+            return false;
+        }
+    }
+    return true;
+}
+
+void BatchEmulator::haltLanes(const Mask& lanes) {
+    for (int w = 0; w < words; ++w) {
+        Word newlyHalted = lanes[w] & ~halted[w];
+        halted[w] |= newlyHalted;
+        while (newlyHalted) {
+            int bit = lowestSetBit(newlyHalted);
+            haltCycle[w * LANES_PER_WORD + bit] = cycles;
+            newlyHalted &= newlyHalted - 1;
+        }
+    }
+}
+
+void BatchEmulator::stepAll() {
+    uint8_t opcode = program[programCounter];
+    cycles++;
+
+    // Lanes with a pending skip consume it instead of executing
+    for (int w = 0; w < words; ++w) {
+        active[w] = ~halted[w] & ~skipNext[w];
+        skipNext[w] = 0;
+    }
+
+    switch (opcode) {
+        case OP_NOT:
+            for (int w = 0; w < words; ++w) {
+                reg[w] ^= active[w];
+            }
+            break;
+        case OP_SKZ:  // Skip next instruction where the SKIP flag (DA1 memory) is high
+            for (int w = 0; w < words; ++w) {
+                skipNext[w] = active[w] & memory[0][w];
+            }
+            break;
+        case OP_OR:
+            readSelected(value, false);
+            for (int w = 0; w < words; ++w) {
+                reg[w] |= value[w] & active[w];
+            }
+            break;
+        case OP_LD:
+            readSelected(value, true);
+            for (int w = 0; w < words; ++w) {
+                reg[w] = (reg[w] & ~active[w]) | (value[w] & active[w]);
+            }
+            break;
+        case OP_XOR:
+            readSelected(value, false);
+            for (int w = 0; w < words; ++w) {
+                reg[w] ^= value[w] & active[w];
+            }
+            break;
+        case OP_OUT:
+            executeOutput();
+            break;
+        case OP_AND:
+            readSelected(value, false);
+            for (int w = 0; w < words; ++w) {
+                reg[w] &= value[w] | ~active[w];
+            }
+            break;
+        case OP_DA1: case OP_DA2: case OP_DA3: case OP_DA4:
+        case OP_DA5: case OP_DA6: case OP_DA7: case OP_DA8: {
+            int dataLine = opcode - OP_DA1;
+            for (int i = 0; i < 8; ++i) {
+                for (int w = 0; w < words; ++w) {
+                    Word keep = selected[i][w] & ~active[w];
+                    selected[i][w] = (i == dataLine) ? (keep | active[w]) : keep;
+                }
+            }
+            break;
+        }
+        default:
+            // Unknown instruction halts every lane that tried to execute it
+            haltLanes(active);
+            break;
+    }
+
+    programCounter++;
+}
+
+void BatchEmulator::readSelected(Mask& result, bool forLoad) {
+    std::fill(result.begin(), result.end(), 0);
+    for (int i = 0; i < 8; ++i) {
+        const Mask* source = &input[i];
+        if (i < 2) {
+            source = &memory[i];
+        } else if (tapeMode) {
+            const isa::InstructionInfo& info = isa::INSTRUCTIONS[OP_DA1 + i];
+            if (info.role == isa::ROLE_TAPE_HEAD) {
+                bool anySelected = false;
+                for (int w = 0; w < words && !anySelected; ++w) {
+                    anySelected = (selected[i][w] & active[w]) != 0;
+                }
+                if (!anySelected) {
+                    continue;
+                }
+                (info.tape == 0 ? tape1 : tape2).read(scratch);
+                source = &scratch;
+            } else if (forLoad) {
+                // LD from a tape shift line leaves the register untouched
+                source = &reg;
+            }
+        }
+        for (int w = 0; w < words; ++w) {
+            result[w] |= selected[i][w] & (*source)[w];
+        }
+    }
+}
+
+void BatchEmulator::executeOutput() {
+    for (int i = 0; i < 2; ++i) {
+        for (int w = 0; w < words; ++w) {
+            Word lanes = active[w] & selected[i][w];
+            memory[i][w] = (memory[i][w] & ~lanes) | (reg[w] & lanes);
+        }
+    }
+
+    if (!tapeMode) {
+        for (int i = 2; i < 8; ++i) {
+            for (int w = 0; w < words; ++w) {
+                Word lanes = active[w] & selected[i][w];
+                output[i][w] = (output[i][w] & ~lanes) | (reg[w] & lanes);
+            }
+        }
+        return;
+    }
+
+    // Tape lines only act where the register is high
+    // Tape 1: DA3 (left), DA4 (toggle), DA5 (right); Tape 2: DA6, DA7, DA8
+    for (int i = 2; i < 8; ++i) {
+        bool any = false;
+        for (int w = 0; w < words; ++w) {
+            scratch[w] = active[w] & selected[i][w] & reg[w];
+            any = any || scratch[w] != 0;
+        }
+        if (!any) {
+            continue;
+        }
+        const isa::InstructionInfo& info = isa::INSTRUCTIONS[OP_DA1 + i];
+        BatchTape& tape = info.tape == 0 ? tape1 : tape2;
+        switch (info.role) {
+            case isa::ROLE_TAPE_LEFT: tape.move(scratch, -1); break;
+            case isa::ROLE_TAPE_HEAD: tape.toggle(scratch); break;
+            case isa::ROLE_TAPE_RIGHT: tape.move(scratch, 1); break;
+            default: break;
+        }
+    }
+}
+
+void BatchEmulator::setDataInput(int lane, int dataLine, bool value) {
+    if (lane >= 0 && lane < laneCount && dataLine >= 2 && dataLine < 8) {
+        setBit(input[dataLine], lane, value);
+    }
+}
+
+void BatchEmulator::setTapeCell(int lane, int tapeIndex, int position, bool value) {
+    if (lane < 0 || lane >= laneCount) {
+        return;
+    }
+    BatchTape& tape = tapeIndex == 0 ? tape1 : tape2;
+    Word* cell = tape.touchCell(position);
+    Word bitMask = Word(1) << (lane % LANES_PER_WORD);
+    if (value) {
+        cell[lane / LANES_PER_WORD] |= bitMask;
+    } else {
+        cell[lane / LANES_PER_WORD] &= ~bitMask;
+    }
+}
+
+void BatchEmulator::setMemoryValue(int lane, int dataLine, bool value) {
+    if (dataLine >= 0 && dataLine < 2) {
+        setLaneBit(memory[dataLine], lane, value);
+    }
+}
+
+void BatchEmulator::setSelectedDataLine(int lane, int dataLine) {
+    if (dataLine >= 0 && dataLine < 8) {
+        for (int i = 0; i < 8; ++i) {
+            setLaneBit(selected[i], lane, i == dataLine);
+        }
+    }
+}
+
+void BatchEmulator::setDataOutput(int lane, int dataLine, bool value) {
+    if (dataLine >= 2 && dataLine < 8) {
+        setLaneBit(output[dataLine], lane, value);
+    }
+}
+
+void BatchEmulator::diffLanes(const BatchEmulator& other, std::vector<Word>& differ) const {
+    differ.assign(words, 0);
+    if (other.words != words) {
+        std::fill(differ.begin(), differ.end(), ~Word(0));
+        return;
+    }
+    for (int w = 0; w < words; ++w) {
+        Word bits = (reg[w] ^ other.reg[w]) | (skipNext[w] ^ other.skipNext[w]) | (halted[w] ^ other.halted[w]) |
+                    (memory[0][w] ^ other.memory[0][w]) | (memory[1][w] ^ other.memory[1][w]);
+        for (int i = 0; i < 8; ++i) {
+            bits |= (selected[i][w] ^ other.selected[i][w]) | (output[i][w] ^ other.output[i][w]);
+        }
+        differ[w] = bits;
+    }
+    tape1.diff(other.tape1, differ);
+    tape2.diff(other.tape2, differ);
+}
+
+bool BatchEmulator::getDataOutput(int lane, int dataLine) const {
+    if (dataLine >= 0 && dataLine < 8) {
+        return getBit(output[dataLine], lane);
+    }
+    return false;
+}
+
+bool BatchEmulator::getMemoryValue(int lane, int dataLine) const {
+    if (dataLine >= 0 && dataLine < 2) {
+        return getBit(memory[dataLine], lane);
+    }
+    return false;
+}
+
+int BatchEmulator::getSelectedDataLine(int lane) const {
+    for (int i = 0; i < 8; ++i) {
+        if (getBit(selected[i], lane)) {
+            return i;
+        }
+    }
+    return 0;
+}
+
+bool BatchEmulator::getTapeCell(int lane, int tapeIndex, int position) const {
+    const Word* cell = (tapeIndex == 0 ? tape1 : tape2).cell(position);
+    return cell && ((cell[lane / LANES_PER_WORD] >> (lane % LANES_PER_WORD)) & 1);
+}
+
+int BatchEmulator::getTapeHead(int lane, int tapeIndex) const {
+    return (tapeIndex == 0 ? tape1 : tape2).head(lane);
+}
+
+void BatchEmulator::BatchTape::clear(int wordCount, int laneCount) {
+    words = wordCount;
+    std::fill(rightCells.begin(), rightCells.end(), 0);
+    std::fill(leftCells.begin(), leftCells.end(), 0);
+    uniform = true;
+    commonHead = 0;
+    heads.assign(laneCount, 0);
+}
+
+const BatchEmulator::Word* BatchEmulator::BatchTape::cell(int position) const {
+    const std::vector<Word>& cells = position >= 0 ? rightCells : leftCells;
+    size_t index = static_cast<size_t>(position >= 0 ? position : ~position) * words;
+    return index < cells.size() ? &cells[index] : nullptr;
+}
+
+BatchEmulator::Word* BatchEmulator::BatchTape::touchCell(int position) {
+    std::vector<Word>& cells = position >= 0 ? rightCells : leftCells;
+    size_t index = static_cast<size_t>(position >= 0 ? position : ~position) * words;
+    if (index >= cells.size()) {
+        // Grow geometrically so sweeping heads stay amortised O(1)
+        cells.resize(std::max(index + words, cells.size() * 2), 0);
+    }
+    return &cells[index];
+}
+
+void BatchEmulator::BatchTape::read(Mask& value) const {
+    if (uniform) {
+        const Word* current = cell(commonHead);
+        for (int w = 0; w < words; ++w) {
+            value[w] = current ? current[w] : 0;
+        }
+        return;
+    }
+    for (int w = 0; w < words; ++w) {
+        Word bits = 0;
+        for (int bit = 0; bit < LANES_PER_WORD; ++bit) {
+            const Word* current = cell(heads[w * LANES_PER_WORD + bit]);
+            if (current && ((current[w] >> bit) & 1)) {
+                bits |= Word(1) << bit;
+            }
+        }
+        value[w] = bits;
+    }
+}
+
+void BatchEmulator::BatchTape::toggle(const Mask& lanes) {
+    if (uniform) {
+        Word* current = touchCell(commonHead);
+        for (int w = 0; w < words; ++w) {
+            current[w] ^= lanes[w];
+        }
+        return;
+    }
+    for (int w = 0; w < words; ++w) {
+        Word remaining = lanes[w];
+        while (remaining) {
+            int bit = lowestSetBit(remaining);
+            touchCell(heads[w * LANES_PER_WORD + bit])[w] ^= Word(1) << bit;
+            remaining &= remaining - 1;
+        }
+    }
+}
+
+void BatchEmulator::BatchTape::diff(const BatchTape& other, Mask& differ) const {
+    // Cells are laid out alike in both, and cells never touched are blank
+    const std::vector<Word>* mine[2] = {&rightCells, &leftCells};
+    const std::vector<Word>* theirs[2] = {&other.rightCells, &other.leftCells};
+    for (int side = 0; side < 2; ++side) {
+        size_t size = std::max(mine[side]->size(), theirs[side]->size());
+        for (size_t index = 0; index < size; ++index) {
+            Word a = index < mine[side]->size() ? (*mine[side])[index] : 0;
+            Word b = index < theirs[side]->size() ? (*theirs[side])[index] : 0;
+            differ[index % words] |= a ^ b;
+        }
+    }
+    if (uniform && other.uniform) {
+        if (commonHead != other.commonHead) {
+            std::fill(differ.begin(), differ.end(), ~Word(0));
+        }
+        return;
+    }
+    for (int lane = 0; lane < words * LANES_PER_WORD; ++lane) {
+        if (head(lane) != other.head(lane)) {
+            differ[lane / LANES_PER_WORD] |= Word(1) << (lane % LANES_PER_WORD);
+        }
+    }
+}
+
+void BatchEmulator::BatchTape::move(const Mask& lanes, int delta) {
+    bool all = true;
+    for (int w = 0; w < words && all; ++w) {
+        all = lanes[w] == ~Word(0);
+    }
+    if (uniform && all) {
+        commonHead += delta;
+        return;
+    }
+    if (uniform) {
+        std::fill(heads.begin(), heads.end(), commonHead);
+        uniform = false;
+    }
+    for (int w = 0; w < words; ++w) {
+        Word remaining = lanes[w];
+        while (remaining) {
+            int bit = lowestSetBit(remaining);
+            heads[w * LANES_PER_WORD + bit] += delta;
+            remaining &= remaining - 1;
+        }
+    }
+    // Heads that have met up again go back to the shared fast path
+    for (size_t i = 1; i < heads.size(); ++i) {
+        if (heads[i] != heads[0]) {
+            return;
+        }
+    }
+    uniform = true;
+    commonHead = heads[0];
+}
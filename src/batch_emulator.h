@@ -0,0 +1,125 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+#include "isa.h"
+
+// Bit-sliced emulator that runs one program on many independent machines at
+// once. Every machine value is a single bit, so lane i of the machine lives in
+// bit (i % 64) of word (i / 64) and each instruction becomes a few word ops.
+// All lanes share the program counter; SKZ skips, halting and tape head moves
+// are tracked per lane.
+class BatchEmulator {
+public:
+    typedef uint64_t Word;
+    static const int LANES_PER_WORD = 64;
+
+    // laneCount is rounded up to a multiple of 64 (e.g. 64, 256 or 512)
+    explicit BatchEmulator(int laneCount = 64);
+    ~BatchEmulator() = default;
+
+    // Takes the decoded opcodes produced by Emulator::getProgram()
+    bool loadProgram(const std::vector<uint8_t>& decodedProgram);
+    void reset();
+    // Run until every lane halts or maxCycles have passed (0 = unlimited)
+    uint64_t run(uint64_t maxCycles = 0);
+
+    void enableTapeMode(bool enable) { tapeMode = enable; }
+    void setDataInput(int lane, int dataLine, bool value);
+    void setTapeCell(int lane, int tapeIndex, int position, bool value);
+    // Per-lane machine state, so lanes can start anywhere rather than at reset
+    void setRegisterValue(int lane, bool value) { setLaneBit(reg, lane, value); }
+    void setMemoryValue(int lane, int dataLine, bool value);
+    void setSelectedDataLine(int lane, int dataLine);
+    void setDataOutput(int lane, int dataLine, bool value);
+    void setSkipNext(int lane, bool value) { setLaneBit(skipNext, lane, value); }
+
+    int getLaneCount() const { return laneCount; }
+    bool allHalted() const;
+    bool isHalted(int lane) const { return getBit(halted, lane); }
+    uint64_t getHaltCycle(int lane) const { return haltCycle[lane]; }
+    bool getRegisterValue(int lane) const { return getBit(reg, lane); }
+    bool getDataOutput(int lane, int dataLine) const;
+    bool getMemoryValue(int lane, int dataLine) const;
+    int getSelectedDataLine(int lane) const;
+    bool getTapeCell(int lane, int tapeIndex, int position) const;
+    int getTapeHead(int lane, int tapeIndex) const;
+    bool getSkipNext(int lane) const { return getBit(skipNext, lane); }
+    uint64_t getCycleCount() const { return cycles; }
+
+    // Sets bit i of differ[i / 64] for every lane whose machine differs from
+    // the same lane of another batch of the same width: register, flags,
+    // selected line, pending skip, outputs, halting, tape heads and cells
+    void diffLanes(const BatchEmulator& other, std::vector<Word>& differ) const;
+
+private:
+    typedef std::vector<Word> Mask;
+
+    // Bit-sliced tape: every cell holds one bit per lane. While all heads sit
+    // on the same cell a read is a plain word load; once SKZ or halting makes
+    // the lanes move differently, heads are tracked per lane until they meet.
+    struct BatchTape {
+        int words = 0;
+        std::vector<Word> rightCells;  // Cells 0, 1, 2, ... (words per cell)
+        std::vector<Word> leftCells;   // Cells -1, -2, ...
+        bool uniform = true;
+        int commonHead = 0;
+        std::vector<int> heads;        // Only valid while !uniform
+
+        void clear(int wordCount, int laneCount);
+        const Word* cell(int position) const;
+        Word* touchCell(int position);
+        int head(int lane) const { return uniform ? commonHead : heads[lane]; }
+        void read(Mask& value) const;
+        void toggle(const Mask& lanes);
+        void move(const Mask& lanes, int delta);
+        void diff(const BatchTape& other, Mask& differ) const;
+    };
+
+    int laneCount;
+    int words;
+    bool tapeMode;
+    int programCounter;
+    uint64_t cycles;
+
+    std::vector<uint8_t> program;
+
+    Mask reg;
+    Mask memory[2];     // DA1/DA2 memory cells
+    Mask input[8];
+    Mask output[8];
+    Mask selected[8];   // One-hot selected data line per lane
+    Mask skipNext;
+    Mask halted;
+    std::vector<uint64_t> haltCycle;
+
+    BatchTape tape1;
+    BatchTape tape2;
+
+    // Scratch masks reused across instructions
+    Mask active;
+    Mask value;
+    Mask scratch;
+
+    void stepAll();
+    void haltLanes(const Mask& lanes);
+    void readSelected(Mask& result, bool forLoad);
+    void executeOutput();
+
+    static bool getBit(const Mask& mask, int lane) {
+        return (mask[lane / LANES_PER_WORD] >> (lane % LANES_PER_WORD)) & 1;
+    }
+    void setLaneBit(Mask& mask, int lane, bool bit) {
+        if (lane >= 0 && lane < laneCount) {
+            setBit(mask, lane, bit);
+        }
+    }
+    static void setBit(Mask& mask, int lane, bool bit) {
+        Word bitMask = Word(1) << (lane % LANES_PER_WORD);
+        if (bit) {
+            mask[lane / LANES_PER_WORD] |= bitMask;
+        } else {
+            mask[lane / LANES_PER_WORD] &= ~bitMask;
+        }
+    }
+};
@@ -0,0 +1,37 @@
+#pragma once
+
+#include <cerrno>
+#include <cctype>
+#include <cmath>
+#include <cstdint>
+#include <cstdlib>
+
+// Checked parsing of numeric command line arguments. Both return false,
+// leaving value alone, unless the whole text is a number in range.
+
+// A decimal count from 0 to max
+inline bool parseCount(const char* text, uint64_t max, uint64_t& value) {
+    if (!std::isdigit(static_cast<unsigned char>(text[0]))) {
+        return false;  // strtoull would skip spaces and accept a sign
+    }
+    char* end = nullptr;
+    errno = 0;
+    unsigned long long parsed = std::strtoull(text, &end, 10);
+    if (errno != 0 || *end != '\0' || parsed > max) {
+        return false;
+    }
+    value = parsed;
+    return true;
+}
+
+// A finite, non-negative number of seconds
+inline bool parseSeconds(const char* text, double& value) {
+    char* end = nullptr;
+    errno = 0;
+    double parsed = std::strtod(text, &end);
+    if (end == text || errno != 0 || *end != '\0' || !std::isfinite(parsed) || parsed < 0.0) {
+        return false;
+    }
+    value = parsed;
+    return true;
+}
@@ -0,0 +1,162 @@
+#include "dataflow.h"
+
+const int8_t DataflowAnalysis::UNKNOWN;
+
+DataflowAnalysis::DataflowAnalysis(const std::vector<Opcode>& program) : program(program) {
+    solve();
+}
+
+std::vector<size_t> DataflowAnalysis::successors(size_t node) const {
+    size_t size = program.size();
+    if (node == endNode()) {
+        return {0};
+    }
+    if (node == endSkipNode()) {
+        // With one instruction, skipping it reaches the end again
+        return {size >= 2 ? size_t(1) : endNode()};
+    }
+    if (program[node] == OP_SKZ) {
+        return {node + 1, node + 2};  // Past the end, these are the end nodes
+    }
+    return {node + 1};
+}
+
+void DataflowAnalysis::solve() {
+    size_t size = program.size();
+    states.assign(size + 2, FlowState());
+    if (size == 0) {
+        return;
+    }
+    FlowState reset;
+    reset.reachable = true;
+    reset.reg = 0;
+    reset.selected = 0;
+    reset.memory[0] = reset.memory[1] = 0;
+
+    // The graph only loops through the end nodes, so one sweep in program
+    // order settles every state given what reached the end last time.
+    // States only ever become less known, so this stops after a few sweeps.
+    FlowState lastEnd;
+    FlowState lastEndSkip;
+    do {
+        sweeps++;
+        lastEnd = states[endNode()];
+        lastEndSkip = states[endSkipNode()];
+        states.assign(size + 2, FlowState());
+        flowInto(0, reset);
+        flowInto(0, wrapAround(lastEnd));
+        flowInto(successors(endSkipNode())[0], wrapAround(lastEndSkip));
+
+        for (size_t i = 0; i < size; ++i) {
+            if (!states[i].reachable) {
+                continue;
+            }
+            FlowState state = states[i];
+            int8_t& reg = state.reg;
+            int8_t value = operand(state);
+            switch (program[i]) {
+                case OP_NOT:
+                    reg = reg == UNKNOWN ? UNKNOWN : !reg;
+                    break;
+                case OP_SKZ: {
+                    // Each edge knows which way the SKIP flag was
+                    if (state.memory[0] != 1) {
+                        FlowState low = state;
+                        low.memory[0] = 0;
+                        flowInto(i + 1, low);
+                    }
+                    if (state.memory[0] != 0) {
+                        FlowState high = state;
+                        high.memory[0] = 1;
+                        flowInto(i + 2, high);
+                    }
+                    continue;
+                }
+                case OP_OR:
+                    reg = reg == 1 || value == 1 ? 1 : reg == 0 && value == 0 ? 0 : UNKNOWN;
+                    break;
+                case OP_LD:
+                    reg = value;
+                    break;
+                case OP_XOR:
+                    reg = reg == UNKNOWN || value == UNKNOWN ? UNKNOWN : reg ^ value;
+                    break;
+                case OP_OUT:
+                    if (state.selected == 0 || state.selected == 1) {
+                        state.memory[state.selected] = reg;
+                    } else if (state.selected == UNKNOWN) {
+                        // Either flag may have been written
+                        for (int8_t& flag : state.memory) {
+                            flag = flag == reg ? flag : UNKNOWN;
+                        }
+                    }
+                    break;
+                case OP_AND:
+                    reg = reg == 0 || value == 0 ? 0 : reg == 1 && value == 1 ? 1 : UNKNOWN;
+                    break;
+                default:
+                    state.selected = static_cast<int8_t>(program[i] - OP_DA1);
+                    break;
+            }
+            flowInto(i + 1, state);
+        }
+    } while (!(states[endNode()] == lastEnd && states[endSkipNode()] == lastEndSkip));
+}
+
+void DataflowAnalysis::flowInto(size_t node, const FlowState& state) {
+    states[node] = join(states[node], state);
+}
+
+DataflowAnalysis::FlowState DataflowAnalysis::wrapAround(const FlowState& state) const {
+    // The machine halts at the end of a pass with the HALT flag high
+    if (!state.reachable || state.memory[1] == 1) {
+        return FlowState();
+    }
+    FlowState next = state;
+    next.memory[1] = 0;
+    return next;
+}
+
+DataflowAnalysis::FlowState DataflowAnalysis::join(const FlowState& a, const FlowState& b) {
+    if (!a.reachable) {
+        return b;
+    }
+    if (!b.reachable) {
+        return a;
+    }
+    FlowState state = a;
+    state.reg = a.reg == b.reg ? a.reg : UNKNOWN;
+    state.selected = a.selected == b.selected ? a.selected : UNKNOWN;
+    for (int i = 0; i < 2; ++i) {
+        state.memory[i] = a.memory[i] == b.memory[i] ? a.memory[i] : UNKNOWN;
+    }
+    return state;
+}
+
+int8_t DataflowAnalysis::operand(const FlowState& state) {
+    // Only DA1 and DA2 read something the analysis follows
+    return state.selected == 0 || state.selected == 1 ? state.memory[state.selected] : UNKNOWN;
+}
+
+bool DataflowAnalysis::hasNoEffect(Opcode opcode, const FlowState& state) {
+    int8_t value = operand(state);
+    switch (opcode) {
+        case OP_OR:
+            return state.reg == 1 || value == 0;
+        case OP_LD:
+            return state.reg != UNKNOWN && value == state.reg;
+        case OP_XOR:
+            return value == 0;
+        case OP_OUT:
+            // Writing a flag the value it already holds
+            return state.reg != UNKNOWN && value == state.reg;
+        case OP_AND:
+            return state.reg == 0 || value == 1;
+        case OP_NOT:
+        case OP_SKZ:
+        case OP_NONE:
+            return false;
+        default:
+            return state.selected == opcode - OP_DA1;
+    }
+}
@@ -0,0 +1,65 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+#include "isa.h"
+
+// Control flow graph and known values of an expanded program. Each
+// instruction falls through to the next; SKZ also has an edge over the next
+// instruction, taken when the SKIP flag (DA1's memory) is high. The end of
+// the program is a node of its own: it halts when the HALT flag (DA2's
+// memory) is high and otherwise wraps around to the start, or to the second
+// instruction when the last one was an SKZ that skips.
+//
+// Over that graph a forward analysis finds, before every instruction, the
+// register, the selected line and both flags wherever every path agrees on
+// them. Runs start from the emulator's reset state: register and flags low
+// and DA1 selected. Inputs and tapes are never assumed.
+class DataflowAnalysis {
+public:
+    static const int8_t UNKNOWN = -1;
+
+    // Machine state before an instruction; each value is 0, 1 (a line for
+    // selected) or UNKNOWN when paths disagree
+    struct FlowState {
+        bool reachable = false;
+        int8_t reg = UNKNOWN;
+        int8_t selected = UNKNOWN;
+        int8_t memory[2] = {UNKNOWN, UNKNOWN};  // SKIP and HALT flags
+
+        bool operator==(const FlowState& other) const {
+            return reachable == other.reachable && reg == other.reg && selected == other.selected &&
+                   memory[0] == other.memory[0] && memory[1] == other.memory[1];
+        }
+    };
+
+    explicit DataflowAnalysis(const std::vector<Opcode>& program);
+
+    // Nodes are instruction indices, then END for the end of a pass and
+    // END_SKIP for the end of a pass whose first instruction will be skipped
+    size_t endNode() const { return program.size(); }
+    size_t endSkipNode() const { return program.size() + 1; }
+    // Nodes an instruction or end node can go to next, with or without a skip
+    std::vector<size_t> successors(size_t node) const;
+
+    const FlowState& before(size_t node) const { return states[node]; }
+    bool reachable(size_t node) const { return states[node].reachable; }
+    // Sweeps over the program until the states at the end stopped changing
+    int getSweeps() const { return sweeps; }
+
+    // True if an instruction other than SKZ leaves everything as it was when
+    // run in this state
+    static bool hasNoEffect(Opcode opcode, const FlowState& state);
+
+private:
+    const std::vector<Opcode>& program;
+    std::vector<FlowState> states;  // Indexed by node
+    int sweeps = 0;
+
+    void solve();
+    void flowInto(size_t node, const FlowState& state);
+    FlowState wrapAround(const FlowState& state) const;
+    static FlowState join(const FlowState& a, const FlowState& b);
+    static int8_t operand(const FlowState& state);
+};
@@ -0,0 +1,120 @@
+#include "diagnostics.h"
+#include <sstream>
+#include <utility>
+
+const size_t DiagnosticSink::FLUSH_THRESHOLD;
+
+DiagnosticSink::DiagnosticSink(std::ostream* errors, std::ostream* notes)
+    : errorStream(errors), noteStream(notes) {
+}
+
+DiagnosticSink::~DiagnosticSink() {
+    flush();
+}
+
+void DiagnosticSink::report(Diagnostic diagnostic) {
+    counts[diagnostic.severity]++;
+    if (!wants(diagnostic.severity)) {
+        return;
+    }
+    diagnostics.push_back(std::move(diagnostic));
+    if (diagnostics.size() >= FLUSH_THRESHOLD && (errorStream || noteStream)) {
+        flush();
+    }
+}
+
+void DiagnosticSink::report(Severity severity, const std::string& message, const SourceLocation& location) {
+    if (!wants(severity)) {
+        counts[severity]++;
+        return;
+    }
+    Diagnostic diagnostic;
+    diagnostic.severity = severity;
+    diagnostic.message = message;
+    diagnostic.location = location;
+    report(std::move(diagnostic));
+}
+
+void DiagnosticSink::append(DiagnosticSink& other) {
+    for (int severity = 0; severity < SEVERITY_COUNT; ++severity) {
+        counts[severity] += other.counts[severity];
+        other.counts[severity] = 0;
+    }
+    for (Diagnostic& diagnostic : other.diagnostics) {
+        if (wants(diagnostic.severity)) {
+            diagnostics.push_back(std::move(diagnostic));
+        }
+    }
+    other.diagnostics.clear();
+}
+
+void DiagnosticSink::flush() {
+    if (!errorStream && !noteStream) {
+        return;
+    }
+    // Formatted into one buffer per stream, written with a single call each
+    std::string errorText;
+    std::string noteText;
+    for (const Diagnostic& diagnostic : diagnostics) {
+        if (diagnostic.severity >= SEVERITY_WARNING) {
+            errorText += format(diagnostic);
+        } else {
+            noteText += format(diagnostic);
+        }
+    }
+    diagnostics.clear();
+    if (errorStream && !errorText.empty()) {
+        errorStream->write(errorText.data(), static_cast<std::streamsize>(errorText.size()));
+        errorStream->flush();
+    }
+    if (noteStream && !noteText.empty()) {
+        noteStream->write(noteText.data(), static_cast<std::streamsize>(noteText.size()));
+        noteStream->flush();
+    }
+}
+
+const char* DiagnosticSink::severityName(Severity severity) {
+    switch (severity) {
+        case SEVERITY_TRACE: return "trace";
+        case SEVERITY_NOTE: return "note";
+        case SEVERITY_WARNING: return "warning";
+        default: return "error";
+    }
+}
+
+namespace {
+
+void formatLocation(std::ostringstream& out, const SourceLocation& location) {
+    if (!location.file.empty()) {
+        out << location.file << ":";
+    }
+    if (location.line > 0) {
+        out << location.line << ":" << location.column << ":";
+    }
+    if (!location.file.empty() || location.line > 0) {
+        out << " ";
+    }
+}
+
+}  // namespace
+
+std::string DiagnosticSink::format(const Diagnostic& diagnostic) {
+    std::ostringstream out;
+    if (diagnostic.severity < SEVERITY_WARNING) {
+        // Progress and tracing read as plain text
+        out << diagnostic.message << '\n';
+        return out.str();
+    }
+    formatLocation(out, diagnostic.location);
+    out << severityName(diagnostic.severity) << ": " << diagnostic.message << '\n';
+    for (size_t i = 0; i < diagnostic.backtrace.size(); ++i) {
+        const ExpansionSite& site = diagnostic.backtrace[i];
+        if (diagnostic.omittedSites > 0 && i + 1 == diagnostic.backtrace.size()) {
+            out << "  ... " << diagnostic.omittedSites << " more invocations\n";
+        }
+        out << "  ";
+        formatLocation(out, site.location);
+        out << "in expansion of macro " << site.macro << '\n';
+    }
+    return out.str();
+}
@@ -0,0 +1,78 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <iostream>
+#include <string>
+#include <vector>
+
+// How serious a diagnostic is; a sink keeps nothing below its threshold
+enum Severity : uint8_t {
+    SEVERITY_TRACE,    // Every expanded line, for debugging macros
+    SEVERITY_NOTE,     // Progress of the assembler's passes
+    SEVERITY_WARNING,
+    SEVERITY_ERROR,
+    SEVERITY_COUNT
+};
+
+struct SourceLocation {
+    std::string file;
+    int line = 0;    // 0 when the diagnostic is not about a source line
+    int column = 0;
+};
+
+// One macro invocation a diagnostic happened inside, and where it was invoked
+struct ExpansionSite {
+    std::string macro;
+    SourceLocation location;
+};
+
+struct Diagnostic {
+    Severity severity = SEVERITY_ERROR;
+    std::string message;
+    SourceLocation location;
+    std::vector<ExpansionSite> backtrace;  // Innermost invocation first
+    size_t omittedSites = 0;               // Left out before the outermost site
+};
+
+// Collects diagnostics in memory and writes them out in one go on flush(),
+// so hot paths never touch an unbuffered stream. Errors and warnings go to
+// the error stream as "file:line:column: error: message", notes and traces
+// to the note stream as plain text. A sink without streams only buffers,
+// for merging into another with append().
+class DiagnosticSink {
+public:
+    explicit DiagnosticSink(std::ostream* errors = &std::cerr, std::ostream* notes = &std::cout);
+    ~DiagnosticSink();
+    DiagnosticSink(const DiagnosticSink&) = delete;
+    DiagnosticSink& operator=(const DiagnosticSink&) = delete;
+
+    void setThreshold(Severity severity) { threshold = severity; }
+    Severity getThreshold() const { return threshold; }
+    // Callers check this before building a message nobody will see
+    bool wants(Severity severity) const { return severity >= threshold; }
+
+    void report(Diagnostic diagnostic);
+    void report(Severity severity, const std::string& message, const SourceLocation& location = SourceLocation());
+    // Takes over another sink's pending diagnostics and counts, in order
+    void append(DiagnosticSink& other);
+    void flush();
+
+    // Counted whether or not the threshold kept them
+    size_t count(Severity severity) const { return counts[severity]; }
+    size_t errorCount() const { return counts[SEVERITY_ERROR]; }
+    const std::vector<Diagnostic>& pending() const { return diagnostics; }
+
+    static const char* severityName(Severity severity);
+    static std::string format(const Diagnostic& diagnostic);
+
+private:
+    // Buffered diagnostics are written out once this many are waiting
+    static const size_t FLUSH_THRESHOLD = 4096;
+
+    std::ostream* errorStream;
+    std::ostream* noteStream;
+    Severity threshold = SEVERITY_WARNING;
+    std::vector<Diagnostic> diagnostics;
+    size_t counts[SEVERITY_COUNT] = {};
+};
@@ -0,0 +1,355 @@
+#include "emitter.h"
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include "gzip.h"
+#include "nbt.h"
+
+const size_t ProgramEmitter::BUFFER_BYTES;
+const size_t ProgramEmitter::SLOTS_PER_SHULKER;
+const size_t PackedProgram::HEADER_BYTES;
+const uint8_t PackedProgram::VERSION;
+const uint8_t PackedProgram::MAX_SLOTS_PER_SHULKER;
+const int32_t StructureEmitter::DATA_VERSION;
+const size_t StructureEmitter::SHULKERS_PER_CHEST;
+
+std::unique_ptr<ProgramEmitter> ProgramEmitter::create(OutputFormat format, std::ostream& out) {
+    switch (format) {
+        case FORMAT_COMMANDS:
+            return std::unique_ptr<ProgramEmitter>(new CommandEmitter(out));
+        case FORMAT_PACKED:
+            return std::unique_ptr<ProgramEmitter>(new PackedEmitter(out));
+        case FORMAT_STRUCTURE:
+        case FORMAT_LITEMATIC:
+            return std::unique_ptr<ProgramEmitter>(new StructureEmitter(out, format == FORMAT_LITEMATIC));
+        default:
+            return std::unique_ptr<ProgramEmitter>(new NumericEmitter(out));
+    }
+}
+
+void ProgramEmitter::writeBuffer() {
+    out.write(buffer.data(), static_cast<std::streamsize>(buffer.size()));
+    buffer.clear();
+}
+
+bool ProgramEmitter::finish() {
+    writeBuffer();
+    out.flush();
+    return static_cast<bool>(out);
+}
+
+void NumericEmitter::emit(Opcode opcode) {
+    buffer += isa::discName(opcode);
+    buffer += '\n';
+    writeIfFull();
+}
+
+void CommandEmitter::emit(Opcode opcode) {
+    if (shulker.size() == SLOTS_PER_SHULKER) {
+        multipleShulkers = true;
+        writeShulker();
+    }
+    shulker.push_back(opcode);
+}
+
+bool CommandEmitter::finish() {
+    if (!shulker.empty()) {
+        writeShulker();
+    }
+    return ProgramEmitter::finish();
+}
+
+void CommandEmitter::writeShulker() {
+    std::string shulkerName = "Program";
+    if (multipleShulkers) {
+        shulkerName += "_Part_" + std::to_string(shulkerIndex + 1);
+    }
+
+    buffer += "/give @p shulker_box{display:{Name:'{\"text\":\"";
+    buffer += shulkerName;
+    buffer += "\"}'},BlockEntityTag:{Items:[";
+    for (size_t i = 0; i < shulker.size(); ++i) {
+        if (i > 0) buffer += ',';
+        buffer += "{Slot:";
+        buffer += std::to_string(i);
+        buffer += "b,id:\"minecraft:music_disc_";
+        buffer += isa::discName(shulker[i]);
+        buffer += "\",Count:1b}";
+    }
+    buffer += "]}}\n";
+
+    shulker.clear();
+    shulkerIndex++;
+    writeIfFull();
+}
+
+namespace {
+
+void putLittleEndian(std::string& out, uint64_t value, int bytes) {
+    for (int i = 0; i < bytes; ++i) {
+        out += static_cast<char>((value >> (8 * i)) & 0xFF);
+    }
+}
+
+uint64_t getLittleEndian(const unsigned char* in, int bytes) {
+    uint64_t value = 0;
+    for (int i = 0; i < bytes; ++i) {
+        value |= static_cast<uint64_t>(in[i]) << (8 * i);
+    }
+    return value;
+}
+
+}  // namespace
+
+void PackedProgram::writeHeader(std::string& out, uint64_t instructions, uint8_t slotsPerShulker) {
+    out += "MCPK";
+    out += static_cast<char>(VERSION);
+    out += static_cast<char>(slotsPerShulker);
+    putLittleEndian(out, 0, 2);
+    putLittleEndian(out, instructions, 8);
+    putLittleEndian(out, (instructions + slotsPerShulker - 1) / slotsPerShulker, 8);
+}
+
+bool PackedProgram::read(std::istream& in, std::vector<Opcode>& program) {
+    unsigned char header[HEADER_BYTES];
+    if (!in.read(reinterpret_cast<char*>(header), HEADER_BYTES) || std::memcmp(header, "MCPK", 4) != 0) {
+        std::cerr << "Error: Not a packed program image" << std::endl;
+        return false;
+    }
+    if (header[4] != VERSION) {
+        std::cerr << "Error: Unsupported packed program version " << static_cast<int>(header[4]) << std::endl;
+        return false;
+    }
+    uint64_t count = getLittleEndian(header + 8, 8);
+    uint8_t slots = header[5];
+    if (slots == 0 || slots > MAX_SLOTS_PER_SHULKER) {
+        std::cerr << "Error: Invalid slots per shulker box in packed program image: " << static_cast<int>(slots)
+                  << std::endl;
+        return false;
+    }
+    if (getLittleEndian(header + 16, 8) != count / slots + (count % slots != 0)) {
+        std::cerr << "Error: Packed program image header is inconsistent" << std::endl;
+        return false;
+    }
+
+    // Read in bounded pieces, so the buffer only grows as far as the data does
+    const size_t READ_BYTES = 1 << 20;
+    uint64_t bytes = count / 2 + count % 2;
+    std::string packed;
+    while (packed.size() < bytes) {
+        size_t start = packed.size();
+        size_t size = static_cast<size_t>(std::min<uint64_t>(READ_BYTES, bytes - start));
+        packed.resize(start + size);
+        if (!in.read(&packed[start], static_cast<std::streamsize>(size))) {
+            std::cerr << "Error: Packed program image is truncated" << std::endl;
+            return false;
+        }
+    }
+
+    program.clear();
+    program.reserve(count);
+    for (uint64_t i = 0; i < count; ++i) {
+        uint8_t nibble = static_cast<uint8_t>(packed[i / 2]) >> (i % 2 * 4) & 0xF;
+        if (nibble == OP_NONE) {
+            std::cerr << "Error: Invalid opcode in packed program image at " << i << std::endl;
+            return false;
+        }
+        program.push_back(static_cast<Opcode>(nibble));
+    }
+    return true;
+}
+
+void PackedEmitter::emit(Opcode opcode) {
+    // Opcodes 1-15 fit a nibble; zero is never a valid instruction
+    if (count % 2 == 0) {
+        packed += static_cast<char>(opcode);
+    } else {
+        packed.back() = static_cast<char>(packed.back() | opcode << 4);
+    }
+    count++;
+}
+
+bool PackedEmitter::finish() {
+    PackedProgram::writeHeader(buffer, count, SLOTS_PER_SHULKER);
+    writeBuffer();
+    buffer.swap(packed);
+    return ProgramEmitter::finish();
+}
+
+namespace {
+
+// A chest pair is two blocks: the left half west of the right one
+void writeChestState(NbtWriter& nbt, const char* type) {
+    nbt.beginCompound();
+    nbt.writeString("Name", "minecraft:chest");
+    nbt.beginCompound("Properties");
+    nbt.writeString("waterlogged", "false");
+    nbt.writeString("facing", "north");
+    nbt.writeString("type", type);
+    nbt.endCompound();
+    nbt.endCompound();
+}
+
+void writeVector(NbtWriter& nbt, const std::string& name, int32_t x, int32_t y, int32_t z) {
+    nbt.beginCompound(name);
+    nbt.writeInt("x", x);
+    nbt.writeInt("y", y);
+    nbt.writeInt("z", z);
+    nbt.endCompound();
+}
+
+}  // namespace
+
+size_t StructureEmitter::chestCount() const {
+    size_t shulkers = (program.size() + SLOTS_PER_SHULKER - 1) / SLOTS_PER_SHULKER;
+    return std::max<size_t>(1, (shulkers + SHULKERS_PER_CHEST - 1) / SHULKERS_PER_CHEST);
+}
+
+void StructureEmitter::writeChestItems(NbtWriter& nbt, size_t chest, bool rightHalf) const {
+    // The right half is the top of the double chest's inventory, so it
+    // holds the first 27 boxes
+    size_t firstShulker = chest * SHULKERS_PER_CHEST + (rightHalf ? 0 : SLOTS_PER_SHULKER);
+    size_t shulkers = (program.size() + SLOTS_PER_SHULKER - 1) / SLOTS_PER_SHULKER;
+    size_t count = std::min(SLOTS_PER_SHULKER, shulkers > firstShulker ? shulkers - firstShulker : 0);
+
+    nbt.beginList("Items", TAG_COMPOUND, static_cast<int32_t>(count));
+    for (size_t slot = 0; slot < count; ++slot) {
+        size_t first = (firstShulker + slot) * SLOTS_PER_SHULKER;
+        size_t discs = std::min(SLOTS_PER_SHULKER, program.size() - first);
+        nbt.beginCompound();
+        nbt.writeByte("Slot", static_cast<int8_t>(slot));
+        nbt.writeInt("count", 1);
+        nbt.writeString("id", "minecraft:purple_shulker_box");
+        nbt.beginCompound("components");
+        nbt.beginList("minecraft:container", TAG_COMPOUND, static_cast<int32_t>(discs));
+        for (size_t i = 0; i < discs; ++i) {
+            nbt.beginCompound();
+            nbt.beginCompound("item");
+            nbt.writeInt("count", 1);
+            nbt.writeString("id", std::string("minecraft:music_disc_") + isa::discName(program[first + i]));
+            nbt.endCompound();
+            nbt.writeInt("slot", static_cast<int32_t>(i));
+            nbt.endCompound();
+        }
+        nbt.endList();
+        nbt.endCompound();
+        nbt.endCompound();
+    }
+    nbt.endList();
+}
+
+void StructureEmitter::writeStructure(NbtWriter& nbt) const {
+    int32_t width = static_cast<int32_t>(2 * chestCount());
+    nbt.beginRoot();
+    nbt.writeInt("DataVersion", DATA_VERSION);
+    nbt.beginList("size", TAG_INT, 3);
+    nbt.writeInt("", width);
+    nbt.writeInt("", 1);
+    nbt.writeInt("", 1);
+    nbt.endList();
+    nbt.beginList("entities", TAG_COMPOUND, 0);
+    nbt.endList();
+    nbt.beginList("blocks", TAG_COMPOUND, width);
+    for (int32_t x = 0; x < width; ++x) {
+        bool rightHalf = x % 2 == 1;
+        nbt.beginCompound();
+        nbt.beginList("pos", TAG_INT, 3);
+        nbt.writeInt("", x);
+        nbt.writeInt("", 0);
+        nbt.writeInt("", 0);
+        nbt.endList();
+        nbt.writeInt("state", rightHalf ? 1 : 0);  // Palette index
+        nbt.beginCompound("nbt");
+        writeChestItems(nbt, static_cast<size_t>(x / 2), rightHalf);
+        nbt.writeString("id", "minecraft:chest");
+        nbt.endCompound();
+        nbt.endCompound();
+    }
+    nbt.endList();
+    nbt.beginList("palette", TAG_COMPOUND, 2);
+    writeChestState(nbt, "left");
+    writeChestState(nbt, "right");
+    nbt.endList();
+    nbt.endRoot();
+}
+
+void StructureEmitter::writeLitematic(NbtWriter& nbt) const {
+    int32_t width = static_cast<int32_t>(2 * chestCount());
+    int64_t now = std::chrono::duration_cast<std::chrono::milliseconds>(
+        std::chrono::system_clock::now().time_since_epoch()).count();
+    nbt.beginRoot();
+    nbt.writeInt("MinecraftDataVersion", DATA_VERSION);
+    nbt.writeInt("Version", 7);
+    nbt.writeInt("SubVersion", 1);
+    nbt.beginCompound("Metadata");
+    nbt.writeString("Name", "Program");
+    nbt.writeString("Author", "");
+    nbt.writeString("Description", std::to_string(program.size()) + " instructions");
+    nbt.writeInt("RegionCount", 1);
+    nbt.writeInt("TotalVolume", width);
+    nbt.writeInt("TotalBlocks", width);
+    nbt.writeLong("TimeCreated", now);
+    nbt.writeLong("TimeModified", now);
+    writeVector(nbt, "EnclosingSize", width, 1, 1);
+    nbt.endCompound();
+
+    nbt.beginCompound("Regions");
+    nbt.beginCompound("Program");
+    writeVector(nbt, "Position", 0, 0, 0);
+    writeVector(nbt, "Size", width, 1, 1);
+    nbt.beginList("BlockStatePalette", TAG_COMPOUND, 3);
+    nbt.beginCompound();
+    nbt.writeString("Name", "minecraft:air");
+    nbt.endCompound();
+    writeChestState(nbt, "left");
+    writeChestState(nbt, "right");
+    nbt.endList();
+
+    // Palette indices packed 2 bits each into longs, entries allowed to
+    // straddle two longs; with y = z = 0 the block index is just x
+    const int BITS = 2;
+    std::vector<int64_t> states((static_cast<size_t>(width) * BITS + 63) / 64, 0);
+    for (int32_t x = 0; x < width; ++x) {
+        uint64_t state = x % 2 == 1 ? 2 : 1;
+        size_t bit = static_cast<size_t>(x) * BITS;
+        states[bit / 64] |= static_cast<int64_t>(state << (bit % 64));
+        if (bit % 64 + BITS > 64) {
+            states[bit / 64 + 1] |= static_cast<int64_t>(state >> (64 - bit % 64));
+        }
+    }
+    nbt.writeLongArray("BlockStates", states);
+
+    nbt.beginList("TileEntities", TAG_COMPOUND, width);
+    for (int32_t x = 0; x < width; ++x) {
+        nbt.beginCompound();
+        nbt.beginCompound("components");
+        nbt.endCompound();
+        nbt.writeInt("x", x);
+        nbt.writeInt("y", 0);
+        nbt.writeInt("z", 0);
+        writeChestItems(nbt, static_cast<size_t>(x / 2), x % 2 == 1);
+        nbt.writeString("id", "minecraft:chest");
+        nbt.endCompound();
+    }
+    nbt.endList();
+    nbt.beginList("Entities", TAG_COMPOUND, 0);
+    nbt.endList();
+    nbt.beginList("PendingBlockTicks", TAG_COMPOUND, 0);
+    nbt.endList();
+    nbt.beginList("PendingFluidTicks", TAG_COMPOUND, 0);
+    nbt.endList();
+    nbt.endCompound();
+    nbt.endCompound();
+    nbt.endRoot();
+}
+
+bool StructureEmitter::finish() {
+    NbtWriter nbt;
+    if (litematic) {
+        writeLitematic(nbt);
+    } else {
+        writeStructure(nbt);
+    }
+    buffer += gzip::compress(nbt.data());
+    return ProgramEmitter::finish();
+}
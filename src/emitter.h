@@ -0,0 +1,132 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <iostream>
+#include <memory>
+#include <string>
+#include <vector>
+#include "isa.h"
+
+class NbtWriter;
+
+// Output formats the assembler can write a program in
+enum OutputFormat {
+    FORMAT_NUMERIC,   // One disc name per line
+    FORMAT_COMMANDS,  // Minecraft /give commands, one shulker box each
+    FORMAT_PACKED,    // Binary program image, see PackedProgram
+    FORMAT_STRUCTURE, // Gzipped NBT structure of chests of shulker boxes
+    FORMAT_LITEMATIC  // The same chests as a Litematica schematic
+};
+
+// Renders a program one opcode at a time. Output is built up in a large
+// buffer and written out a block at a time, never per instruction.
+class ProgramEmitter {
+public:
+    explicit ProgramEmitter(std::ostream& out) : out(out) {}
+    virtual ~ProgramEmitter() = default;
+
+    // Called once per instruction, in program order
+    virtual void emit(Opcode opcode) = 0;
+    // Called after the last instruction; false if the stream failed
+    virtual bool finish();
+
+    static std::unique_ptr<ProgramEmitter> create(OutputFormat format, std::ostream& out);
+
+protected:
+    static const size_t BUFFER_BYTES = 1 << 20;
+    static const size_t SLOTS_PER_SHULKER = 27;
+
+    // Emitters append here and call writeIfFull() between instructions
+    std::string buffer;
+    void writeIfFull() {
+        if (buffer.size() >= BUFFER_BYTES) {
+            writeBuffer();
+        }
+    }
+    void writeBuffer();
+
+private:
+    std::ostream& out;
+};
+
+class NumericEmitter : public ProgramEmitter {
+public:
+    using ProgramEmitter::ProgramEmitter;
+    void emit(Opcode opcode) override;
+};
+
+// Each shulker is written once the next one starts, so the first knows
+// whether it is one of several parts
+class CommandEmitter : public ProgramEmitter {
+public:
+    using ProgramEmitter::ProgramEmitter;
+    void emit(Opcode opcode) override;
+    bool finish() override;
+
+private:
+    std::vector<Opcode> shulker;
+    int shulkerIndex = 0;
+    bool multipleShulkers = false;
+
+    void writeShulker();
+};
+
+// Packed program image: a 24-byte little-endian header followed by the
+// opcodes, two per byte, low nibble first.
+//
+//   offset  size  field
+//        0     4  magic "MCPK"
+//        4     1  format version (1)
+//        5     1  slots per shulker box (27)
+//        6     2  reserved, zero
+//        8     8  instruction count
+//       16     8  shulker box count
+struct PackedProgram {
+    static const size_t HEADER_BYTES = 24;
+    static const uint8_t VERSION = 1;
+    static const uint8_t MAX_SLOTS_PER_SHULKER = 27;
+
+    static void writeHeader(std::string& out, uint64_t instructions, uint8_t slotsPerShulker);
+    // False, with a message on std::cerr, if the image is malformed. The
+    // header's counts are checked against each other and against what the
+    // stream actually holds, so a corrupt image cannot force a huge allocation.
+    static bool read(std::istream& in, std::vector<Opcode>& program);
+};
+
+// Nibbles are kept in memory until the end, since the header leads with
+// the length; at half a byte per instruction that stays small
+class PackedEmitter : public ProgramEmitter {
+public:
+    using ProgramEmitter::ProgramEmitter;
+    void emit(Opcode opcode) override;
+    bool finish() override;
+
+private:
+    std::string packed;
+    uint64_t count = 0;
+};
+
+// Double chests of shulker boxes of discs, laid out as scripts/generate_nbt.py
+// does: 27 discs per purple shulker box and 54 boxes per north-facing double
+// chest, with each further double chest placed east of the last. Written as
+// a gzipped vanilla structure file or as a Litematica schematic.
+class StructureEmitter : public ProgramEmitter {
+public:
+    StructureEmitter(std::ostream& out, bool litematic) : ProgramEmitter(out), litematic(litematic) {}
+    void emit(Opcode opcode) override { program.push_back(opcode); }
+    bool finish() override;
+
+    // The game version generate_nbt.py's structures were checked against
+    static const int32_t DATA_VERSION = 4325;
+    static const size_t SHULKERS_PER_CHEST = 2 * SLOTS_PER_SHULKER;
+
+private:
+    std::vector<Opcode> program;
+    bool litematic;
+
+    size_t chestCount() const;
+    void writeChestItems(NbtWriter& nbt, size_t chest, bool rightHalf) const;
+    void writeStructure(NbtWriter& nbt) const;
+    void writeLitematic(NbtWriter& nbt) const;
+};
@@ -1,44 +1,332 @@
 #include "emulator.h"
+#include "bit_utils.h"
 #include <iostream>
 #include <fstream>
+#include <chrono>
 #include <iomanip>
 #include <limits>
 #include <sstream>
 
+const uint64_t Emulator::UNLIMITED;
+const size_t Emulator::WINDOW_MEMO_LIMIT;
+const int Emulator::TapeMemory::PAGE_SHIFT;
+const int Emulator::TapeMemory::PAGE_CELLS;
+const int Emulator::TapeMemory::PAGE_WORDS;
+
 Emulator::Emulator() {
-    initializeOpcodeMap();
     reset();
 }
 
-void Emulator::initializeOpcodeMap() {
-    opcodeToNumber = {
-        {"NOT", 1}, {"SKZ", 2}, {"OR", 3}, {"LD", 4},
-        {"XOR", 5}, {"OUT", 6}, {"AND", 7}, {"DA1", 8},
-        {"DA2", 9}, {"DA3", 10}, {"DA4", 11}, {"DA5", 12},
-        {"DA6", 13}, {"DA7", 14}, {"DA8", 15}
-    };
-}
-
-bool Emulator::loadProgram(const std::string& assemblyFile) {
+bool Emulator::loadProgram(const std::string& assemblyFile, bool optimize, const RewriteTable* rewrites) {
     Assembler assembler;
     if (!assembler.readAssemblyFile(assemblyFile)) {
         std::cerr << "Failed to read assembly file: " << assemblyFile << std::endl;
         return false;
     }
     
-    assembler.assemble();
-    instructions = assembler.getInstructions();
+    // Diagnostics are already flushed; a program with errors is not run
+    if (!assembler.assemble() || assembler.getErrorCount() > 0) {
+        std::cerr << assembler.getErrorCount() << " error(s) while assembling " << assemblyFile << std::endl;
+        return false;
+    }
+    if (optimize) {
+        assembler.setRewriteTable(rewrites);
+        assembler.optimize();
+        assembler.printOptimizationStats();
+    }
+    if (!loadInstructions(assembler.getInstructions())) {
+        return false;
+    }
+    
+    std::cout << "Loaded program with " << instructions.size() << " instructions." << std::endl;
+    return true;
+}
+
+bool Emulator::loadInstructions(const std::vector<std::string>& assembled) {
+    instructions = assembled;
     
     if (instructions.empty()) {
         std::cerr << "No instructions found in assembly file." << std::endl;
         return false;
     }
     
+    decodeProgram();
     reset();
-    std::cout << "Loaded program with " << instructions.size() << " instructions." << std::endl;
     return true;
 }
 
+void Emulator::decodeProgram() {
+    // Decode mnemonics once so the interpreter never hashes or copies strings
+    program.clear();
+    program.reserve(instructions.size());
+    for (const auto& instruction : instructions) {
+        program.push_back(isa::findOpcode(instruction));
+    }
+    buildBlocks();
+    computeWindowReach();
+    breakpoints.assign(program.size(), 0);
+    breakpointCount = 0;
+}
+
+void Emulator::buildBlocks() {
+    blockAt.assign(program.size(), -1);
+    blockStart.clear();
+    blockEnd.clear();
+    variants.clear();
+    microOps.clear();
+    
+    // A block starts at PC 0 and after every SKZ
+    for (size_t pc = 0; pc < program.size(); ++pc) {
+        if (pc == 0 || program[pc - 1] == OP_SKZ) {
+            if (!blockEnd.empty()) {
+                blockEnd.back() = static_cast<uint32_t>(pc);
+            }
+            blockAt[pc] = static_cast<int>(blockEnd.size());
+            blockStart.push_back(static_cast<uint32_t>(pc));
+            blockEnd.push_back(static_cast<uint32_t>(program.size()));
+        }
+    }
+    variantIndex.assign(blockEnd.size() * 32, -1);
+}
+
+void Emulator::computeWindowReach() {
+    // Track which data lines may be selected at each OUT; the entry line is
+    // unknown and an instruction after SKZ may not run at all
+    const int MAX_REACH = 31;  // Window of 2 * reach + 1 cells in one word
+    int moveLines[2] = {0, 0};  // DA3/DA5, DA6/DA8
+    for (int op = OP_DA1; op <= OP_DA8; ++op) {
+        const isa::InstructionInfo& info = isa::INSTRUCTIONS[op];
+        if (info.role == isa::ROLE_TAPE_LEFT || info.role == isa::ROLE_TAPE_RIGHT) {
+            moveLines[info.tape] |= 1 << info.dataLine;
+        }
+    }
+    int reach[2] = {0, 0};
+    int possibleLines = 0xff;
+    for (size_t pc = 0; pc < program.size(); ++pc) {
+        size_t previous = pc == 0 ? program.size() - 1 : pc - 1;
+        bool mayBeSkipped = program[previous] == OP_SKZ;
+        uint8_t opcode = program[pc];
+        if (isa::isDataLine(static_cast<Opcode>(opcode))) {
+            possibleLines = (1 << (opcode - OP_DA1)) | (mayBeSkipped ? possibleLines : 0);
+        } else if (opcode == OP_OUT) {
+            for (int tape = 0; tape < 2; ++tape) {
+                if (possibleLines & moveLines[tape]) {
+                    reach[tape]++;
+                }
+            }
+        }
+    }
+    for (int tape = 0; tape < 2; ++tape) {
+        windowReach[tape] = reach[tape] <= MAX_REACH ? reach[tape] : -1;
+    }
+}
+
+const Emulator::CompiledBlock& Emulator::blockVariant(int block, bool skipFirst) {
+    int key = block * 32 + (tapeMode ? 16 : 0) + (skipFirst ? 8 : 0) + selectedDataLine;
+    if (variantIndex[key] < 0) {
+        variantIndex[key] = static_cast<int>(variants.size());
+        variants.push_back(compileBlock(block, skipFirst, selectedDataLine));
+    }
+    return variants[variantIndex[key]];
+}
+
+Emulator::CompiledBlock Emulator::compileBlock(int block, bool skipFirst, int entryLine) {
+    uint32_t begin = blockStart[block];
+    uint32_t end = blockEnd[block];
+    
+    CompiledBlock compiled;
+    compiled.firstOp = static_cast<uint32_t>(microOps.size());
+    compiled.cycles = end - begin;
+    
+    int line = entryLine;
+    int knownRegister = -1;  // -1 unknown, otherwise the register value
+    size_t blockFirstOp = microOps.size();
+    
+    // Adds one instruction to the previous micro-op when it has no effect
+    auto absorb = [&](uint32_t pc) {
+        if (microOps.size() > blockFirstOp) {
+            microOps.back().count++;
+        } else {
+            MicroOp nop = {UOP_NOP, 0, 0, pc, 1};
+            microOps.push_back(nop);
+        }
+    };
+    auto emit = [&](MicroOpKind kind, int arg, int delta, uint32_t pc) {
+        MicroOp op = {kind, static_cast<uint8_t>(arg), delta, pc, 1};
+        microOps.push_back(op);
+    };
+    auto lastIs = [&](MicroOpKind kind) {
+        return microOps.size() > blockFirstOp && microOps.back().kind == kind;
+    };
+    // Operand source for LD/XOR/AND/OR on the selected line: 0 mem, 1 input, 2 tape, -1 none
+    auto source = [&](bool forLoad, int& arg) {
+        if (line < 2) {
+            arg = line;
+            return 0;
+        }
+        if (tapeMode) {
+            const isa::InstructionInfo& info = isa::INSTRUCTIONS[OP_DA1 + line];
+            if (info.role == isa::ROLE_TAPE_HEAD) {
+                arg = info.tape;
+                return 2;
+            }
+            if (forLoad) {
+                return -1;  // LD from a tape shift line leaves the register alone
+            }
+        }
+        arg = line;
+        return 1;
+    };
+    
+    for (uint32_t pc = begin + (skipFirst ? 1 : 0); pc < end; ++pc) {
+        uint8_t opcode = program[pc];
+        int arg = 0;
+        switch (opcode) {
+            case OP_NOT:
+                if (lastIs(UOP_SET_REG)) {
+                    microOps.back().arg ^= 1;
+                    microOps.back().count++;
+                } else if (lastIs(UOP_NOT)) {
+                    microOps.back().kind = UOP_NOP;
+                    microOps.back().count++;
+                } else {
+                    emit(UOP_NOT, 0, 0, pc);
+                }
+                knownRegister = knownRegister < 0 ? -1 : !knownRegister;
+                break;
+            case OP_SKZ:
+                emit(UOP_SKZ, 0, 0, pc);
+                break;
+            case OP_OR: {
+                if (knownRegister == 1) {
+                    absorb(pc);
+                    break;
+                }
+                int kind = source(false, arg);
+                emit(static_cast<MicroOpKind>(UOP_OR_MEM + kind), arg, 0, pc);
+                knownRegister = -1;
+                break;
+            }
+            case OP_LD: {
+                int kind = source(true, arg);
+                if (kind < 0) {
+                    absorb(pc);
+                    break;
+                }
+                emit(static_cast<MicroOpKind>(UOP_LD_MEM + kind), arg, 0, pc);
+                knownRegister = -1;
+                break;
+            }
+            case OP_XOR: {
+                int kind = source(false, arg);
+                MicroOpKind loadKind = static_cast<MicroOpKind>(UOP_LD_MEM + kind);
+                if (lastIs(loadKind) && microOps.back().arg == arg && microOps.back().count == 1) {
+                    // LD x; XOR x always leaves the register low
+                    microOps.back().kind = UOP_SET_REG;
+                    microOps.back().arg = 0;
+                    microOps.back().count++;
+                    knownRegister = 0;
+                    break;
+                }
+                emit(static_cast<MicroOpKind>(UOP_XOR_MEM + kind), arg, 0, pc);
+                knownRegister = -1;
+                break;
+            }
+            case OP_OUT:
+                if (line < 2) {
+                    emit(UOP_OUT_MEM, line, 0, pc);
+                } else if (!tapeMode) {
+                    emit(UOP_OUT_OUTPUT, line, 0, pc);
+                } else {
+                    const isa::InstructionInfo& info = isa::INSTRUCTIONS[OP_DA1 + line];
+                    int tape = info.tape;
+                    if (knownRegister == 0) {
+                        absorb(pc);
+                    } else if (info.role == isa::ROLE_TAPE_HEAD) {
+                        emit(knownRegister == 1 ? UOP_TOGGLE : UOP_OUT_TOGGLE, tape, 0, pc);
+                    } else {
+                        int delta = info.role == isa::ROLE_TAPE_LEFT ? -1 : 1;
+                        if (knownRegister == 1 && lastIs(UOP_MOVE) && microOps.back().arg == tape) {
+                            microOps.back().delta += delta;
+                            microOps.back().count++;
+                        } else {
+                            emit(knownRegister == 1 ? UOP_MOVE : UOP_OUT_MOVE, tape, delta, pc);
+                        }
+                    }
+                }
+                break;
+            case OP_AND: {
+                if (knownRegister == 0) {
+                    absorb(pc);
+                    break;
+                }
+                int kind = source(false, arg);
+                emit(static_cast<MicroOpKind>(UOP_AND_MEM + kind), arg, 0, pc);
+                knownRegister = -1;
+                break;
+            }
+            case OP_DA1: case OP_DA2: case OP_DA3: case OP_DA4:
+            case OP_DA5: case OP_DA6: case OP_DA7: case OP_DA8:
+                line = opcode - OP_DA1;
+                if (lastIs(UOP_SELECT)) {
+                    microOps.back().arg = static_cast<uint8_t>(line);
+                    microOps.back().count++;
+                } else {
+                    emit(UOP_SELECT, line, 0, pc);
+                }
+                break;
+            default:
+                // Unknown instructions halt; leave them to the per-instruction path
+                microOps.resize(blockFirstOp);
+                compiled.compilable = false;
+                return compiled;
+        }
+    }
+    
+    compiled.opCount = static_cast<uint32_t>(microOps.size() - blockFirstOp);
+    return compiled;
+}
+
+template <bool Tape>
+void Emulator::runBlock(const CompiledBlock& variant) {
+    const MicroOp* op = &microOps[variant.firstOp];
+    const MicroOp* end = op + variant.opCount;
+    for (; op != end; ++op) {
+        switch (op->kind) {
+            case UOP_NOP: break;
+            case UOP_NOT: registerValue = !registerValue; break;
+            case UOP_SET_REG: registerValue = op->arg != 0; break;
+            case UOP_LD_MEM: registerValue = dataLines[op->arg].memoryValue; break;
+            case UOP_LD_INPUT: registerValue = dataLines[op->arg].input; break;
+            case UOP_LD_TAPE: registerValue = (op->arg == 0 ? tape1 : tape2).read(); break;
+            case UOP_XOR_MEM: registerValue = registerValue ^ dataLines[op->arg].memoryValue; break;
+            case UOP_XOR_INPUT: registerValue = registerValue ^ dataLines[op->arg].input; break;
+            case UOP_XOR_TAPE: registerValue = registerValue ^ (op->arg == 0 ? tape1 : tape2).read(); break;
+            case UOP_AND_MEM: registerValue = registerValue & dataLines[op->arg].memoryValue; break;
+            case UOP_AND_INPUT: registerValue = registerValue & dataLines[op->arg].input; break;
+            case UOP_AND_TAPE: registerValue = registerValue & (op->arg == 0 ? tape1 : tape2).read(); break;
+            case UOP_OR_MEM: registerValue = registerValue | dataLines[op->arg].memoryValue; break;
+            case UOP_OR_INPUT: registerValue = registerValue | dataLines[op->arg].input; break;
+            case UOP_OR_TAPE: registerValue = registerValue | (op->arg == 0 ? tape1 : tape2).read(); break;
+            case UOP_OUT_MEM: dataLines[op->arg].memoryValue = registerValue; break;
+            case UOP_OUT_OUTPUT: dataLines[op->arg].output = registerValue; break;
+            case UOP_OUT_TOGGLE: (op->arg == 0 ? tape1 : tape2).write(registerValue); break;
+            case UOP_OUT_MOVE:
+                if (registerValue) {
+                    (op->arg == 0 ? tape1 : tape2).headPosition += op->delta;
+                }
+                break;
+            case UOP_TOGGLE: (op->arg == 0 ? tape1 : tape2).write(true); break;
+            case UOP_MOVE: (op->arg == 0 ? tape1 : tape2).headPosition += op->delta; break;
+            case UOP_SELECT:
+                selectedDataLine = op->arg;
+                selectedLine = &lineHandlers[Tape][selectedDataLine];
+                break;
+            case UOP_SKZ: skipNext = dataLines[0].memoryValue; break;
+        }
+    }
+}
+
 void Emulator::reset() {
     registerValue = false;
     selectedDataLine = 0;
@@ -54,72 +342,348 @@ void Emulator::reset() {
         dataLines[i].memoryValue = false;
     }
     
-    tape1.tape.clear();
-    tape1.headPosition = 0;
-    tape2.tape.clear();
-    tape2.headPosition = 0;
+    selectedLine = &lineHandlers[0][selectedDataLine];
+    
+    tape1.clear();
+    tape2.clear();
+    
+    stats = RunStats();
+    invalidatePassCache();
 }
 
 bool Emulator::step() {
-    if (halted || programCounter >= static_cast<int>(instructions.size())) {
+    return tapeMode ? stepImpl<true, true>() : stepImpl<false, true>();
+}
+
+template <bool Tape, bool Trace>
+bool Emulator::stepImpl() {
+    if (halted || programCounter >= static_cast<int>(program.size())) {
         // Check HALT flag (DA2) before declaring halt
-        if (programCounter >= static_cast<int>(instructions.size()) && dataLines[1].memoryValue) {
+        if (programCounter >= static_cast<int>(program.size()) && dataLines[1].memoryValue) {
+            stats.passes++;
             halted = true;
             return false;
         }
         // Loop back to start if no halt flag
-        if (programCounter >= static_cast<int>(instructions.size())) {
+        if (programCounter >= static_cast<int>(program.size())) {
+            stats.passes++;
             programCounter = 0;
+            pendingPass = -1;  // This pass was not started by replayPass()
+            pendingWindow = false;
         }
     }
     
-    std::string instruction = instructions[programCounter];
-    std::cout << "PC:" << std::setw(3) << programCounter 
-              << " | " << std::setw(8) << instruction 
-              << " | ";
+    stats.cycles++;
+    if (Trace) {
+        std::cout << "PC:" << std::setw(3) << programCounter 
+                  << " | " << std::setw(8) << instructions[programCounter] 
+                  << " | ";
+    }
     
     // Check if we should skip this instruction
     if (skipNext) {
         skipNext = false;
         programCounter++;
-        std::cout << "SKIPPED | REG:" << (registerValue ? 1 : 0) << std::endl;
+        stats.skipped++;
+        if (Trace) {
+            std::cout << "SKIPPED | REG:" << (registerValue ? 1 : 0) << std::endl;
+        }
         return true;
     }
     
-    bool continueExecution = executeInstruction(instruction);
+    // The selected line's handlers were resolved when its DAx executed
+    uint8_t opcode = program[programCounter];
+    switch (opcode) {
+        case OP_NOT: registerValue = !registerValue; break;
+        case OP_SKZ: skipNext = dataLines[0].memoryValue; break;
+        case OP_OR:  registerValue = registerValue | selectedLine->read(*this, selectedDataLine); break;
+        case OP_LD:  selectedLine->load(*this, selectedDataLine); break;
+        case OP_XOR: registerValue = registerValue ^ selectedLine->read(*this, selectedDataLine); break;
+        case OP_OUT: selectedLine->output(*this, selectedDataLine); break;
+        case OP_AND: registerValue = registerValue & selectedLine->read(*this, selectedDataLine); break;
+        case OP_DA1: case OP_DA2: case OP_DA3: case OP_DA4:
+        case OP_DA5: case OP_DA6: case OP_DA7: case OP_DA8:
+            selectedDataLine = opcode - OP_DA1;
+            selectedLine = &lineHandlers[Tape][selectedDataLine];
+            break;
+        case OP_NONE:
+            std::cerr << "Unknown instruction: " << instructions[programCounter] << std::endl;
+            halted = true;
+            return false;
+        default:
+            std::cerr << "Invalid opcode: " << static_cast<int>(opcode) << std::endl;
+            halted = true;
+            return false;
+    }
     
-    if (!continueExecution) {
-        halted = true;
-        return false;
+    programCounter++;
+    
+    if (Trace) {
+        std::cout << "REG:" << (registerValue ? 1 : 0)
+                  << " | DA" << (selectedDataLine + 1) 
+                  << " IN:" << (dataLines[selectedDataLine].input ? 1 : 0)
+                  << " OUT:" << (dataLines[selectedDataLine].output ? 1 : 0)
+                  << std::endl;
     }
     
-    if (outputFlag) {
-        updateOutput();
-        outputFlag = false;
+    return true;
+}
+
+uint32_t Emulator::packPassState() const {
+    uint32_t state = (registerValue ? 1u : 0u) |
+                     (dataLines[0].memoryValue ? 2u : 0u) |
+                     (dataLines[1].memoryValue ? 4u : 0u) |
+                     static_cast<uint32_t>(selectedDataLine) << 3;
+    for (int line = 2; line < 8; ++line) {
+        if (dataLines[line].output) {
+            state |= 1u << (line + 4);  // DA3-DA8 in bits 6-11
+        }
+    }
+    if (skipNext) {
+        state |= 1u << 12;
+    }
+    return state;
+}
+
+void Emulator::unpackPassState(uint32_t state) {
+    registerValue = state & 1;
+    dataLines[0].memoryValue = (state >> 1) & 1;
+    dataLines[1].memoryValue = (state >> 2) & 1;
+    selectedDataLine = (state >> 3) & 7;
+    selectedLine = &lineHandlers[tapeMode][selectedDataLine];
+    for (int line = 2; line < 8; ++line) {
+        dataLines[line].output = (state >> (line + 4)) & 1;
+    }
+    skipNext = (state >> 12) & 1;
+}
+
+bool Emulator::endOfPass(uint64_t cyclesLeft) {
+    // Called with PC at the end of the program and the HALT flag clear
+    if (pendingPass >= 0) {
+        PassTransfer& transfer = passMemo[pendingPass];
+        transfer.known = true;
+        transfer.next = static_cast<uint16_t>(packPassState());
+        transfer.skipped = static_cast<uint32_t>(stats.skipped - pendingSkipped);
+        pendingPass = -1;
+    }
+    if (pendingWindow) {
+        if (windowMemo.size() >= WINDOW_MEMO_LIMIT) {
+            windowMemo.clear();
+        }
+        WindowStep& step = windowMemo[pendingKey];
+        step.state = static_cast<uint16_t>(packPassState());
+        step.windows[0] = tape1.window(pendingHeads[0] - windowReach[0], 2 * windowReach[0] + 1);
+        step.windows[1] = tape2.window(pendingHeads[1] - windowReach[1], 2 * windowReach[1] + 1);
+        step.deltas[0] = tape1.headPosition - pendingHeads[0];
+        step.deltas[1] = tape2.headPosition - pendingHeads[1];
+        step.skipped = static_cast<uint32_t>(stats.skipped - pendingSkipped);
+        pendingWindow = false;
     }
     
-    programCounter++;
+    // Brent's algorithm: compare against one saved state, moving it forward
+    // every power-of-two passes, so a cycle is found without storing history.
+    // Heads and tape hashes are checked first since they rule most passes out.
+    bool sameTapes = !tapeMode || (snapshot.tapes[0].headPosition == tape1.headPosition &&
+                                   snapshot.tapes[1].headPosition == tape2.headPosition &&
+                                   snapshot.tapes[0].hash == tape1.hash &&
+                                   snapshot.tapes[1].hash == tape2.hash);
+    if (snapshot.valid && sameTapes && snapshot.passes != stats.passes && snapshot.state == packPassState() &&
+        (!tapeMode || (snapshot.tapes[0].sameCells(tape1) && snapshot.tapes[1].sameCells(tape2)))) {
+        loopPeriod = stats.passes - snapshot.passes;
+        loopCycles = stats.cycles - snapshot.cycles;
+        if (cyclesLeft == UNLIMITED) {
+            return true;
+        }
+        // Every whole period returns to this exact state, so skip them
+        uint64_t periods = cyclesLeft / loopCycles;
+        uint64_t loopSkipped = stats.skipped - snapshot.skipped;
+        stats.cycles += periods * loopCycles;
+        stats.passes += periods * loopPeriod;
+        stats.skipped += periods * loopSkipped;
+        snapshot.cycles = stats.cycles - loopCycles;
+        snapshot.passes = stats.passes - loopPeriod;
+        snapshot.skipped = stats.skipped - loopSkipped;
+        return false;
+    }
+    if (!snapshot.valid || stats.passes - snapshot.passes >= snapshot.power) {
+        snapshot.power = snapshot.valid ? snapshot.power * 2 : 1;
+        snapshot.valid = true;
+        snapshot.state = packPassState();
+        snapshot.passes = stats.passes;
+        snapshot.cycles = stats.cycles;
+        snapshot.skipped = stats.skipped;
+        if (tapeMode) {
+            snapshot.tapes[0] = tape1;
+            snapshot.tapes[1] = tape2;
+        }
+    }
+    return false;
+}
+
+bool Emulator::replayPass(uint64_t cyclesLeft) {
+    // Runs the next whole pass from the memo; the first run of a state is recorded
+    if (cyclesLeft < program.size()) {
+        return false;
+    }
+    if (tapeMode) {
+        return replayWindowPass();
+    }
+    if (passMemo.empty()) {
+        passMemo.resize(1 << 13);
+    }
+    uint32_t state = packPassState();
+    const PassTransfer& transfer = passMemo[state];
+    if (!transfer.known) {
+        pendingPass = static_cast<int>(state);
+        pendingSkipped = stats.skipped;
+        return false;
+    }
+    stats.passes++;
+    stats.cycles += program.size();
+    stats.skipped += transfer.skipped;
+    stats.replayed++;
+    unpackPassState(transfer.next);
+    return true;
+}
+
+bool Emulator::replayWindowPass() {
+    if (windowReach[0] < 0 || windowReach[1] < 0) {
+        return false;  // Heads can move too far in one pass; simulate normally
+    }
+    TapeMemory* tapes[2] = {&tape1, &tape2};
+    WindowKey key;
+    key.state = packPassState();
+    for (int tape = 0; tape < 2; ++tape) {
+        key.windows[tape] = tapes[tape]->window(tapes[tape]->headPosition - windowReach[tape],
+                                                2 * windowReach[tape] + 1);
+    }
     
-    std::cout << "REG:" << (registerValue ? 1 : 0)
-              << " | DA" << (selectedDataLine + 1) 
-              << " IN:" << (dataLines[selectedDataLine].input ? 1 : 0)
-              << " OUT:" << (dataLines[selectedDataLine].output ? 1 : 0)
-              << std::endl;
+    auto found = windowMemo.find(key);
+    if (found == windowMemo.end()) {
+        pendingWindow = true;
+        pendingKey = key;
+        pendingHeads[0] = tape1.headPosition;
+        pendingHeads[1] = tape2.headPosition;
+        pendingSkipped = stats.skipped;
+        return false;
+    }
     
+    const WindowStep& step = found->second;
+    for (int tape = 0; tape < 2; ++tape) {
+        // Only the cells that changed need writing back
+        int low = tapes[tape]->headPosition - windowReach[tape];
+        for (uint64_t changed = key.windows[tape] ^ step.windows[tape]; changed; changed &= changed - 1) {
+            tapes[tape]->toggle(low + lowestSetBit(changed));
+        }
+        tapes[tape]->headPosition += step.deltas[tape];
+    }
+    stats.passes++;
+    stats.cycles += program.size();
+    stats.skipped += step.skipped;
+    stats.replayed++;
+    unpackPassState(step.state);
     return true;
 }
 
+void Emulator::invalidatePassCache() {
+    passMemo.clear();
+    pendingPass = -1;
+    windowMemo.clear();
+    pendingWindow = false;
+    snapshot.valid = false;
+    loopPeriod = 0;
+    loopCycles = 0;
+}
+
+void Emulator::enablePassCache(bool enable) {
+    passCacheEnabled = enable;
+    invalidatePassCache();
+}
+
+bool Emulator::atBreakpoint() const {
+    int pc = programCounter;
+    if (pc >= static_cast<int>(program.size())) {
+        // About to halt rather than wrap, so PC 0 will not run
+        if (dataLines[1].memoryValue) {
+            return false;
+        }
+        pc = 0;
+    }
+    return breakpoints[pc] != 0;
+}
+
+template <bool Tape, bool Trace, bool Breakpoints>
+Emulator::StopReason Emulator::runLoop(uint64_t maxCycles, double maxSeconds) {
+    // Only check the clock every so often so timing stays out of the hot loop
+    const uint64_t CLOCK_CHECK_INTERVAL = 1 << 16;
+    
+    auto start = std::chrono::steady_clock::now();
+    uint64_t startCycles = stats.cycles;
+    uint64_t nextClockCheck = startCycles + CLOCK_CHECK_INTERVAL;
+    
+    // A breakpoint at the starting PC does not stop the run, so runs can resume from it
+    bool firstStep = true;
+    while (maxCycles == 0 || stats.cycles - startCycles < maxCycles) {
+        if (Breakpoints && !firstStep && atBreakpoint()) {
+            return STOP_BREAKPOINT;
+        }
+        firstStep = false;
+        if (passCacheEnabled && programCounter >= static_cast<int>(program.size()) &&
+            !halted && !dataLines[1].memoryValue) {
+            if (endOfPass(maxCycles == 0 ? UNLIMITED : maxCycles - (stats.cycles - startCycles))) {
+                return STOP_LOOP;
+            }
+            if (maxCycles != 0 && stats.cycles - startCycles >= maxCycles) {
+                return STOP_CYCLES;
+            }
+        }
+        if (!stepImpl<Tape, Trace>()) {
+            return STOP_HALTED;
+        }
+        if (maxSeconds > 0.0 && stats.cycles >= nextClockCheck) {
+            nextClockCheck = stats.cycles + CLOCK_CHECK_INTERVAL;
+            std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+            if (elapsed.count() >= maxSeconds) {
+                return STOP_TIME;
+            }
+        }
+    }
+    return STOP_CYCLES;
+}
+
+Emulator::StopReason Emulator::runUntilStop(bool trace, uint64_t maxCycles, double maxSeconds) {
+    // Pick the loop instantiation once so the loop itself never tests a mode
+    int mode = (tapeMode ? 4 : 0) | (trace ? 2 : 0) | (breakpointCount > 0 ? 1 : 0);
+    switch (mode) {
+        case 0: return runLoop<false, false, false>(maxCycles, maxSeconds);
+        case 1: return runLoop<false, false, true>(maxCycles, maxSeconds);
+        case 2: return runLoop<false, true, false>(maxCycles, maxSeconds);
+        case 3: return runLoop<false, true, true>(maxCycles, maxSeconds);
+        case 4: return runLoop<true, false, false>(maxCycles, maxSeconds);
+        case 5: return runLoop<true, false, true>(maxCycles, maxSeconds);
+        case 6: return runLoop<true, true, false>(maxCycles, maxSeconds);
+        default: return runLoop<true, true, true>(maxCycles, maxSeconds);
+    }
+}
+
 void Emulator::run() {
     std::cout << "Running program..." << std::endl;
     printState();
     std::cout << std::endl;
     
-    while (step()) {
-        // Continue execution
+    // Stop at each breakpoint to show the state, then carry on
+    StopReason stop;
+    while ((stop = runUntilStop(true)) == STOP_BREAKPOINT) {
+        std::cout << std::endl << "Breakpoint at PC " << programCounter << std::endl;
+        printState();
+        std::cout << std::endl;
     }
     
     if (halted) {
         std::cout << std::endl << "Program halted." << std::endl;
+    } else if (stop == STOP_LOOP) {
+        std::cout << std::endl << "Program never halts: state repeats every " << loopPeriod
+                  << " passes (" << loopCycles << " cycles)." << std::endl;
     } else {
         std::cout << std::endl << "Program completed." << std::endl;
     }
@@ -127,15 +691,128 @@ void Emulator::run() {
     printState();
 }
 
+const Emulator::RunStats& Emulator::runHeadless(uint64_t maxCycles, double maxSeconds) {
+    auto start = std::chrono::steady_clock::now();
+    
+    if (!fusionEnabled || breakpointCount > 0) {
+        lastStop = runUntilStop(false, maxCycles, maxSeconds);
+    } else {
+        lastStop = tapeMode ? runFused<true>(maxCycles, maxSeconds) : runFused<false>(maxCycles, maxSeconds);
+    }
+    
+    std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+    stats.seconds += elapsed.count();
+    return stats;
+}
+
+template <bool Tape>
+Emulator::StopReason Emulator::runFused(uint64_t maxCycles, double maxSeconds) {
+    const uint64_t CLOCK_CHECK_INTERVAL = 1 << 16;
+    
+    auto start = std::chrono::steady_clock::now();
+    uint64_t startCycles = stats.cycles;
+    uint64_t nextClockCheck = startCycles + CLOCK_CHECK_INTERVAL;
+    
+    while (maxCycles == 0 || stats.cycles - startCycles < maxCycles) {
+        // Whole blocks run as fused micro-ops; anything else goes one instruction at a time
+        if (!halted) {
+            if (programCounter >= static_cast<int>(program.size())) {
+                if (passCacheEnabled && !dataLines[1].memoryValue) {
+                    uint64_t cyclesLeft = maxCycles == 0 ? UNLIMITED : maxCycles - (stats.cycles - startCycles);
+                    if (endOfPass(cyclesLeft)) {
+                        return STOP_LOOP;
+                    }
+                    cyclesLeft = maxCycles == 0 ? UNLIMITED : maxCycles - (stats.cycles - startCycles);
+                    if (cyclesLeft == 0) {
+                        return STOP_CYCLES;
+                    }
+                    if (replayPass(cyclesLeft)) {
+                        if (maxSeconds > 0.0 && stats.cycles >= nextClockCheck) {
+                            nextClockCheck = stats.cycles + CLOCK_CHECK_INTERVAL;
+                            std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+                            if (elapsed.count() >= maxSeconds) {
+                                return STOP_TIME;
+                            }
+                        }
+                        continue;
+                    }
+                }
+                stats.passes++;
+                if (dataLines[1].memoryValue) {
+                    halted = true;
+                    return STOP_HALTED;
+                }
+                programCounter = 0;
+            }
+            int block = blockAt[programCounter];
+            if (block >= 0) {
+                const CompiledBlock& variant = blockVariant(block, skipNext);
+                if (variant.compilable &&
+                    (maxCycles == 0 || stats.cycles - startCycles + variant.cycles <= maxCycles)) {
+                    if (skipNext) {
+                        skipNext = false;
+                        stats.skipped++;
+                    }
+                    runBlock<Tape>(variant);
+                    stats.cycles += variant.cycles;
+                    programCounter = blockEnd[block];
+                    if (maxSeconds > 0.0 && stats.cycles >= nextClockCheck) {
+                        nextClockCheck = stats.cycles + CLOCK_CHECK_INTERVAL;
+                        std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+                        if (elapsed.count() >= maxSeconds) {
+                            return STOP_TIME;
+                        }
+                    }
+                    continue;
+                }
+            }
+        }
+        if (!stepImpl<Tape, false>()) {
+            return STOP_HALTED;
+        }
+        if (maxSeconds > 0.0 && stats.cycles >= nextClockCheck) {
+            nextClockCheck = stats.cycles + CLOCK_CHECK_INTERVAL;
+            std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+            if (elapsed.count() >= maxSeconds) {
+                return STOP_TIME;
+            }
+        }
+    }
+    return STOP_CYCLES;
+}
+
+void Emulator::printRunStats() const {
+    std::cout << "=== Run Statistics ===" << std::endl;
+    std::cout << "Cycles: " << stats.cycles << std::endl;
+    std::cout << "Passes: " << stats.passes << std::endl;
+    std::cout << "Skipped Instructions: " << stats.skipped << std::endl;
+    if (stats.replayed > 0) {
+        std::cout << "Replayed Passes: " << stats.replayed << std::endl;
+    }
+    std::ostringstream elapsed;
+    elapsed << std::fixed << std::setprecision(3) << stats.seconds;
+    std::cout << "Elapsed: " << elapsed.str() << " s" << std::endl;
+    if (tapeMode) {
+        std::cout << "Tape Memory: " << getTapeMemoryFootprint() << " bytes" << std::endl;
+    }
+    if (loopPeriod > 0) {
+        std::cout << "Loop Period: " << loopPeriod << " passes (" << loopCycles << " cycles)" << std::endl;
+    }
+    if (stats.seconds > 0.0) {
+        std::cout << "Instructions/sec: " << static_cast<uint64_t>(stats.cycles / stats.seconds) << std::endl;
+    }
+}
+
 void Emulator::runInteractive() {
     clearScreen();
     std::cout << "Interactive mode commands:" << std::endl;
     std::cout << "  Enter/step - Execute next instruction" << std::endl;
     std::cout << "  q/quit     - Quit emulator" << std::endl;
-    std::cout << "  r/run      - Run until completion" << std::endl;
+    std::cout << "  r/run      - Run until completion or breakpoint" << std::endl;
     std::cout << "  s/state    - Show current state" << std::endl;
     std::cout << "  p/program  - Show program with PC" << std::endl;
     std::cout << "  set DAx 0/1- Set data line x input to 0 or 1" << std::endl;
+    std::cout << "  b <pc>     - Toggle breakpoint at PC" << std::endl;
     std::cout << "  h/help     - Show this help" << std::endl;
     std::cout << std::endl;
     printState();
@@ -153,11 +830,19 @@ void Emulator::runInteractive() {
             std::cout << "Running program..." << std::endl;
             printState();
             std::cout << std::endl;
-            while (step()) {
-                // Continue execution
+            bool firstStep = true;
+            while (firstStep || !atBreakpoint()) {
+                firstStep = false;
+                if (!step()) {
+                    break;
+                }
                 printTapeState();
             }
-            break;
+            if (halted) {
+                break;
+            }
+            std::cout << std::endl << "Breakpoint at PC " << programCounter << std::endl;
+            printState();
         } else if (input == "s" || input == "state") {
             clearScreen();
             printState();
@@ -169,13 +854,23 @@ void Emulator::runInteractive() {
             std::cout << "Interactive mode commands:" << std::endl;
             std::cout << "  Enter/step - Execute next instruction" << std::endl;
             std::cout << "  q/quit     - Quit emulator" << std::endl;
-            std::cout << "  r/run      - Run until completion" << std::endl;
+            std::cout << "  r/run      - Run until completion or breakpoint" << std::endl;
             std::cout << "  s/state    - Show current state" << std::endl;
             std::cout << "  p/program  - Show program with PC" << std::endl;
             std::cout << "  set DAx 0/1- Set data line x input to 0 or 1" << std::endl;
+            std::cout << "  b <pc>     - Toggle breakpoint at PC" << std::endl;
             std::cout << "  h/help     - Show this help" << std::endl;
             std::cout << std::endl;
             printState();
+        } else if (input.size() > 2 && input.substr(0, 2) == "b ") {
+            std::istringstream iss(input.substr(2));
+            int pc;
+            if (iss >> pc && pc >= 0 && pc < static_cast<int>(program.size())) {
+                setBreakpoint(pc, !hasBreakpoint(pc));
+                std::cout << (hasBreakpoint(pc) ? "Breakpoint set at PC " : "Breakpoint cleared at PC ") << pc << std::endl;
+            } else {
+                std::cout << "Invalid PC. Use: b <pc>" << std::endl;
+            }
         } else if (input.substr(0, 3) == "set") {
             // Parse "set DAx value" command
             std::istringstream iss(input);
@@ -253,9 +948,9 @@ void Emulator::printTapeState() const {
     std::cout << "  Tape 1 (DA3-DA5): ";
     for (int i = tape1.headPosition - 3; i <= tape1.headPosition + 3; ++i) {
         if (i == tape1.headPosition) {
-            std::cout << "[" << (tape1.tape.count(i) ? (tape1.tape.at(i) ? 1 : 0) : 0) << "]";
+            std::cout << "[" << (tape1.cell(i) ? 1 : 0) << "]";
         } else {
-            std::cout << (tape1.tape.count(i) ? (tape1.tape.at(i) ? 1 : 0) : 0);
+            std::cout << (tape1.cell(i) ? 1 : 0);
         }
         if (i < tape1.headPosition + 3) std::cout << " ";
     }
@@ -265,9 +960,9 @@ void Emulator::printTapeState() const {
     std::cout << "  Tape 2 (DA6-DA8): ";
     for (int i = tape2.headPosition - 3; i <= tape2.headPosition + 3; ++i) {
         if (i == tape2.headPosition) {
-            std::cout << "[" << (tape2.tape.count(i) ? (tape2.tape.at(i) ? 1 : 0) : 0) << "]";
+            std::cout << "[" << (tape2.cell(i) ? 1 : 0) << "]";
         } else {
-            std::cout << (tape2.tape.count(i) ? (tape2.tape.at(i) ? 1 : 0) : 0);
+            std::cout << (tape2.cell(i) ? 1 : 0);
         }
         if (i < tape2.headPosition + 3) std::cout << " ";
     }
@@ -278,6 +973,9 @@ void Emulator::printProgram() const {
     std::cout << "=== Program ===" << std::endl;
     for (size_t i = 0; i < instructions.size(); ++i) {
         std::cout << std::setw(3) << i << ": " << instructions[i];
+        if (breakpoints[i]) {
+            std::cout << " [BREAK]";
+        }
         if (static_cast<int>(i) == programCounter) {
             std::cout << " <-- PC";
         }
@@ -293,6 +991,15 @@ void Emulator::clearScreen() const {
 void Emulator::setDataInput(int dataLine, bool value) {
     if (dataLine >= 2 && dataLine < 8) {
         dataLines[dataLine].input = value;
+        invalidatePassCache();
+    }
+}
+
+void Emulator::setTapeCell(int tapeIndex, int position, bool value) {
+    TapeMemory& tape = tapeIndex == 0 ? tape1 : tape2;
+    if (tape.cell(position) != value) {
+        tape.toggle(position);
+        invalidatePassCache();
     }
 }
 
@@ -303,227 +1010,63 @@ bool Emulator::getDataOutput(int dataLine) const {
     return false;
 }
 
-bool Emulator::executeInstruction(const std::string& instruction) {
-    auto it = opcodeToNumber.find(instruction);
-    if (it == opcodeToNumber.end()) {
-        std::cerr << "Unknown instruction: " << instruction << std::endl;
-        return false;
+// Data line handlers, indexed [tape mode][line]. DA1/DA2 are always memory
+// cells; in Turing mode DA3-DA8 drive the two tapes instead of I/O lines.
+const Emulator::LineHandler Emulator::lineHandlers[2][8] = {
+    {
+        {readMemory, loadMemory, outputMemory},
+        {readMemory, loadMemory, outputMemory},
+        {readInput, loadInput, outputLine},
+        {readInput, loadInput, outputLine},
+        {readInput, loadInput, outputLine},
+        {readInput, loadInput, outputLine},
+        {readInput, loadInput, outputLine},
+        {readInput, loadInput, outputLine}
+    },
+    {
+        {readMemory, loadMemory, outputMemory},
+        {readMemory, loadMemory, outputMemory},
+        {readInput, loadNothing, moveTape1Left},    // DA3 - tape 1 left
+        {readTape1, loadTape1, toggleTape1},        // DA4 - tape 1 read/write
+        {readInput, loadNothing, moveTape1Right},   // DA5 - tape 1 right
+        {readInput, loadNothing, moveTape2Left},    // DA6 - tape 2 left
+        {readTape2, loadTape2, toggleTape2},        // DA7 - tape 2 read/write
+        {readInput, loadNothing, moveTape2Right}    // DA8 - tape 2 right
     }
-    
-    int opcode = it->second;
-    
-    switch (opcode) {
-        case 1: executeNOT(); break;
-        case 2: executeSKZ(); break;
-        case 3: executeOR(); break;
-        case 4: executeLD(); break;
-        case 5: executeXOR(); break;
-        case 6: executeOUT(); break;
-        case 7: executeAND(); break;
-        case 8: case 9: case 10: case 11: case 12: case 13: case 14: case 15:
-            executeDataSelect(opcode - 8); break;
-        default:
-            std::cerr << "Invalid opcode: " << opcode << std::endl;
-            return false;
-    }
-    
-    return true;
-}
+};
 
-void Emulator::updateOutput() {
-    if (tapeMode && (selectedDataLine >= 2 && selectedDataLine <= 7)) {
-        handleTapeOperation(selectedDataLine, true);
-    } else {
-        // Normal memory operation for DA1/DA2, output for others
-        if (selectedDataLine < 2) {
-            writeMemoryCell(selectedDataLine, registerValue);
-        } else {
-            dataLines[selectedDataLine].output = registerValue;
-        }
-    }
+void Emulator::enableTapeMode(bool enable) {
+    tapeMode = enable;
+    selectedLine = &lineHandlers[tapeMode][selectedDataLine];
+    invalidatePassCache();
 }
 
-void Emulator::executeXOR() {
-    bool valueToXOR;
-    if (tapeMode && (selectedDataLine >= 2 && selectedDataLine <= 7)) {
-        // For tape operations, we need to read the current tape value
-        if (selectedDataLine >= 2 && selectedDataLine <= 4) {
-            // Tape 1 - DA4 is the read/write head
-            if (selectedDataLine == 3) {
-                valueToXOR = tape1.read();
-            } else {
-                valueToXOR = dataLines[selectedDataLine].input;
-            }
-        } else if (selectedDataLine >= 5 && selectedDataLine <= 7) {
-            // Tape 2 - DA7 is the read/write head  
-            if (selectedDataLine == 6) {
-                valueToXOR = tape2.read();
-            } else {
-                valueToXOR = dataLines[selectedDataLine].input;
-            }
-        } else {
-            valueToXOR = dataLines[selectedDataLine].input;
-        }
-    } else {
-        // Normal operation - use input line or memory
-        if (selectedDataLine < 2) {
-            valueToXOR = readMemoryCell(selectedDataLine);
-        } else {
-            valueToXOR = dataLines[selectedDataLine].input;
-        }
+void Emulator::setBreakpoint(int pc, bool enable) {
+    if (pc < 0 || pc >= static_cast<int>(breakpoints.size())) {
+        return;
     }
-    
-    registerValue = registerValue ^ valueToXOR;
-}
-
-void Emulator::executeSKZ() {
-    // Skip next instruction if SKIP flag (DA1 memory) is high
-    if (dataLines[0].memoryValue) {
-        skipNext = true;
+    if ((breakpoints[pc] != 0) != enable) {
+        breakpoints[pc] = enable;
+        breakpointCount += enable ? 1 : -1;
     }
 }
 
-void Emulator::executeAND() {
-    bool valueToAND;
-    if (tapeMode && (selectedDataLine >= 2 && selectedDataLine <= 7)) {
-        // For tape operations, we need to read the current tape value
-        if (selectedDataLine >= 2 && selectedDataLine <= 4) {
-            // Tape 1 - DA4 is the read/write head
-            if (selectedDataLine == 3) {
-                valueToAND = tape1.read();
-            } else {
-                valueToAND = dataLines[selectedDataLine].input;
-            }
-        } else if (selectedDataLine >= 5 && selectedDataLine <= 7) {
-            // Tape 2 - DA7 is the read/write head  
-            if (selectedDataLine == 6) {
-                valueToAND = tape2.read();
-            } else {
-                valueToAND = dataLines[selectedDataLine].input;
-            }
-        } else {
-            valueToAND = dataLines[selectedDataLine].input;
-        }
-    } else {
-        // Normal operation - use input line or memory
-        if (selectedDataLine < 2) {
-            valueToAND = readMemoryCell(selectedDataLine);
-        } else {
-            valueToAND = dataLines[selectedDataLine].input;
-        }
-    }
-    
-    registerValue = registerValue & valueToAND;
-}
+bool Emulator::readMemory(const Emulator& emulator, int line) { return emulator.dataLines[line].memoryValue; }
+bool Emulator::readInput(const Emulator& emulator, int line) { return emulator.dataLines[line].input; }
+bool Emulator::readTape1(const Emulator& emulator, int) { return emulator.tape1.read(); }
+bool Emulator::readTape2(const Emulator& emulator, int) { return emulator.tape2.read(); }
 
-void Emulator::executeLD() {
-    if (tapeMode && (selectedDataLine >= 2 && selectedDataLine <= 7)) {
-        handleTapeOperation(selectedDataLine, false);
-    } else {
-        // Normal memory operation for DA1/DA2, input for others
-        if (selectedDataLine < 2) {
-            registerValue = readMemoryCell(selectedDataLine);
-        } else {
-            registerValue = dataLines[selectedDataLine].input;
-        }
-    }
-}
+void Emulator::loadMemory(Emulator& emulator, int line) { emulator.registerValue = emulator.dataLines[line].memoryValue; }
+void Emulator::loadInput(Emulator& emulator, int line) { emulator.registerValue = emulator.dataLines[line].input; }
+void Emulator::loadTape1(Emulator& emulator, int) { emulator.registerValue = emulator.tape1.read(); }
+void Emulator::loadTape2(Emulator& emulator, int) { emulator.registerValue = emulator.tape2.read(); }
+void Emulator::loadNothing(Emulator&, int) {}
 
-void Emulator::executeOR() {
-    bool valueToOR;
-    if (tapeMode && (selectedDataLine >= 2 && selectedDataLine <= 7)) {
-        // For tape operations, we need to read the current tape value
-        if (selectedDataLine >= 2 && selectedDataLine <= 4) {
-            // Tape 1 - DA4 is the read/write head
-            if (selectedDataLine == 3) {
-                valueToOR = tape1.read();
-            } else {
-                valueToOR = dataLines[selectedDataLine].input;
-            }
-        } else if (selectedDataLine >= 5 && selectedDataLine <= 7) {
-            // Tape 2 - DA7 is the read/write head  
-            if (selectedDataLine == 6) {
-                valueToOR = tape2.read();
-            } else {
-                valueToOR = dataLines[selectedDataLine].input;
-            }
-        } else {
-            valueToOR = dataLines[selectedDataLine].input;
-        }
-    } else {
-        // Normal operation - use input line or memory
-        if (selectedDataLine < 2) {
-            valueToOR = readMemoryCell(selectedDataLine);
-        } else {
-            valueToOR = dataLines[selectedDataLine].input;
-        }
-    }
-    
-    registerValue = registerValue | valueToOR;
-}
-
-void Emulator::executeOUT() {
-    outputFlag = true;
-}
-
-void Emulator::executeNOT() {
-    registerValue = !registerValue;
-}
-
-void Emulator::executeDataSelect(int dataLineIndex) {
-    selectedDataLine = dataLineIndex;
-}
-
-std::string Emulator::getInstructionName(const std::string& instruction) const {
-    return instruction;
-}
-
-bool Emulator::readMemoryCell(int dataLineIndex) {
-    if (dataLineIndex < 2) {
-        return dataLines[dataLineIndex].memoryValue;
-    }
-    return dataLines[dataLineIndex].input;
-}
-
-void Emulator::writeMemoryCell(int dataLineIndex, bool value) {
-    if (dataLineIndex < 2) {
-        dataLines[dataLineIndex].memoryValue = value;
-    } else {
-        dataLines[dataLineIndex].output = value;
-    }
-}
-
-void Emulator::handleTapeOperation(int dataLineIndex, bool isWrite) {
-    if (!tapeMode) return;
-    
-    // Tape 1: DA3 (left), DA4 (read/write), DA5 (right)
-    // Tape 2: DA6 (left), DA7 (read/write), DA8 (right)
-    
-    if (dataLineIndex >= 2 && dataLineIndex <= 4) {
-        // Tape 1 operations
-        if (dataLineIndex == 2 && registerValue && isWrite) { // DA3 - move left
-            tape1.moveLeft();
-        } else if (dataLineIndex == 3) { // DA4 - read/write
-            if (isWrite) {
-                tape1.write(registerValue);
-            } else {
-                registerValue = tape1.read();
-            }
-        } else if (dataLineIndex == 4 && registerValue && isWrite) { // DA5 - move right
-            tape1.moveRight();
-        }
-    } else if (dataLineIndex >= 5 && dataLineIndex <= 7) {
-        // Tape 2 operations
-        if (dataLineIndex == 5 && registerValue && isWrite) { // DA6 - move left
-            tape2.moveLeft();
-        } else if (dataLineIndex == 6) { // DA7 - read/write
-            if (isWrite) {
-                tape2.write(registerValue);
-            } else {
-                registerValue = tape2.read();
-            }
-        } else if (dataLineIndex == 7 && registerValue && isWrite) { // DA8 - move right
-            tape2.moveRight();
-        }
-    }
-}
\ No newline at end of file
+void Emulator::outputMemory(Emulator& emulator, int line) { emulator.dataLines[line].memoryValue = emulator.registerValue; }
+void Emulator::outputLine(Emulator& emulator, int line) { emulator.dataLines[line].output = emulator.registerValue; }
+void Emulator::moveTape1Left(Emulator& emulator, int) { if (emulator.registerValue) emulator.tape1.moveLeft(); }
+void Emulator::moveTape1Right(Emulator& emulator, int) { if (emulator.registerValue) emulator.tape1.moveRight(); }
+void Emulator::moveTape2Left(Emulator& emulator, int) { if (emulator.registerValue) emulator.tape2.moveLeft(); }
+void Emulator::moveTape2Right(Emulator& emulator, int) { if (emulator.registerValue) emulator.tape2.moveRight(); }
+void Emulator::toggleTape1(Emulator& emulator, int) { emulator.tape1.write(emulator.registerValue); }
+void Emulator::toggleTape2(Emulator& emulator, int) { emulator.tape2.write(emulator.registerValue); }
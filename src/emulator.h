@@ -1,59 +1,234 @@
 #pragma once
 
 #include <iostream>
+#include <cstdint>
 #include <string>
 #include <vector>
 #include <unordered_map>
-#include <map>
+#include <algorithm>
 #include "assembler.h"
 
 class Emulator {
 public:
+    // Counters gathered while running, reported by the headless mode
+    struct RunStats {
+        uint64_t cycles = 0;    // Instructions fetched, including skipped ones
+        uint64_t passes = 0;    // Times execution reached the end of the program
+        uint64_t skipped = 0;   // Instructions skipped by SKZ
+        uint64_t replayed = 0;  // Passes applied from the pass cache instead of simulated
+        double seconds = 0.0;   // Wall-clock time spent in runHeadless()
+    };
+
+    // Why a run loop returned
+    enum StopReason {
+        STOP_HALTED,
+        STOP_CYCLES,
+        STOP_TIME,
+        STOP_BREAKPOINT,
+        STOP_LOOP        // State repeats an earlier pass and no cycle budget was given
+    };
+
     Emulator();
     ~Emulator() = default;
     
-    bool loadProgram(const std::string& assemblyFile);
+    // Assembles the file, running the peephole optimizer over it if asked,
+    // with the rewrite table if one is given
+    bool loadProgram(const std::string& assemblyFile, bool optimize = false, const RewriteTable* rewrites = nullptr);
+    bool loadInstructions(const std::vector<std::string>& assembled);
     void reset();
     bool step();
     void run();
     void runInteractive();
+    // Run with no per-step output until halt or a budget runs out (0 = unlimited)
+    const RunStats& runHeadless(uint64_t maxCycles = 0, double maxSeconds = 0.0);
+    void printRunStats() const;
+    StopReason getLastStopReason() const { return lastStop; }
+    
+    // Runs stop before executing a breakpoint PC (except the PC they start on)
+    void setBreakpoint(int pc, bool enable = true);
+    bool hasBreakpoint(int pc) const { return pc >= 0 && pc < static_cast<int>(breakpoints.size()) && breakpoints[pc]; }
     
     void printState() const;
     void printProgram() const;
     void clearScreen() const;
     void setDataInput(int dataLine, bool value);
     bool getDataOutput(int dataLine) const;
-    void enableTapeMode(bool enable) { tapeMode = enable; }
+    void setTapeCell(int tapeIndex, int position, bool value);
+    void enableTapeMode(bool enable);
+    // Headless runs execute fused basic blocks unless this is turned off
+    void enableFusion(bool enable) { fusionEnabled = enable; }
+    // Whole passes are replayed from a memo (no tape) and repeating states are
+    // fast-forwarded over unless this is turned off
+    void enablePassCache(bool enable);
+    // Passes in the detected state cycle, 0 while no repeat has been seen
+    uint64_t getLoopPeriod() const { return loopPeriod; }
     
     bool isRunning() const { return !halted; }
     bool isHalted() const { return halted; }
     int getCurrentPC() const { return programCounter; }
     bool getRegisterValue() const { return registerValue; }
     bool getOutputFlag() const { return outputFlag; }
+    bool getMemoryValue(int dataLine) const { return dataLine >= 0 && dataLine < 2 && dataLines[dataLine].memoryValue; }
+    int getSelectedDataLine() const { return selectedDataLine; }
+    bool getTapeCell(int tapeIndex, int position) const { return (tapeIndex == 0 ? tape1 : tape2).cell(position); }
+    int getTapeHead(int tapeIndex) const { return (tapeIndex == 0 ? tape1 : tape2).headPosition; }
+    size_t getTapeMemoryFootprint() const { return tape1.memoryFootprint() + tape2.memoryFootprint(); }
+    const std::vector<uint8_t>& getProgram() const { return program; }
+    const RunStats& getRunStats() const { return stats; }
 
 private:
+    // Handlers for the selected data line, looked up once when DAx executes
+    struct LineHandler {
+        bool (*read)(const Emulator&, int line);   // Operand for XOR/AND/OR
+        void (*load)(Emulator&, int line);         // LD
+        void (*output)(Emulator&, int line);       // OUT
+    };
+    static const LineHandler lineHandlers[2][8];   // [tape mode][data line]
+    static const uint64_t UNLIMITED = ~uint64_t(0);  // Cycles left when no budget was given
+    
     struct DataLine {
         bool input = false;
         bool output = false;
         bool memoryValue = false;  // For DA1/DA2 memory storage
     };
     
+    // Infinite tape stored as fixed-size bit pages growing in both directions.
+    // Reads never allocate; a page is only created when a cell in it is toggled.
     struct TapeMemory {
-        std::map<int, bool> tape;  // Infinite tape using map
+        static const int PAGE_SHIFT = 12;  // 4096 cells per page
+        static const int PAGE_CELLS = 1 << PAGE_SHIFT;
+        static const int PAGE_WORDS = PAGE_CELLS / 64;
+        
+        std::vector<std::vector<uint64_t>> rightPages;  // Cells 0, 1, 2, ...
+        std::vector<std::vector<uint64_t>> leftPages;   // Cells -1, -2, -3, ...
         int headPosition = 0;
+        uint64_t hash = 0;  // XOR of cellKey() over the set cells
         
-        bool read() {
-            return tape[headPosition];
+        bool read() const {
+            return cell(headPosition);
         }
         
         void write(bool value) {
             if (value) {
-                tape[headPosition] = !tape[headPosition];  // Toggle if high
+                toggle(headPosition);  // Toggle if high
             }
         }
         
         void moveLeft() { headPosition--; }
         void moveRight() { headPosition++; }
+        
+        bool cell(int position) const {
+            const std::vector<std::vector<uint64_t>>& pages = position >= 0 ? rightPages : leftPages;
+            unsigned int index = pageIndex(position);
+            if (index >= pages.size() || pages[index].empty()) {
+                return false;
+            }
+            unsigned int offset = pageOffset(position);
+            return (pages[index][offset >> 6] >> (offset & 63)) & 1;
+        }
+        
+        void toggle(int position) {
+            std::vector<std::vector<uint64_t>>& pages = position >= 0 ? rightPages : leftPages;
+            unsigned int index = pageIndex(position);
+            if (index >= pages.size()) {
+                pages.resize(index + 1);
+            }
+            if (pages[index].empty()) {
+                pages[index].assign(PAGE_WORDS, 0);
+            }
+            unsigned int offset = pageOffset(position);
+            pages[index][offset >> 6] ^= uint64_t(1) << (offset & 63);
+            hash ^= cellKey(position);
+        }
+        
+        // Same set cells, however the pages happen to be allocated
+        bool sameCells(const TapeMemory& other) const {
+            return samePages(rightPages, other.rightPages) && samePages(leftPages, other.leftPages);
+        }
+        
+        // Zero the tape but keep the pages allocated for the next run
+        void clear() {
+            for (auto& page : rightPages) std::fill(page.begin(), page.end(), 0);
+            for (auto& page : leftPages) std::fill(page.begin(), page.end(), 0);
+            headPosition = 0;
+            hash = 0;
+        }
+        
+        size_t memoryFootprint() const {
+            size_t bytes = (rightPages.capacity() + leftPages.capacity()) * sizeof(std::vector<uint64_t>);
+            for (const auto& page : rightPages) bytes += page.capacity() * sizeof(uint64_t);
+            for (const auto& page : leftPages) bytes += page.capacity() * sizeof(uint64_t);
+            return bytes;
+        }
+        
+        // Negative cells are mirrored onto the left pages as -1 -> 0, -2 -> 1, ...
+        static unsigned int pageIndex(int position) {
+            unsigned int cellIndex = position >= 0 ? position : ~position;
+            return cellIndex >> PAGE_SHIFT;
+        }
+        static unsigned int pageOffset(int position) {
+            unsigned int cellIndex = position >= 0 ? position : ~position;
+            return cellIndex & (PAGE_CELLS - 1);
+        }
+        // Cells low .. low + count - 1 as bits 0 .. count - 1 (count <= 64)
+        uint64_t window(int low, int count) const {
+            uint64_t bits = 0;
+            int high = low + count - 1;
+            if (high >= 0) {
+                int first = std::max(low, 0);
+                bits |= pageBits(rightPages, first, high - first + 1) << (first - low);
+            }
+            if (low < 0) {
+                // Mirrored cells ~last .. ~low hold positions last .. low, so reverse them
+                int last = std::min(high, -1);
+                int width = last - low + 1;
+                bits |= reverseBits(pageBits(leftPages, ~last, width)) >> (64 - width);
+            }
+            return bits;
+        }
+        
+        static uint64_t pageBits(const std::vector<std::vector<uint64_t>>& pages, unsigned int start, int count) {
+            uint64_t bits = 0;
+            for (int got = 0; got < count; ) {
+                unsigned int cellIndex = start + got;
+                unsigned int index = cellIndex >> PAGE_SHIFT;
+                unsigned int offset = cellIndex & (PAGE_CELLS - 1);
+                int take = std::min(64 - static_cast<int>(offset & 63), count - got);
+                uint64_t word = index < pages.size() && !pages[index].empty() ? pages[index][offset >> 6] : 0;
+                uint64_t mask = take == 64 ? ~uint64_t(0) : (uint64_t(1) << take) - 1;
+                bits |= ((word >> (offset & 63)) & mask) << got;
+                got += take;
+            }
+            return bits;
+        }
+        static uint64_t reverseBits(uint64_t bits) {
+            bits = ((bits >> 1) & 0x5555555555555555ULL) | ((bits & 0x5555555555555555ULL) << 1);
+            bits = ((bits >> 2) & 0x3333333333333333ULL) | ((bits & 0x3333333333333333ULL) << 2);
+            bits = ((bits >> 4) & 0x0f0f0f0f0f0f0f0fULL) | ((bits & 0x0f0f0f0f0f0f0f0fULL) << 4);
+            bits = ((bits >> 8) & 0x00ff00ff00ff00ffULL) | ((bits & 0x00ff00ff00ff00ffULL) << 8);
+            bits = ((bits >> 16) & 0x0000ffff0000ffffULL) | ((bits & 0x0000ffff0000ffffULL) << 16);
+            return (bits >> 32) | (bits << 32);
+        }
+        static uint64_t cellKey(int position) {
+            // splitmix64 finalizer, so nearby cells get unrelated keys
+            uint64_t key = static_cast<uint64_t>(static_cast<int64_t>(position)) + 0x9e3779b97f4a7c15ULL;
+            key = (key ^ (key >> 30)) * 0xbf58476d1ce4e5b9ULL;
+            key = (key ^ (key >> 27)) * 0x94d049bb133111ebULL;
+            return key ^ (key >> 31);
+        }
+        static bool samePages(const std::vector<std::vector<uint64_t>>& a,
+                              const std::vector<std::vector<uint64_t>>& b) {
+            for (size_t i = 0; i < std::max(a.size(), b.size()); ++i) {
+                for (int word = 0; word < PAGE_WORDS; ++word) {
+                    uint64_t wordA = i < a.size() && !a[i].empty() ? a[i][word] : 0;
+                    uint64_t wordB = i < b.size() && !b[i].empty() ? b[i][word] : 0;
+                    if (wordA != wordB) {
+                        return false;
+                    }
+                }
+            }
+            return true;
+        }
     };
     
     bool registerValue;
@@ -68,28 +243,157 @@ private:
     TapeMemory tape1;
     TapeMemory tape2;
     
-    std::vector<std::string> instructions;
-    std::unordered_map<std::string, int> opcodeToNumber;
+    const LineHandler* selectedLine;
+    
+    RunStats stats;
+    StopReason lastStop = STOP_HALTED;
+    std::vector<uint8_t> breakpoints;    // Per PC
+    int breakpointCount = 0;
+    
+    // Basic blocks end at each SKZ (the only control flow) or at the end of
+    // the program. They are compiled lazily into fused micro-ops, one variant
+    // per (tape mode, first instruction skipped, data line selected on entry),
+    // so every operand inside a variant is already resolved.
+    enum MicroOpKind : uint8_t {
+        UOP_NOP,                // Instructions folded away entirely
+        UOP_NOT,
+        UOP_SET_REG,            // LD XOR [NOT...] on the same source
+        UOP_LD_MEM, UOP_LD_INPUT, UOP_LD_TAPE,
+        UOP_XOR_MEM, UOP_XOR_INPUT, UOP_XOR_TAPE,
+        UOP_AND_MEM, UOP_AND_INPUT, UOP_AND_TAPE,
+        UOP_OR_MEM, UOP_OR_INPUT, UOP_OR_TAPE,
+        UOP_OUT_MEM, UOP_OUT_OUTPUT,
+        UOP_OUT_TOGGLE,         // Toggle tape cell if register is high
+        UOP_OUT_MOVE,           // Move tape head if register is high
+        UOP_TOGGLE,             // Register known high: unconditional toggle
+        UOP_MOVE,               // Register known high: move head by delta
+        UOP_SELECT,
+        UOP_SKZ
+    };
+    
+    struct MicroOp {
+        MicroOpKind kind;
+        uint8_t arg;        // Data line, tape index or register value
+        int32_t delta;      // Head movement for UOP_OUT_MOVE / UOP_MOVE
+        uint32_t pc;        // First original instruction covered
+        uint32_t count;     // Original instructions covered
+    };
+    
+    struct CompiledBlock {
+        uint32_t firstOp = 0;
+        uint32_t opCount = 0;
+        uint32_t cycles = 0;   // Original instructions, including a skipped first one
+        bool compilable = true;
+    };
+    
+    bool fusionEnabled = true;
+    std::vector<int> blockAt;            // Block index for block-start PCs, -1 elsewhere
+    std::vector<uint32_t> blockStart;    // First PC of each block
+    std::vector<uint32_t> blockEnd;      // One past the last PC of each block
+    std::vector<int> variantIndex;       // Compiled variant per (block, tape, skip, entry line)
+    std::vector<CompiledBlock> variants;
+    std::vector<MicroOp> microOps;
+    
+    // Without the tape a pass is a pure function of the 13-bit state it starts
+    // from (register, DA1/DA2 memory, selected line, DA3-DA8 outputs, skip
+    // flag) while the inputs stay fixed, so each transfer is recorded once.
+    struct PassTransfer {
+        bool known = false;
+        uint16_t next = 0;      // Packed state at the end of the pass
+        uint32_t skipped = 0;   // Instructions skipped during the pass
+    };
+    
+    // With the tape a pass can only touch cells within windowReach of where
+    // each head started, so it is a pure function of the 13-bit state and the
+    // two tape windows. Each such macro-step is recorded once and replayed.
+    struct WindowKey {
+        uint32_t state;
+        uint64_t windows[2];
+        bool operator==(const WindowKey& other) const {
+            return state == other.state && windows[0] == other.windows[0] && windows[1] == other.windows[1];
+        }
+    };
+    struct WindowKeyHash {
+        size_t operator()(const WindowKey& key) const {
+            uint64_t hash = key.state * 0x9e3779b97f4a7c15ULL;
+            hash = (hash ^ key.windows[0]) * 0xbf58476d1ce4e5b9ULL;
+            hash = (hash ^ key.windows[1]) * 0x94d049bb133111ebULL;
+            return static_cast<size_t>(hash ^ (hash >> 31));
+        }
+    };
+    struct WindowStep {
+        uint16_t state;
+        uint64_t windows[2];    // Window contents after the pass, around the old heads
+        int32_t deltas[2];      // Head movement
+        uint32_t skipped;
+    };
+    static const size_t WINDOW_MEMO_LIMIT = 1 << 18;  // Entries before the memo starts over
+    
+    // Machine state at an earlier end of pass, for Brent's cycle detection
+    struct PassSnapshot {
+        bool valid = false;
+        uint32_t state = 0;
+        uint64_t passes = 0;
+        uint64_t cycles = 0;
+        uint64_t skipped = 0;
+        uint64_t power = 1;     // Passes until the snapshot moves forward
+        TapeMemory tapes[2];
+    };
+    
+    bool passCacheEnabled = true;
+    std::vector<PassTransfer> passMemo;  // Indexed by packed state, filled lazily
+    int pendingPass = -1;                // Packed state the running pass started from
+    uint64_t pendingSkipped = 0;
+    int windowReach[2] = {-1, -1};       // Furthest a head can move in one pass, -1 if too far
+    std::unordered_map<WindowKey, WindowStep, WindowKeyHash> windowMemo;
+    bool pendingWindow = false;          // The running pass is being recorded
+    WindowKey pendingKey;
+    int pendingHeads[2] = {0, 0};
+    PassSnapshot snapshot;
+    uint64_t loopPeriod = 0;
+    uint64_t loopCycles = 0;
+    
+    std::vector<std::string> instructions;  // Mnemonics, kept for display only
+    std::vector<uint8_t> program;           // Decoded opcodes (0 = unknown), indexed by PC
     
-    void initializeOpcodeMap();
-    bool executeInstruction(const std::string& instruction);
-    void updateOutput();
+    void decodeProgram();
+    void buildBlocks();
+    void computeWindowReach();
+    const CompiledBlock& blockVariant(int block, bool skipFirst);
+    CompiledBlock compileBlock(int block, bool skipFirst, int entryLine);
     
-    void executeXOR();
-    void executeSKZ();
-    void executeOR();
-    void executeLD();
-    void executeAND();
-    void executeOUT();
-    void executeNOT();
-    void executeDataSelect(int dataLineIndex);
+    // The run loops are instantiated per mode so the loop body never tests one
+    template <bool Tape, bool Trace> bool stepImpl();
+    template <bool Tape, bool Trace, bool Breakpoints> StopReason runLoop(uint64_t maxCycles, double maxSeconds);
+    template <bool Tape> StopReason runFused(uint64_t maxCycles, double maxSeconds);
+    template <bool Tape> void runBlock(const CompiledBlock& variant);
+    StopReason runUntilStop(bool trace, uint64_t maxCycles = 0, double maxSeconds = 0.0);
+    bool atBreakpoint() const;
+    uint32_t packPassState() const;
+    void unpackPassState(uint32_t state);
+    bool endOfPass(uint64_t cyclesLeft);
+    bool replayPass(uint64_t cyclesLeft);
+    bool replayWindowPass();
+    void invalidatePassCache();
     
-    // Memory and tape operations
-    bool readMemoryCell(int dataLineIndex);
-    void writeMemoryCell(int dataLineIndex, bool value);
-    void handleTapeOperation(int dataLineIndex, bool isWrite = false);
+    static bool readMemory(const Emulator& emulator, int line);
+    static bool readInput(const Emulator& emulator, int line);
+    static bool readTape1(const Emulator& emulator, int line);
+    static bool readTape2(const Emulator& emulator, int line);
+    static void loadMemory(Emulator& emulator, int line);
+    static void loadInput(Emulator& emulator, int line);
+    static void loadTape1(Emulator& emulator, int line);
+    static void loadTape2(Emulator& emulator, int line);
+    static void loadNothing(Emulator& emulator, int line);
+    static void outputMemory(Emulator& emulator, int line);
+    static void outputLine(Emulator& emulator, int line);
+    static void moveTape1Left(Emulator& emulator, int line);
+    static void moveTape1Right(Emulator& emulator, int line);
+    static void moveTape2Left(Emulator& emulator, int line);
+    static void moveTape2Right(Emulator& emulator, int line);
+    static void toggleTape1(Emulator& emulator, int line);
+    static void toggleTape2(Emulator& emulator, int line);
     
-    std::string getInstructionName(const std::string& instruction) const;
     void printDataLines() const;
     void printTapeState() const;
 };
\ No newline at end of file
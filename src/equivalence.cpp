@@ -0,0 +1,290 @@
+#include "equivalence.h"
+#include "batch_emulator.h"
+#include "isa.h"
+#include <algorithm>
+#include <chrono>
+#include <iomanip>
+#include <iostream>
+
+const int EquivalenceChecker::START_STATES;
+const int EquivalenceChecker::DEFAULT_TAPE_REACH;
+const int EquivalenceChecker::MAX_TAPE_REACH;
+const int EquivalenceChecker::TAPE_SHOWN;
+const size_t EquivalenceChecker::LANES_PER_TASK;
+const uint8_t EquivalenceChecker::HALTED;
+
+namespace {
+
+// Start states pack the register, both flags, the pending skip and the line
+uint8_t packStart(bool reg, bool skipFlag, bool haltFlag, bool skip, int selected) {
+    return static_cast<uint8_t>(reg | skipFlag << 1 | haltFlag << 2 | skip << 3 | selected << 4);
+}
+
+std::string lineBits(uint8_t bits) {
+    // DA3 first, as the sweep's truth tables show them
+    std::string text;
+    for (int line = 2; line < 8; ++line) {
+        text += ((bits >> line) & 1) ? '1' : '0';
+    }
+    return text;
+}
+
+}  // namespace
+
+EquivalenceChecker::EquivalenceChecker(const std::vector<uint8_t>& first, const std::vector<uint8_t>& second) {
+    programs[0] = first;
+    programs[1] = second;
+}
+
+void EquivalenceChecker::setTapeMode(bool enable, int reach) {
+    tapeMode = enable;
+    tapeReach = std::max(0, std::min(reach, MAX_TAPE_REACH));
+}
+
+uint8_t EquivalenceChecker::inputsOf(size_t index) const {
+    size_t bits = index >> extraBits;
+    uint8_t inputs = 0;
+    for (size_t k = 0; k < inputLines.size(); ++k) {
+        if ((bits >> k) & 1) {
+            inputs |= 1 << inputLines[k];
+        }
+    }
+    return inputs;
+}
+
+void EquivalenceChecker::setupLane(BatchEmulator& batch, int lane, size_t index) const {
+    int start = startOf(index);
+    batch.setRegisterValue(lane, start & 1);
+    batch.setMemoryValue(lane, 0, (start >> 1) & 1);
+    batch.setMemoryValue(lane, 1, (start >> 2) & 1);
+    batch.setSkipNext(lane, (start >> 3) & 1);
+    batch.setSelectedDataLine(lane, start >> 4);
+    uint8_t inputs = inputsOf(index);
+    for (int line = 2; line < 8; ++line) {
+        batch.setDataInput(lane, line, (inputs >> line) & 1);
+    }
+    size_t extra = index & ((size_t(1) << extraBits) - 1);
+    if (tapeMode) {
+        int cells = 2 * tapeReach + 1;
+        for (int tape = 0; tape < 2; ++tape) {
+            for (int cell = 0; cell < cells; ++cell) {
+                if ((extra >> (tape * cells + cell)) & 1) {
+                    batch.setTapeCell(lane, tape, cell - tapeReach, true);
+                }
+            }
+        }
+    } else if (extra) {
+        for (int line = 2; line < 8; ++line) {
+            batch.setDataOutput(lane, line, true);
+        }
+    }
+}
+
+EquivalenceChecker::Machine EquivalenceChecker::laneMachine(const BatchEmulator& batch, int lane) const {
+    Machine machine;
+    machine.reg = batch.getRegisterValue(lane);
+    machine.selected = batch.getSelectedDataLine(lane);
+    machine.memory[0] = batch.getMemoryValue(lane, 0);
+    machine.memory[1] = batch.getMemoryValue(lane, 1);
+    machine.skip = batch.getSkipNext(lane);
+    for (int line = 2; line < 8; ++line) {
+        machine.outputs |= batch.getDataOutput(lane, line) << line;
+    }
+    if (tapeMode) {
+        for (int tape = 0; tape < 2; ++tape) {
+            machine.heads[tape] = batch.getTapeHead(lane, tape);
+            for (int cell = -TAPE_SHOWN; cell <= TAPE_SHOWN; ++cell) {
+                machine.tapes[tape].push_back(batch.getTapeCell(lane, tape, cell));
+            }
+        }
+    }
+    return machine;
+}
+
+void EquivalenceChecker::runCases(size_t first, size_t count) {
+    // One pass of each program; a lane per case
+    BatchEmulator batchA(static_cast<int>(count));
+    BatchEmulator batchB(static_cast<int>(count));
+    BatchEmulator* batches[2] = {&batchA, &batchB};
+    for (int p = 0; p < 2; ++p) {
+        BatchEmulator& batch = *batches[p];
+        batch.loadProgram(programs[p]);
+        batch.enableTapeMode(tapeMode);
+        for (size_t lane = 0; lane < count; ++lane) {
+            setupLane(batch, static_cast<int>(lane), first + lane);
+        }
+        batch.run(programs[p].size());
+    }
+
+    std::vector<BatchEmulator::Word> differ;
+    batchA.diffLanes(batchB, differ);
+    for (size_t lane = 0; lane < count; ++lane) {
+        int l = static_cast<int>(lane);
+        size_t index = first + lane;
+        differs[index] = (differ[lane / BatchEmulator::LANES_PER_WORD] >> (lane % BatchEmulator::LANES_PER_WORD)) & 1;
+        // The HALT flag stops the machine at the end of the pass
+        bool halts = batchA.isHalted(l) || batchA.getMemoryValue(l, 1);
+        nextState[index] = halts ? HALTED
+                                 : packStart(batchA.getRegisterValue(l), batchA.getMemoryValue(l, 0), false,
+                                             batchA.getSkipNext(l), batchA.getSelectedDataLine(l));
+    }
+}
+
+bool EquivalenceChecker::check(ThreadPool& pool) {
+    auto started = std::chrono::steady_clock::now();
+    equivalent = false;
+    counterexample = Counterexample();
+    stats = Stats();
+    for (const std::vector<uint8_t>& program : programs) {
+        if (program.empty()) {
+            std::cerr << "Error: Cannot check an empty program" << std::endl;
+            return false;
+        }
+    }
+
+    // In tape mode the head lines read the tapes rather than inputs
+    inputLines.clear();
+    for (int line = 2; line < 8; ++line) {
+        if (!tapeMode || isa::INSTRUCTIONS[OP_DA1 + line].role != isa::ROLE_TAPE_HEAD) {
+            inputLines.push_back(line);
+        }
+    }
+    extraBits = tapeMode ? 2 * (2 * tapeReach + 1) : 1;
+    size_t cases = size_t(START_STATES) << (inputLines.size() + extraBits);
+    nextState.assign(cases, HALTED);
+    differs.assign(cases, 0);
+    for (size_t first = 0; first < cases; first += LANES_PER_TASK) {
+        size_t count = std::min(LANES_PER_TASK, cases - first);
+        pool.submit([this, first, count] { runCases(first, count); });
+    }
+    pool.wait();
+
+    // Start states in the order a breadth-first search from reset reaches
+    // them, so the first difference found takes the fewest passes
+    size_t perStart = cases / START_STATES;
+    std::vector<int> passes(START_STATES, -1);
+    std::vector<int> parent(START_STATES, -1);
+    std::vector<uint8_t> parentInputs(START_STATES, 0);
+    std::vector<int> order = {packStart(false, false, false, false, 0)};
+    passes[order[0]] = 0;
+    for (size_t next = 0; next < order.size(); ++next) {
+        int start = order[next];
+        for (size_t i = 0; i < perStart; ++i) {
+            size_t index = start * perStart + i;
+            uint8_t state = nextState[index];
+            if (state != HALTED && passes[state] < 0) {
+                passes[state] = passes[start] + 1;
+                parent[state] = start;
+                parentInputs[state] = inputsOf(index);
+                order.push_back(state);
+            }
+        }
+    }
+    if (allStates) {
+        for (int start = 0; start < START_STATES; ++start) {
+            if (passes[start] < 0) {
+                order.push_back(start);
+            }
+        }
+    }
+    stats.cases = cases;
+    stats.startStates = static_cast<int>(order.size());
+
+    equivalent = true;
+    for (int start : order) {
+        for (size_t i = 0; i < perStart && equivalent; ++i) {
+            size_t index = start * perStart + i;
+            if (!differs[index]) {
+                continue;
+            }
+            // Tape passes depend on more than the inputs, so only a normal
+            // mode path can be replayed
+            std::vector<uint8_t> path;
+            if (!tapeMode && passes[start] >= 0) {
+                for (int state = start; parent[state] >= 0; state = parent[state]) {
+                    path.insert(path.begin(), parentInputs[state]);
+                }
+            }
+            buildCounterexample(index, passes[start], path);
+            equivalent = false;
+        }
+        if (!equivalent) {
+            break;
+        }
+    }
+    stats.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - started).count();
+    return equivalent;
+}
+
+void EquivalenceChecker::buildCounterexample(size_t index, int passes, const std::vector<uint8_t>& path) {
+    counterexample.passes = passes;
+    counterexample.path = path;
+    counterexample.inputs = inputsOf(index);
+    for (int p = 0; p < 2; ++p) {
+        BatchEmulator batch(1);
+        batch.loadProgram(programs[p]);
+        batch.enableTapeMode(tapeMode);
+        setupLane(batch, 0, index);
+        if (p == 0) {
+            counterexample.start = laneMachine(batch, 0);
+        }
+        batch.run(programs[p].size());
+        (p == 0 ? counterexample.first : counterexample.second) = laneMachine(batch, 0);
+    }
+}
+
+void EquivalenceChecker::printMachine(std::ostream& out, const Machine& machine) const {
+    out << "REG=" << machine.reg << " SEL=DA" << (machine.selected + 1) << " DA1=" << machine.memory[0]
+        << " DA2=" << machine.memory[1] << " SKIP=" << machine.skip;
+    if (tapeMode) {
+        for (int tape = 0; tape < 2; ++tape) {
+            out << " TAPE" << (tape + 1) << "=";
+            for (bool cell : machine.tapes[tape]) {
+                out << cell;
+            }
+            out << "@" << machine.heads[tape];
+        }
+    } else {
+        out << " OUT=" << lineBits(machine.outputs);
+    }
+    out << std::endl;
+}
+
+void EquivalenceChecker::printReport(std::ostream& out) const {
+    out << "=== Equivalence Check ===" << std::endl;
+    if (tapeMode) {
+        out << "Mode: tape, every cell within " << tapeReach << " of each head" << std::endl;
+    } else {
+        out << "Mode: normal" << std::endl;
+    }
+    out << "Cases Per Program: " << stats.cases << std::endl;
+    out << "Start States: " << stats.startStates << (allStates ? " (all)" : " reachable from reset") << std::endl;
+    out << "Result: " << (equivalent ? "equivalent" : "DIFFERENT") << std::endl;
+    if (!equivalent && stats.cases > 0) {
+        const Counterexample& example = counterexample;
+        out << "Counterexample:" << std::endl;
+        if (example.passes < 0) {
+            out << "  Start state is never reached from reset" << std::endl;
+        } else {
+            out << "  Passes From Reset: " << example.passes << std::endl;
+        }
+        if (!example.path.empty()) {
+            out << "  Their Inputs (DA3-DA8):";
+            for (uint8_t inputs : example.path) {
+                out << " " << lineBits(inputs);
+            }
+            out << std::endl;
+        }
+        out << "  Start:  ";
+        printMachine(out, example.start);
+        out << "  Inputs: DA3-DA8=" << lineBits(example.inputs) << std::endl;
+        out << "  First:  ";
+        printMachine(out, example.first);
+        out << "  Second: ";
+        printMachine(out, example.second);
+        if (tapeMode) {
+            out << "  (Tapes show cells " << -TAPE_SHOWN << " to " << TAPE_SHOWN << " @ head position)" << std::endl;
+        }
+    }
+    out << "Time: " << std::fixed << std::setprecision(3) << stats.seconds << " s" << std::endl;
+}
@@ -0,0 +1,96 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <iosfwd>
+#include <vector>
+#include "thread_pool.h"
+
+class BatchEmulator;
+
+// Proves that two programs do the same thing pass for pass. A pass runs
+// from PC 0 to the end of the program, and all that carries into the next
+// one is the register, the selected line, the SKIP and HALT flags and a
+// skip left pending by a trailing SKZ: 128 start states. Both programs run
+// one pass on a BatchEmulator lane per start state, per combination of the
+// inputs they can read and, outside tape mode, with outputs starting all
+// low and all high. Every lane must end the same in both.
+//
+// Only start states reachable from reset have to match, as the optimizer
+// relies on what it knows of the reset state. Reachability follows the
+// first program's passes under every input, since inputs may change
+// between passes. Tape mode is checked up to a bound: each tape starts with
+// every combination of the cells within tapeReach of its head, blank beyond.
+class EquivalenceChecker {
+public:
+    static const int START_STATES = 128;
+    static const int DEFAULT_TAPE_REACH = 1;
+    static const int MAX_TAPE_REACH = 2;
+
+    // A machine between passes, as far as the report shows it
+    struct Machine {
+        bool reg = false;
+        int selected = 0;
+        bool memory[2] = {false, false};
+        bool skip = false;           // The first instruction of the next pass is skipped
+        uint8_t outputs = 0;         // Bit per data line, DA3-DA8
+        int heads[2] = {0, 0};
+        std::vector<bool> tapes[2];  // Cells -TAPE_SHOWN..TAPE_SHOWN
+    };
+
+    struct Counterexample {
+        int passes = 0;               // Passes from reset before the one that differs, -1 if unreachable
+        std::vector<uint8_t> path;    // Inputs of each of those passes (normal mode only)
+        Machine start;
+        uint8_t inputs = 0;           // Bit per data line during the pass that differs
+        Machine first;
+        Machine second;
+    };
+
+    struct Stats {
+        size_t cases = 0;             // Lanes per program
+        int startStates = 0;          // Start states held to matching
+        double seconds = 0.0;
+    };
+
+    EquivalenceChecker(const std::vector<uint8_t>& first, const std::vector<uint8_t>& second);
+
+    void setTapeMode(bool enable, int tapeReach = DEFAULT_TAPE_REACH);
+    // Also require start states that are never reached from reset to match
+    void setAllStates(bool enable) { allStates = enable; }
+
+    // True when the programs are equivalent; otherwise getCounterexample()
+    // holds a difference reached in as few passes as possible
+    bool check(ThreadPool& pool);
+    const Counterexample& getCounterexample() const { return counterexample; }
+    const Stats& getStats() const { return stats; }
+    void printReport(std::ostream& out) const;
+
+private:
+    static const int TAPE_SHOWN = 4;
+    static const size_t LANES_PER_TASK = 4096;
+    static const uint8_t HALTED = 0xff;
+
+    std::vector<uint8_t> programs[2];
+    bool tapeMode = false;
+    int tapeReach = DEFAULT_TAPE_REACH;
+    bool allStates = false;
+    bool equivalent = false;
+    Counterexample counterexample;
+    Stats stats;
+
+    // Cases are numbered start state, then inputs, then extra bits: the
+    // output level outside tape mode, the starting tape windows in it
+    std::vector<int> inputLines;
+    int extraBits = 0;
+    std::vector<uint8_t> nextState;  // Start of the next pass of the first program, or HALTED
+    std::vector<uint8_t> differs;
+
+    void runCases(size_t first, size_t count);
+    void setupLane(BatchEmulator& batch, int lane, size_t index) const;
+    Machine laneMachine(const BatchEmulator& batch, int lane) const;
+    int startOf(size_t index) const { return static_cast<int>(index >> (extraBits + inputLines.size())); }
+    uint8_t inputsOf(size_t index) const;
+    void buildCounterexample(size_t index, int passes, const std::vector<uint8_t>& path);
+    void printMachine(std::ostream& out, const Machine& machine) const;
+};
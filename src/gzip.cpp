@@ -0,0 +1,732 @@
+#include "gzip.h"
+#include <algorithm>
+#include <array>
+#include <queue>
+#include <vector>
+
+namespace gzip {
+
+namespace {
+
+constexpr std::array<uint32_t, 256> makeCrcTable() {
+    std::array<uint32_t, 256> table = {};
+    for (uint32_t n = 0; n < 256; ++n) {
+        uint32_t c = n;
+        for (int k = 0; k < 8; ++k) {
+            c = c & 1 ? 0xEDB88320u ^ (c >> 1) : c >> 1;
+        }
+        table[n] = c;
+    }
+    return table;
+}
+
+constexpr std::array<uint32_t, 256> CRC_TABLE = makeCrcTable();
+
+// Lengths 3-258 and distances 1-32768 as a base code plus extra bits
+const uint16_t LENGTH_BASE[29] = {3, 4, 5, 6, 7, 8, 9, 10, 11, 13, 15, 17, 19, 23, 27, 31,
+                                  35, 43, 51, 59, 67, 83, 99, 115, 131, 163, 195, 227, 258};
+const uint8_t LENGTH_EXTRA[29] = {0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 1, 1, 2, 2, 2, 2,
+                                  3, 3, 3, 3, 4, 4, 4, 4, 5, 5, 5, 5, 0};
+const uint16_t DISTANCE_BASE[30] = {1, 2, 3, 4, 5, 7, 9, 13, 17, 25, 33, 49, 65, 97, 129, 193,
+                                    257, 385, 513, 769, 1025, 1537, 2049, 3073, 4097, 6145,
+                                    8193, 12289, 16385, 24577};
+const uint8_t DISTANCE_EXTRA[30] = {0, 0, 0, 0, 1, 1, 2, 2, 3, 3, 4, 4, 5, 5, 6, 6,
+                                    7, 7, 8, 8, 9, 9, 10, 10, 11, 11, 12, 12, 13, 13};
+// Order the code length code lengths are sent in
+const uint8_t CODE_LENGTH_ORDER[19] = {16, 17, 18, 0, 8, 7, 9, 6, 10, 5, 11, 4, 12, 3, 13, 2, 14, 1, 15};
+
+const int LITERALS = 286;
+const int DISTANCES = 30;
+const int CODE_LENGTHS = 19;
+const int END_OF_BLOCK = 256;
+const int MAX_BITS = 15;
+
+const int WINDOW_SIZE = 1 << 15;
+const int MIN_MATCH = 3;
+const int MAX_MATCH = 258;
+const int HASH_BITS = 15;
+const int MAX_CHAIN = 128;
+const int NICE_MATCH = 128;  // Stop searching once a match is this long
+const int MAX_LAZY = 16;     // Only look one byte ahead for shorter matches
+const size_t BLOCK_SYMBOLS = 1 << 16;
+
+class BitWriter {
+public:
+    explicit BitWriter(std::string& out) : out(out) {}
+
+    // Bits go out least significant first
+    void put(uint32_t value, int count) {
+        bits |= static_cast<uint64_t>(value) << used;
+        used += count;
+        while (used >= 8) {
+            out += static_cast<char>(bits & 0xFF);
+            bits >>= 8;
+            used -= 8;
+        }
+    }
+    void flush() {
+        if (used > 0) {
+            out += static_cast<char>(bits & 0xFF);
+        }
+        bits = 0;
+        used = 0;
+    }
+
+private:
+    std::string& out;
+    uint64_t bits = 0;
+    int used = 0;
+};
+
+// Huffman code lengths of at most maxBits for the given frequencies. Over
+// long codes are rare, so they are fixed by flattening the frequencies and
+// building again.
+void buildLengths(const uint32_t* frequencies, int count, int maxBits, uint8_t* lengths) {
+    std::vector<uint32_t> weights(frequencies, frequencies + count);
+    while (true) {
+        std::fill(lengths, lengths + count, 0);
+        struct Node {
+            uint64_t weight;
+            int index;
+        };
+        auto heavier = [](const Node& a, const Node& b) {
+            return a.weight != b.weight ? a.weight > b.weight : a.index > b.index;
+        };
+        std::priority_queue<Node, std::vector<Node>, decltype(heavier)> queue(heavier);
+        std::vector<int> parent;
+        for (int i = 0; i < count; ++i) {
+            if (weights[i] > 0) {
+                queue.push(Node{weights[i], static_cast<int>(parent.size())});
+                parent.push_back(-1);
+            }
+        }
+        std::vector<int> leafSymbol;
+        for (int i = 0; i < count; ++i) {
+            if (weights[i] > 0) {
+                leafSymbol.push_back(i);
+            }
+        }
+        size_t leaves = leafSymbol.size();
+        if (leaves == 1) {
+            lengths[leafSymbol[0]] = 1;
+            return;
+        }
+        while (queue.size() > 1) {
+            Node a = queue.top();
+            queue.pop();
+            Node b = queue.top();
+            queue.pop();
+            int merged = static_cast<int>(parent.size());
+            parent.push_back(-1);
+            parent[a.index] = merged;
+            parent[b.index] = merged;
+            queue.push(Node{a.weight + b.weight, merged});
+        }
+        // Parents always come after their children, so depths fill in backwards
+        std::vector<int> depth(parent.size(), 0);
+        int longest = 0;
+        for (int node = static_cast<int>(parent.size()) - 2; node >= 0; --node) {
+            depth[node] = depth[parent[node]] + 1;
+        }
+        for (size_t leaf = 0; leaf < leaves; ++leaf) {
+            lengths[leafSymbol[leaf]] = static_cast<uint8_t>(std::min(depth[leaf], 255));
+            longest = std::max(longest, depth[leaf]);
+        }
+        if (longest <= maxBits) {
+            return;
+        }
+        for (uint32_t& weight : weights) {
+            if (weight > 0) {
+                weight = (weight + 1) / 2;
+            }
+        }
+    }
+}
+
+// Canonical codes for the lengths, bit-reversed for the LSB-first writer
+void buildCodes(const uint8_t* lengths, int count, uint16_t* codes) {
+    int lengthCount[MAX_BITS + 1] = {};
+    for (int i = 0; i < count; ++i) {
+        lengthCount[lengths[i]]++;
+    }
+    lengthCount[0] = 0;
+    int next[MAX_BITS + 2] = {};
+    int code = 0;
+    for (int bits = 1; bits <= MAX_BITS; ++bits) {
+        code = (code + lengthCount[bits - 1]) << 1;
+        next[bits] = code;
+    }
+    for (int i = 0; i < count; ++i) {
+        int length = lengths[i];
+        if (length == 0) {
+            codes[i] = 0;
+            continue;
+        }
+        int value = next[length]++;
+        int reversed = 0;
+        for (int bit = 0; bit < length; ++bit) {
+            reversed |= ((value >> bit) & 1) << (length - 1 - bit);
+        }
+        codes[i] = static_cast<uint16_t>(reversed);
+    }
+}
+
+// Inflate wants at least two codes in each tree; pad with unused symbols
+void ensureTwoCodes(uint32_t* frequencies, int count) {
+    int used = 0;
+    for (int i = 0; i < count; ++i) {
+        used += frequencies[i] > 0;
+    }
+    for (int i = 0; i < count && used < 2; ++i) {
+        if (frequencies[i] == 0) {
+            frequencies[i] = 1;
+            used++;
+        }
+    }
+}
+
+struct Symbol {
+    uint16_t literal;   // Literal byte, or match length when distance is set
+    uint16_t distance;  // 0 for a literal
+};
+
+int lengthCode(int length) {
+    int code = 28;
+    while (LENGTH_BASE[code] > length) {
+        --code;
+    }
+    return code;
+}
+
+int distanceCode(int distance) {
+    int code = 29;
+    while (DISTANCE_BASE[code] > distance) {
+        --code;
+    }
+    return code;
+}
+
+void writeBlock(BitWriter& writer, const std::vector<Symbol>& symbols, bool last) {
+    uint32_t literalFrequencies[LITERALS] = {};
+    uint32_t distanceFrequencies[DISTANCES] = {};
+    for (const Symbol& symbol : symbols) {
+        if (symbol.distance == 0) {
+            literalFrequencies[symbol.literal]++;
+        } else {
+            literalFrequencies[257 + lengthCode(symbol.literal)]++;
+            distanceFrequencies[distanceCode(symbol.distance)]++;
+        }
+    }
+    literalFrequencies[END_OF_BLOCK] = 1;
+    ensureTwoCodes(literalFrequencies, LITERALS);
+    ensureTwoCodes(distanceFrequencies, DISTANCES);
+
+    uint8_t literalLengths[LITERALS];
+    uint8_t distanceLengths[DISTANCES];
+    uint16_t literalCodes[LITERALS];
+    uint16_t distanceCodes[DISTANCES];
+    buildLengths(literalFrequencies, LITERALS, MAX_BITS, literalLengths);
+    buildLengths(distanceFrequencies, DISTANCES, MAX_BITS, distanceLengths);
+    buildCodes(literalLengths, LITERALS, literalCodes);
+    buildCodes(distanceLengths, DISTANCES, distanceCodes);
+
+    int literalCount = LITERALS;
+    while (literalCount > 257 && literalLengths[literalCount - 1] == 0) {
+        --literalCount;
+    }
+    int distanceCount = DISTANCES;
+    while (distanceCount > 1 && distanceLengths[distanceCount - 1] == 0) {
+        --distanceCount;
+    }
+
+    // Both length tables are sent as one run-length coded sequence
+    std::vector<uint8_t> all(literalLengths, literalLengths + literalCount);
+    all.insert(all.end(), distanceLengths, distanceLengths + distanceCount);
+    struct Run {
+        uint8_t symbol;
+        uint8_t extra;
+    };
+    std::vector<Run> runs;
+    for (size_t i = 0; i < all.size();) {
+        size_t end = i;
+        while (end < all.size() && all[end] == all[i]) {
+            ++end;
+        }
+        size_t run = end - i;
+        if (all[i] == 0) {
+            while (run >= 11) {
+                size_t take = std::min<size_t>(run, 138);
+                runs.push_back(Run{18, static_cast<uint8_t>(take - 11)});
+                run -= take;
+            }
+            if (run >= 3) {
+                runs.push_back(Run{17, static_cast<uint8_t>(run - 3)});
+                run = 0;
+            }
+        } else {
+            runs.push_back(Run{all[i], 0});
+            run--;
+            while (run >= 3) {
+                size_t take = std::min<size_t>(run, 6);
+                runs.push_back(Run{16, static_cast<uint8_t>(take - 3)});
+                run -= take;
+            }
+        }
+        while (run > 0) {
+            runs.push_back(Run{all[i], 0});
+            run--;
+        }
+        i = end;
+    }
+
+    uint32_t codeLengthFrequencies[CODE_LENGTHS] = {};
+    for (const Run& run : runs) {
+        codeLengthFrequencies[run.symbol]++;
+    }
+    ensureTwoCodes(codeLengthFrequencies, CODE_LENGTHS);
+    uint8_t codeLengthLengths[CODE_LENGTHS];
+    uint16_t codeLengthCodes[CODE_LENGTHS];
+    buildLengths(codeLengthFrequencies, CODE_LENGTHS, 7, codeLengthLengths);
+    buildCodes(codeLengthLengths, CODE_LENGTHS, codeLengthCodes);
+    int codeLengthCount = CODE_LENGTHS;
+    while (codeLengthCount > 4 && codeLengthLengths[CODE_LENGTH_ORDER[codeLengthCount - 1]] == 0) {
+        --codeLengthCount;
+    }
+
+    writer.put(last ? 1 : 0, 1);
+    writer.put(2, 2);  // Dynamic Huffman
+    writer.put(literalCount - 257, 5);
+    writer.put(distanceCount - 1, 5);
+    writer.put(codeLengthCount - 4, 4);
+    for (int i = 0; i < codeLengthCount; ++i) {
+        writer.put(codeLengthLengths[CODE_LENGTH_ORDER[i]], 3);
+    }
+    for (const Run& run : runs) {
+        writer.put(codeLengthCodes[run.symbol], codeLengthLengths[run.symbol]);
+        if (run.symbol == 16) {
+            writer.put(run.extra, 2);
+        } else if (run.symbol == 17) {
+            writer.put(run.extra, 3);
+        } else if (run.symbol == 18) {
+            writer.put(run.extra, 7);
+        }
+    }
+
+    for (const Symbol& symbol : symbols) {
+        if (symbol.distance == 0) {
+            writer.put(literalCodes[symbol.literal], literalLengths[symbol.literal]);
+            continue;
+        }
+        int length = lengthCode(symbol.literal);
+        writer.put(literalCodes[257 + length], literalLengths[257 + length]);
+        writer.put(symbol.literal - LENGTH_BASE[length], LENGTH_EXTRA[length]);
+        int distance = distanceCode(symbol.distance);
+        writer.put(distanceCodes[distance], distanceLengths[distance]);
+        writer.put(symbol.distance - DISTANCE_BASE[distance], DISTANCE_EXTRA[distance]);
+    }
+    writer.put(literalCodes[END_OF_BLOCK], literalLengths[END_OF_BLOCK]);
+}
+
+uint32_t hashAt(const unsigned char* p) {
+    return ((p[0] << 10) ^ (p[1] << 5) ^ p[2]) & ((1 << HASH_BITS) - 1);
+}
+
+class BitReader {
+public:
+    explicit BitReader(std::string_view data) : data(data) {}
+
+    bool get(int count, uint32_t& value) {
+        value = 0;
+        for (int i = 0; i < count; ++i) {
+            if (position >= data.size()) {
+                return false;
+            }
+            value |= static_cast<uint32_t>((static_cast<unsigned char>(data[position]) >> bit) & 1) << i;
+            if (++bit == 8) {
+                bit = 0;
+                ++position;
+            }
+        }
+        return true;
+    }
+    void alignToByte() {
+        if (bit != 0) {
+            bit = 0;
+            ++position;
+        }
+    }
+    size_t bytePosition() const { return position; }
+    void skipBytes(size_t count) { position += count; }
+
+private:
+    std::string_view data;
+    size_t position = 0;
+    int bit = 0;
+};
+
+// Canonical Huffman decoding table: symbols sorted by code length
+struct Decoder {
+    int count[MAX_BITS + 1] = {};
+    std::vector<int> symbols;
+
+    bool build(const uint8_t* lengths, int n) {
+        std::fill(count, count + MAX_BITS + 1, 0);
+        for (int i = 0; i < n; ++i) {
+            count[lengths[i]]++;
+        }
+        count[0] = 0;
+        int offsets[MAX_BITS + 2] = {};
+        for (int bits = 1; bits <= MAX_BITS; ++bits) {
+            offsets[bits + 1] = offsets[bits] + count[bits];
+        }
+        symbols.assign(n, 0);
+        for (int i = 0; i < n; ++i) {
+            if (lengths[i] != 0) {
+                symbols[offsets[lengths[i]]++] = i;
+            }
+        }
+        return true;
+    }
+
+    bool decode(BitReader& reader, int& symbol) const {
+        int code = 0;
+        int first = 0;
+        int index = 0;
+        for (int bits = 1; bits <= MAX_BITS; ++bits) {
+            uint32_t bit;
+            if (!reader.get(1, bit)) {
+                return false;
+            }
+            code |= static_cast<int>(bit);
+            int countHere = count[bits];
+            if (code - countHere < first) {
+                symbol = symbols[index + (code - first)];
+                return true;
+            }
+            index += countHere;
+            first = (first + countHere) << 1;
+            code <<= 1;
+        }
+        return false;
+    }
+};
+
+bool inflateBlock(BitReader& reader, const Decoder& literals, const Decoder& distances, std::string& out) {
+    while (true) {
+        int symbol;
+        if (!literals.decode(reader, symbol)) {
+            return false;
+        }
+        if (symbol < 256) {
+            out += static_cast<char>(symbol);
+            continue;
+        }
+        if (symbol == END_OF_BLOCK) {
+            return true;
+        }
+        symbol -= 257;
+        if (symbol >= 29) {
+            return false;
+        }
+        uint32_t extra;
+        if (!reader.get(LENGTH_EXTRA[symbol], extra)) {
+            return false;
+        }
+        size_t length = LENGTH_BASE[symbol] + extra;
+        int distanceSymbol;
+        if (!distances.decode(reader, distanceSymbol) || distanceSymbol >= 30 ||
+            !reader.get(DISTANCE_EXTRA[distanceSymbol], extra)) {
+            return false;
+        }
+        size_t distance = DISTANCE_BASE[distanceSymbol] + extra;
+        if (distance > out.size()) {
+            return false;
+        }
+        // Byte by byte, since a match may overlap what it copies
+        size_t from = out.size() - distance;
+        for (size_t i = 0; i < length; ++i) {
+            out += out[from + i];
+        }
+    }
+}
+
+bool inflateStream(std::string_view data, std::string& out, size_t& consumed) {
+    BitReader reader(data);
+    uint32_t last = 0;
+    while (!last) {
+        uint32_t type;
+        if (!reader.get(1, last) || !reader.get(2, type)) {
+            return false;
+        }
+        if (type == 0) {
+            reader.alignToByte();
+            size_t at = reader.bytePosition();
+            if (at + 4 > data.size()) {
+                return false;
+            }
+            size_t length = static_cast<unsigned char>(data[at]) | static_cast<unsigned char>(data[at + 1]) << 8;
+            if (at + 4 + length > data.size()) {
+                return false;
+            }
+            out.append(data.substr(at + 4, length));
+            reader.skipBytes(4 + length);
+            continue;
+        }
+        uint8_t lengths[LITERALS + DISTANCES] = {};
+        int literalCount = 288;
+        int distanceCount = 30;
+        if (type == 1) {
+            // Fixed codes
+            uint8_t fixed[288 + 30];
+            std::fill(fixed, fixed + 144, 8);
+            std::fill(fixed + 144, fixed + 256, 9);
+            std::fill(fixed + 256, fixed + 280, 7);
+            std::fill(fixed + 280, fixed + 288, 8);
+            std::fill(fixed + 288, fixed + 318, 5);
+            Decoder literals;
+            Decoder distances;
+            literals.build(fixed, 288);
+            distances.build(fixed + 288, 30);
+            if (!inflateBlock(reader, literals, distances, out)) {
+                return false;
+            }
+            continue;
+        }
+        if (type != 2) {
+            return false;
+        }
+        uint32_t hlit, hdist, hclen;
+        if (!reader.get(5, hlit) || !reader.get(5, hdist) || !reader.get(4, hclen)) {
+            return false;
+        }
+        literalCount = static_cast<int>(hlit) + 257;
+        distanceCount = static_cast<int>(hdist) + 1;
+        if (literalCount > LITERALS || distanceCount > DISTANCES) {
+            return false;
+        }
+        uint8_t codeLengthLengths[CODE_LENGTHS] = {};
+        for (uint32_t i = 0; i < hclen + 4; ++i) {
+            uint32_t length;
+            if (!reader.get(3, length)) {
+                return false;
+            }
+            codeLengthLengths[CODE_LENGTH_ORDER[i]] = static_cast<uint8_t>(length);
+        }
+        Decoder codeLengths;
+        codeLengths.build(codeLengthLengths, CODE_LENGTHS);
+        for (int i = 0; i < literalCount + distanceCount;) {
+            int symbol;
+            if (!codeLengths.decode(reader, symbol)) {
+                return false;
+            }
+            if (symbol < 16) {
+                lengths[i++] = static_cast<uint8_t>(symbol);
+                continue;
+            }
+            uint32_t repeat;
+            uint8_t value = 0;
+            if (symbol == 16) {
+                if (i == 0 || !reader.get(2, repeat)) {
+                    return false;
+                }
+                value = lengths[i - 1];
+                repeat += 3;
+            } else if (symbol == 17) {
+                if (!reader.get(3, repeat)) {
+                    return false;
+                }
+                repeat += 3;
+            } else {
+                if (!reader.get(7, repeat)) {
+                    return false;
+                }
+                repeat += 11;
+            }
+            if (i + static_cast<int>(repeat) > literalCount + distanceCount) {
+                return false;
+            }
+            std::fill(lengths + i, lengths + i + repeat, value);
+            i += static_cast<int>(repeat);
+        }
+        Decoder literals;
+        Decoder distances;
+        literals.build(lengths, literalCount);
+        distances.build(lengths + literalCount, distanceCount);
+        if (!inflateBlock(reader, literals, distances, out)) {
+            return false;
+        }
+    }
+    reader.alignToByte();
+    consumed = reader.bytePosition();
+    return true;
+}
+
+void putLittleEndian32(std::string& out, uint32_t value) {
+    for (int i = 0; i < 4; ++i) {
+        out += static_cast<char>((value >> (8 * i)) & 0xFF);
+    }
+}
+
+uint32_t getLittleEndian32(std::string_view data, size_t at) {
+    uint32_t value = 0;
+    for (int i = 0; i < 4; ++i) {
+        value |= static_cast<uint32_t>(static_cast<unsigned char>(data[at + i])) << (8 * i);
+    }
+    return value;
+}
+
+}  // namespace
+
+uint32_t crc32(std::string_view data, uint32_t crc) {
+    crc = ~crc;
+    for (char c : data) {
+        crc = CRC_TABLE[(crc ^ static_cast<unsigned char>(c)) & 0xFF] ^ (crc >> 8);
+    }
+    return ~crc;
+}
+
+std::string deflate(std::string_view data) {
+    std::string out;
+    BitWriter writer(out);
+    const unsigned char* bytes = reinterpret_cast<const unsigned char*>(data.data());
+    size_t size = data.size();
+
+    // Hash chains over the last 32 KiB: head holds the latest position of
+    // each 3-byte hash, previous links back to earlier ones
+    std::vector<int64_t> head(static_cast<size_t>(1) << HASH_BITS, -1);
+    std::vector<int64_t> previous(WINDOW_SIZE, -1);
+    auto insert = [&](size_t position) {
+        if (position + MIN_MATCH <= size) {
+            uint32_t hash = hashAt(bytes + position);
+            previous[position & (WINDOW_SIZE - 1)] = head[hash];
+            head[hash] = static_cast<int64_t>(position);
+        }
+    };
+    auto longestMatch = [&](size_t position, int& bestDistance) {
+        int bestLength = 0;
+        if (position + MIN_MATCH > size) {
+            return 0;
+        }
+        int limit = static_cast<int>(std::min<size_t>(MAX_MATCH, size - position));
+        int64_t candidate = head[hashAt(bytes + position)];
+        for (int chain = 0; chain < MAX_CHAIN && candidate >= 0; ++chain) {
+            size_t distance = position - static_cast<size_t>(candidate);
+            if (distance == 0 || distance > WINDOW_SIZE) {
+                break;
+            }
+            const unsigned char* a = bytes + candidate;
+            const unsigned char* b = bytes + position;
+            if (a[bestLength] == b[bestLength]) {
+                int length = 0;
+                while (length < limit && a[length] == b[length]) {
+                    ++length;
+                }
+                if (length > bestLength) {
+                    bestLength = length;
+                    bestDistance = static_cast<int>(distance);
+                    if (length >= std::min(limit, NICE_MATCH)) {
+                        break;
+                    }
+                }
+            }
+            int64_t next = previous[static_cast<size_t>(candidate) & (WINDOW_SIZE - 1)];
+            if (next >= candidate) {
+                break;  // Slot reused by a newer position
+            }
+            candidate = next;
+        }
+        return bestLength >= MIN_MATCH ? bestLength : 0;
+    };
+
+    std::vector<Symbol> symbols;
+    symbols.reserve(BLOCK_SYMBOLS);
+    size_t position = 0;
+    while (position < size) {
+        // Searched before this position joins the chains, so no match is
+        // ever against itself
+        int distance = 0;
+        int length = longestMatch(position, distance);
+        insert(position);
+        if (length > 0 && length < MAX_LAZY && position + 1 < size) {
+            // Lazy matching: a longer match one byte on wins over this one
+            int nextDistance = 0;
+            if (longestMatch(position + 1, nextDistance) > length) {
+                length = 0;
+            }
+        }
+        if (length == 0) {
+            symbols.push_back(Symbol{bytes[position], 0});
+            ++position;
+        } else {
+            symbols.push_back(Symbol{static_cast<uint16_t>(length), static_cast<uint16_t>(distance)});
+            for (int i = 1; i < length; ++i) {
+                insert(position + i);
+            }
+            position += length;
+        }
+        if (symbols.size() >= BLOCK_SYMBOLS) {
+            writeBlock(writer, symbols, false);
+            symbols.clear();
+        }
+    }
+    writeBlock(writer, symbols, true);
+    writer.flush();
+    return out;
+}
+
+bool inflate(std::string_view data, std::string& out) {
+    size_t consumed = 0;
+    return inflateStream(data, out, consumed);
+}
+
+std::string compress(std::string_view data) {
+    // Fixed header: deflate, no flags, no timestamp, unknown OS
+    std::string out("\x1f\x8b\x08\x00\x00\x00\x00\x00\x00\xff", 10);
+    out += deflate(data);
+    putLittleEndian32(out, crc32(data));
+    putLittleEndian32(out, static_cast<uint32_t>(data.size()));
+    return out;
+}
+
+bool decompress(std::string_view data, std::string& out) {
+    const size_t HEADER = 10;
+    if (data.size() < HEADER + 8 || static_cast<unsigned char>(data[0]) != 0x1f ||
+        static_cast<unsigned char>(data[1]) != 0x8b || data[2] != 8) {
+        return false;
+    }
+    // Optional fields: extra, name, comment, header CRC
+    unsigned char flags = static_cast<unsigned char>(data[3]);
+    size_t at = HEADER;
+    if (flags & 4) {
+        if (at + 2 > data.size()) {
+            return false;
+        }
+        at += 2 + (static_cast<unsigned char>(data[at]) | static_cast<unsigned char>(data[at + 1]) << 8);
+    }
+    for (int field = 8; field <= 16; field <<= 1) {
+        if (flags & field) {
+            at = data.find('\0', at);
+            if (at == std::string_view::npos) {
+                return false;
+            }
+            ++at;
+        }
+    }
+    if (flags & 2) {
+        at += 2;
+    }
+    if (at > data.size()) {
+        return false;
+    }
+    size_t start = out.size();
+    size_t consumed = 0;
+    if (!inflateStream(data.substr(at), out, consumed) || at + consumed + 8 > data.size()) {
+        return false;
+    }
+    std::string_view inflated(out.data() + start, out.size() - start);
+    size_t trailer = at + consumed;
+    return getLittleEndian32(data, trailer) == crc32(inflated) &&
+           getLittleEndian32(data, trailer + 4) == static_cast<uint32_t>(inflated.size());
+}
+
+}  // namespace gzip
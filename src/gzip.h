@@ -0,0 +1,24 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <string_view>
+
+// Self-contained DEFLATE (RFC 1951) and gzip (RFC 1952), enough to write
+// the compressed NBT files Minecraft and Litematica load, and to read them
+// back. The compressor is LZ77 over a 32 KiB window with lazy matching and
+// a dynamic Huffman code per block.
+namespace gzip {
+
+uint32_t crc32(std::string_view data, uint32_t crc = 0);
+
+// Raw DEFLATE streams
+std::string deflate(std::string_view data);
+bool inflate(std::string_view data, std::string& out);
+
+// A single gzip member; decompress() checks the CRC and length trailer
+std::string compress(std::string_view data);
+bool decompress(std::string_view data, std::string& out);
+
+}  // namespace gzip
@@ -0,0 +1,103 @@
+#pragma once
+
+#include <cstdint>
+#include <string_view>
+
+// Opcodes numbered as the CPU decodes them; OP_NONE marks text that is not one
+enum Opcode : uint8_t {
+    OP_NONE = 0,
+    OP_NOT, OP_SKZ, OP_OR, OP_LD, OP_XOR, OP_OUT, OP_AND,
+    OP_DA1, OP_DA2, OP_DA3, OP_DA4, OP_DA5, OP_DA6, OP_DA7, OP_DA8,
+    OPCODE_COUNT
+};
+
+namespace isa {
+
+// What a data line does; lines 2-7 are plain inputs/outputs outside tape mode
+enum DataLineRole : uint8_t {
+    ROLE_NONE,        // Not a data line instruction
+    ROLE_SKIP_FLAG,   // DA1: memory bit tested by SKZ
+    ROLE_HALT_FLAG,   // DA2: memory bit that halts at the end of a pass
+    ROLE_TAPE_LEFT,   // DA3/DA6: move the tape head left
+    ROLE_TAPE_HEAD,   // DA4/DA7: read the cell under the head, toggle it on OUT
+    ROLE_TAPE_RIGHT   // DA5/DA8: move the tape head right
+};
+
+struct InstructionInfo {
+    const char* mnemonic;
+    Opcode opcode;
+    const char* disc;      // Music disc item ID, without the "music_disc_" prefix
+    DataLineRole role;
+    int8_t dataLine;       // 0-7 for DA1-DA8, -1 otherwise
+    int8_t tape;           // Tape driven in tape mode, -1 for none
+};
+
+// The instruction set, indexed by Opcode
+constexpr InstructionInfo INSTRUCTIONS[OPCODE_COUNT] = {
+    {"",    OP_NONE, "",          ROLE_NONE,       -1, -1},
+    {"NOT", OP_NOT,  "13",        ROLE_NONE,       -1, -1},
+    {"SKZ", OP_SKZ,  "cat",       ROLE_NONE,       -1, -1},
+    {"OR",  OP_OR,   "blocks",    ROLE_NONE,       -1, -1},
+    {"LD",  OP_LD,   "chirp",     ROLE_NONE,       -1, -1},
+    {"XOR", OP_XOR,  "far",       ROLE_NONE,       -1, -1},
+    {"OUT", OP_OUT,  "mall",      ROLE_NONE,       -1, -1},
+    {"AND", OP_AND,  "mellohi",   ROLE_NONE,       -1, -1},
+    {"DA1", OP_DA1,  "stal",      ROLE_SKIP_FLAG,   0, -1},
+    {"DA2", OP_DA2,  "strad",     ROLE_HALT_FLAG,   1, -1},
+    {"DA3", OP_DA3,  "ward",      ROLE_TAPE_LEFT,   2,  0},
+    {"DA4", OP_DA4,  "11",        ROLE_TAPE_HEAD,   3,  0},
+    {"DA5", OP_DA5,  "wait",      ROLE_TAPE_RIGHT,  4,  0},
+    {"DA6", OP_DA6,  "pigstep",   ROLE_TAPE_LEFT,   5,  1},
+    {"DA7", OP_DA7,  "otherside", ROLE_TAPE_HEAD,   6,  1},
+    {"DA8", OP_DA8,  "5",         ROLE_TAPE_RIGHT,  7,  1}
+};
+
+constexpr bool inOpcodeOrder() {
+    for (int i = 0; i < OPCODE_COUNT; ++i) {
+        if (INSTRUCTIONS[i].opcode != i) {
+            return false;
+        }
+    }
+    return true;
+}
+static_assert(inOpcodeOrder(), "INSTRUCTIONS must be indexed by Opcode");
+
+constexpr const char* mnemonic(Opcode opcode) { return INSTRUCTIONS[opcode].mnemonic; }
+constexpr const char* discName(Opcode opcode) { return INSTRUCTIONS[opcode].disc; }
+constexpr bool isDataLine(Opcode opcode) { return opcode >= OP_DA1 && opcode <= OP_DA8; }
+
+// Mnemonic lookup through a perfect hash: the first and last characters
+// already tell every mnemonic apart, so one probe and one compare suffice
+constexpr int MNEMONIC_SLOTS = 32;
+
+constexpr int mnemonicSlot(std::string_view text) {
+    return (static_cast<unsigned char>(text.front()) + static_cast<unsigned char>(text.back())) % MNEMONIC_SLOTS;
+}
+
+struct MnemonicTable {
+    Opcode slots[MNEMONIC_SLOTS] = {};
+    bool perfect = true;
+};
+
+constexpr MnemonicTable buildMnemonicTable() {
+    MnemonicTable table;
+    for (int i = OP_NOT; i < OPCODE_COUNT; ++i) {
+        int slot = mnemonicSlot(INSTRUCTIONS[i].mnemonic);
+        table.perfect = table.perfect && table.slots[slot] == OP_NONE;
+        table.slots[slot] = static_cast<Opcode>(i);
+    }
+    return table;
+}
+
+constexpr MnemonicTable MNEMONIC_TABLE = buildMnemonicTable();
+static_assert(MNEMONIC_TABLE.perfect, "mnemonic hash has collisions; change mnemonicSlot()");
+
+constexpr Opcode findOpcode(std::string_view text) {
+    if (text.empty()) {
+        return OP_NONE;
+    }
+    Opcode opcode = MNEMONIC_TABLE.slots[mnemonicSlot(text)];
+    return opcode != OP_NONE && text == INSTRUCTIONS[opcode].mnemonic ? opcode : OP_NONE;
+}
+
+}  // namespace isa
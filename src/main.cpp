@@ -4,16 +4,44 @@
 #include <unordered_map>
 #include <vector>
 #include "assembler.h"
+#include "cli_args.h"
 #include "emulator.h"
+#include "equivalence.h"
+#include "sweep.h"
+#include "thread_pool.h"
 
 void printUsage(const char* programName) {
     std::cout << "Usage: " << programName << " [options] <input_file.asm>" << std::endl;
     std::cout << "Options:" << std::endl;
     std::cout << "  -e, --emulate         Run in emulator mode" << std::endl;
+    std::cout << "  -H, --headless        Run in emulator mode with no per-step output" << std::endl;
+    std::cout << "  -c, --cycles <n>      Stop headless run after n cycles" << std::endl;
+    std::cout << "  -T, --time <seconds>  Stop headless run after a wall-clock limit" << std::endl;
+    std::cout << "  --no-fusion           Run headless mode one instruction at a time (no fused blocks)" << std::endl;
+    std::cout << "  --no-pass-cache       Simulate every pass instead of replaying and skipping repeats" << std::endl;
+    std::cout << "  -S, --sweep           Run over every DA3-DA8 input combination and print a truth table" << std::endl;
+    std::cout << "  --tapes <file>        Sweep each initial tape case in file (\"[start:]bits [start:]bits\" per line)" << std::endl;
+    std::cout << "  --check <file>        Prove the program does the same as file, pass for pass (file gets -O if given)" << std::endl;
+    std::cout << "  --tape-reach <n>      With --check -t, try every tape cell within n of each head (default: 1, max 2)" << std::endl;
+    std::cout << "  --all-states          With --check, also compare start states never reached from reset" << std::endl;
+    std::cout << "  -j, --jobs <n>        Worker threads for sweeps, checks and assembling (default: all cores)" << std::endl;
     std::cout << "  -i, --interactive     Run in interactive emulator mode" << std::endl;
+    std::cout << "  -b, --break <pc>      Stop at a breakpoint PC (may be repeated)" << std::endl;
     std::cout << "  -t, --turing          Enable Turing Complete mode (with tape memory)" << std::endl;
     std::cout << "  -o, --output <file>   Specify output file (default: output.txt)" << std::endl;
     std::cout << "  -m, --minecraft       Output as minecraft commands (default: numeric)" << std::endl;
+    std::cout << "  -p, --packed          Output as a packed binary program image (4 bits per instruction)" << std::endl;
+    std::cout << "  -n, --nbt             Output as a gzipped NBT structure: double chests of shulker boxes of discs" << std::endl;
+    std::cout << "  --litematic <file>    Also write the chests as a Litematica schematic" << std::endl;
+    std::cout << "  -O, --optimize        Remove redundant and dead instructions after expanding macros" << std::endl;
+    std::cout << "  --rewrites <file>     Also apply a rewrite table from the superopt tool (implies -O)" << std::endl;
+    std::cout << "  --macro-stats         Print macro expansion cache statistics after assembling" << std::endl;
+    std::cout << "  --stream              Expand macros while writing output instead of assembling first" << std::endl;
+    std::cout << "  -v, --verbose         Report the assembler's progress through its passes" << std::endl;
+    std::cout << "  --trace-expansion     Report every line as macros are expanded (slow on large programs)" << std::endl;
+    std::cout << "  --max-instructions <n> Refuse programs that expand to more than n instructions" << std::endl;
+    std::cout << "  --max-memory <MB>     Refuse programs whose expansion would not fit in MB megabytes" << std::endl;
+    std::cout << "                        (default: physical memory)" << std::endl;
     std::cout << "  -h, --help            Show this help message" << std::endl;
     std::cout << std::endl;
     std::cout << "Default behavior: Assemble to numeric format in output.txt" << std::endl;
@@ -29,7 +57,27 @@ int main(int argc, char* argv[]) {
     std::string outputFile = "output.txt";
     bool emulatorMode = false;
     bool interactiveMode = false;
-    bool minecraftFormat = false;
+    bool headlessMode = false;
+    uint64_t maxCycles = 0;
+    double maxSeconds = 0.0;
+    bool fusion = true;
+    bool passCache = true;
+    bool sweepMode = false;
+    std::string tapeCaseFile;
+    std::string checkFile;
+    int tapeReach = EquivalenceChecker::DEFAULT_TAPE_REACH;
+    bool allStates = false;
+    unsigned jobs = 0;
+    std::vector<int> breakpoints;
+    OutputFormat outputFormat = FORMAT_NUMERIC;
+    std::string litematicFile;
+    bool macroStats = false;
+    bool optimize = false;
+    std::string rewriteFile;
+    bool streamOutput = false;
+    Severity verbosity = SEVERITY_WARNING;
+    uint64_t maxInstructions = 0;
+    uint64_t maxMemoryMB = 0;
     bool turingMode = false;
 
     // Parse command line arguments
@@ -37,6 +85,83 @@ int main(int argc, char* argv[]) {
         std::string arg = argv[i];
         if (arg == "-e" || arg == "--emulate") {
             emulatorMode = true;
+        } else if (arg == "-H" || arg == "--headless") {
+            emulatorMode = true;
+            headlessMode = true;
+        } else if (arg == "-c" || arg == "--cycles") {
+            uint64_t cycles = 0;
+            if (i + 1 < argc && parseCount(argv[++i], UINT64_MAX, cycles)) {
+                maxCycles = cycles;
+            } else {
+                std::cerr << "Error: -c/--cycles requires a cycle count" << std::endl;
+                printUsage(argv[0]);
+                return 1;
+            }
+        } else if (arg == "-T" || arg == "--time") {
+            double seconds = 0.0;
+            if (i + 1 < argc && parseSeconds(argv[++i], seconds)) {
+                maxSeconds = seconds;
+            } else {
+                std::cerr << "Error: -T/--time requires a number of seconds" << std::endl;
+                printUsage(argv[0]);
+                return 1;
+            }
+        } else if (arg == "--no-fusion") {
+            fusion = false;
+        } else if (arg == "--no-pass-cache") {
+            passCache = false;
+        } else if (arg == "-S" || arg == "--sweep") {
+            emulatorMode = true;
+            sweepMode = true;
+        } else if (arg == "--tapes") {
+            if (i + 1 < argc) {
+                tapeCaseFile = argv[++i];
+            } else {
+                std::cerr << "Error: --tapes requires a filename" << std::endl;
+                printUsage(argv[0]);
+                return 1;
+            }
+        } else if (arg == "--check") {
+            if (i + 1 < argc) {
+                checkFile = argv[++i];
+            } else {
+                std::cerr << "Error: --check requires a filename" << std::endl;
+                printUsage(argv[0]);
+                return 1;
+            }
+        } else if (arg == "--tape-reach") {
+            uint64_t reach = 0;
+            if (i + 1 < argc && parseCount(argv[++i], INT32_MAX, reach)) {
+                tapeReach = static_cast<int>(reach);
+            } else {
+                std::cerr << "Error: --tape-reach requires a cell count" << std::endl;
+                printUsage(argv[0]);
+                return 1;
+            }
+            if (tapeReach < 0 || tapeReach > EquivalenceChecker::MAX_TAPE_REACH) {
+                std::cerr << "Error: --tape-reach must be between 0 and " << EquivalenceChecker::MAX_TAPE_REACH << std::endl;
+                return 1;
+            }
+        } else if (arg == "--all-states") {
+            allStates = true;
+        } else if (arg == "-j" || arg == "--jobs") {
+            uint64_t threads = 0;
+            if (i + 1 < argc && parseCount(argv[++i], UINT32_MAX, threads)) {
+                jobs = static_cast<unsigned>(threads);
+            } else {
+                std::cerr << "Error: -j/--jobs requires a thread count" << std::endl;
+                printUsage(argv[0]);
+                return 1;
+            }
+        } else if (arg == "-b" || arg == "--break") {
+            uint64_t pc = 0;
+            if (i + 1 < argc && parseCount(argv[++i], INT32_MAX, pc)) {
+                breakpoints.push_back(static_cast<int>(pc));
+            } else {
+                std::cerr << "Error: -b/--break requires a PC" << std::endl;
+                printUsage(argv[0]);
+                return 1;
+            }
         } else if (arg == "-i" || arg == "--interactive") {
             emulatorMode = true;
             interactiveMode = true;
@@ -51,7 +176,51 @@ int main(int argc, char* argv[]) {
                 return 1;
             }
         } else if (arg == "-m" || arg == "--minecraft") {
-            minecraftFormat = true;
+            outputFormat = FORMAT_COMMANDS;
+        } else if (arg == "-p" || arg == "--packed") {
+            outputFormat = FORMAT_PACKED;
+        } else if (arg == "-n" || arg == "--nbt") {
+            outputFormat = FORMAT_STRUCTURE;
+        } else if (arg == "--litematic") {
+            if (i + 1 < argc) {
+                litematicFile = argv[++i];
+            } else {
+                std::cerr << "Error: --litematic requires a file name" << std::endl;
+                printUsage(argv[0]);
+                return 1;
+            }
+        } else if (arg == "-O" || arg == "--optimize") {
+            optimize = true;
+        } else if (arg == "--rewrites") {
+            if (i + 1 < argc) {
+                rewriteFile = argv[++i];
+                optimize = true;
+            } else {
+                std::cerr << "Error: --rewrites requires a filename" << std::endl;
+                printUsage(argv[0]);
+                return 1;
+            }
+        } else if (arg == "--macro-stats") {
+            macroStats = true;
+        } else if (arg == "--stream") {
+            streamOutput = true;
+        } else if (arg == "-v" || arg == "--verbose") {
+            if (verbosity > SEVERITY_NOTE) {
+                verbosity = SEVERITY_NOTE;
+            }
+        } else if (arg == "--trace-expansion") {
+            verbosity = SEVERITY_TRACE;
+        } else if (arg == "--max-instructions" || arg == "--max-memory") {
+            // Megabytes are converted to bytes, so they must fit once multiplied
+            uint64_t max = arg == "--max-instructions" ? UINT64_MAX : UINT64_MAX / (1024 * 1024);
+            uint64_t limit = 0;
+            if (i + 1 < argc && parseCount(argv[++i], max, limit)) {
+                (arg == "--max-instructions" ? maxInstructions : maxMemoryMB) = limit;
+            } else {
+                std::cerr << "Error: " << arg << " requires a limit" << std::endl;
+                printUsage(argv[0]);
+                return 1;
+            }
         } else if (arg == "-h" || arg == "--help") {
             printUsage(argv[0]);
             return 0;
@@ -78,36 +247,139 @@ int main(int argc, char* argv[]) {
     }
     file.close();
 
-    if (emulatorMode) {
+    RewriteTable rewrites;
+    if (!rewriteFile.empty() && !rewrites.load(rewriteFile)) {
+        return 1;
+    }
+
+    if (!checkFile.empty()) {
+        // Both programs are assembled and decoded as the emulator would run them
+        Emulator first;
+        Emulator second;
+        if (!first.loadProgram(inputFile) || !second.loadProgram(checkFile, optimize, &rewrites)) {
+            std::cerr << "Failed to load programs for checking." << std::endl;
+            return 1;
+        }
+        std::cout << "First: " << inputFile << std::endl;
+        std::cout << "Second: " << checkFile << (optimize ? " (optimized)" : "") << std::endl;
+        EquivalenceChecker checker(first.getProgram(), second.getProgram());
+        checker.setTapeMode(turingMode, tapeReach);
+        checker.setAllStates(allStates);
+        ThreadPool pool(jobs);
+        bool equivalent = checker.check(pool);
+        checker.printReport(std::cout);
+        return equivalent ? 0 : 1;
+    } else if (emulatorMode) {
         // Run emulator
         Emulator emulator;
-        if (!emulator.loadProgram(inputFile)) {
+        if (!emulator.loadProgram(inputFile, optimize, &rewrites)) {
             std::cerr << "Failed to load program for emulation." << std::endl;
             return 1;
         }
 
+        for (int pc : breakpoints) {
+            emulator.setBreakpoint(pc);
+        }
+        emulator.enablePassCache(passCache);
+
         // Enable Turing Complete mode if requested
         if (turingMode) {
             emulator.enableTapeMode(true);
             std::cout << "Turing Complete mode enabled - data lines function as memory and tape operations." << std::endl;
         }
 
-        if (interactiveMode) {
+        if (sweepMode) {
+            // Sweeps need a bound, since lanes that never halt would otherwise run forever
+            const uint64_t DEFAULT_SWEEP_CYCLES = 1000000;
+            InputSweep sweep(emulator.getProgram(), turingMode, maxCycles ? maxCycles : DEFAULT_SWEEP_CYCLES);
+            if (!tapeCaseFile.empty()) {
+                std::vector<InputSweep::TapeCase> tapeCases;
+                if (!InputSweep::readTapeCases(tapeCaseFile, tapeCases)) {
+                    return 1;
+                }
+                if (tapeCases.empty()) {
+                    std::cerr << "No tape cases found in " << tapeCaseFile << std::endl;
+                    return 1;
+                }
+                sweep.setTapeCases(tapeCases);
+            }
+            ThreadPool pool(jobs);
+            sweep.run(pool);
+            sweep.printTable(std::cout);
+        } else if (interactiveMode) {
             emulator.runInteractive();
+        } else if (headlessMode) {
+            emulator.enableFusion(fusion);
+            emulator.runHeadless(maxCycles, maxSeconds);
+            if (emulator.isHalted()) {
+                std::cout << "Program halted." << std::endl;
+            } else if (emulator.getLastStopReason() == Emulator::STOP_BREAKPOINT) {
+                std::cout << "Breakpoint at PC " << emulator.getCurrentPC() << std::endl;
+            } else if (emulator.getLastStopReason() == Emulator::STOP_LOOP) {
+                std::cout << "Program never halts: state repeats every "
+                          << emulator.getLoopPeriod() << " passes." << std::endl;
+            } else {
+                std::cout << "Run budget exhausted." << std::endl;
+            }
+            emulator.printState();
+            emulator.printRunStats();
         } else {
             emulator.run();
         }
     } else {
         // Run assembler (default behavior)
-        Assembler assembler = Assembler(inputFile);
+        // Streaming keeps memory bounded by macro nesting rather than program size
+        // Sizes are measured before expanding, so over-budget programs are refused up front
+        Assembler assembler;
+        assembler.getDiagnostics().setThreshold(verbosity);
+        assembler.setInstructionBudget(maxInstructions);
+        assembler.setMemoryBudget(maxMemoryMB * 1024 * 1024);
+        if (assembler.readAssemblyFile(inputFile)) {
+            std::cout << "File read successfully." << std::endl;
+            bool fits;
+            if (streamOutput && optimize) {
+                std::cerr << "Warning: --optimize needs the whole program, so --stream is ignored" << std::endl;
+            }
+            if (streamOutput && !optimize) {
+                fits = assembler.checkInstructionBudget();
+            } else {
+                ThreadPool pool(jobs);
+                fits = assembler.assemble(pool);
+                if (fits && optimize) {
+                    assembler.setRewriteTable(&rewrites);
+                    assembler.optimize();
+                    assembler.printOptimizationStats();
+                }
+            }
+            if (!fits) {
+                std::cerr << "Assembly aborted; no output written." << std::endl;
+                return 1;
+            }
+        } else {
+            std::cerr << "Error reading file." << std::endl;
+        }
         
-        if (minecraftFormat) {
-            assembler.writeOutputCommand(outputFile);
+        assembler.writeOutput(outputFile, outputFormat);
+        if (outputFormat == FORMAT_COMMANDS) {
             std::cout << "Assembly complete. Minecraft commands written to " << outputFile << std::endl;
+        } else if (outputFormat == FORMAT_PACKED) {
+            std::cout << "Assembly complete. Packed program image written to " << outputFile << std::endl;
+        } else if (outputFormat == FORMAT_STRUCTURE) {
+            std::cout << "Assembly complete. NBT structure written to " << outputFile << std::endl;
         } else {
-            assembler.writeOutput(outputFile);
             std::cout << "Assembly complete. Numeric output written to " << outputFile << std::endl;
         }
+        if (!litematicFile.empty()) {
+            assembler.writeOutput(litematicFile, FORMAT_LITEMATIC);
+            std::cout << "Litematica schematic written to " << litematicFile << std::endl;
+        }
+        if (macroStats) {
+            assembler.printExpansionCacheStats();
+        }
+        if (assembler.getErrorCount() > 0) {
+            std::cerr << assembler.getErrorCount() << " error(s) while assembling." << std::endl;
+            return 1;
+        }
     }
 
     return 0;
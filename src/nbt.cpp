@@ -0,0 +1,74 @@
+#include "nbt.h"
+
+void NbtWriter::putBigEndian(uint64_t value, int size) {
+    for (int i = size - 1; i >= 0; --i) {
+        bytes += static_cast<char>((value >> (8 * i)) & 0xFF);
+    }
+}
+
+void NbtWriter::tagHeader(NbtTag type, const std::string& name) {
+    if (!inList.empty() && inList.back()) {
+        return;  // List elements are bare payloads
+    }
+    bytes += static_cast<char>(type);
+    putBigEndian(name.size(), 2);
+    bytes += name;
+}
+
+void NbtWriter::beginRoot(const std::string& name) {
+    bytes.clear();
+    inList.clear();
+    beginCompound(name);
+}
+
+void NbtWriter::beginCompound(const std::string& name) {
+    tagHeader(TAG_COMPOUND, name);
+    inList.push_back(false);
+}
+
+void NbtWriter::endCompound() {
+    bytes += static_cast<char>(TAG_END);
+    inList.pop_back();
+}
+
+void NbtWriter::beginList(const std::string& name, NbtTag elementType, int32_t count) {
+    tagHeader(TAG_LIST, name);
+    // An empty list is written with element type TAG_END
+    bytes += static_cast<char>(count > 0 ? elementType : TAG_END);
+    putBigEndian(static_cast<uint32_t>(count), 4);
+    inList.push_back(true);
+}
+
+void NbtWriter::endList() {
+    inList.pop_back();
+}
+
+void NbtWriter::writeByte(const std::string& name, int8_t value) {
+    tagHeader(TAG_BYTE, name);
+    putBigEndian(static_cast<uint8_t>(value), 1);
+}
+
+void NbtWriter::writeInt(const std::string& name, int32_t value) {
+    tagHeader(TAG_INT, name);
+    putBigEndian(static_cast<uint32_t>(value), 4);
+}
+
+void NbtWriter::writeLong(const std::string& name, int64_t value) {
+    tagHeader(TAG_LONG, name);
+    putBigEndian(static_cast<uint64_t>(value), 8);
+}
+
+void NbtWriter::writeString(const std::string& name, const std::string& value) {
+    // Every string written here is ASCII, which modified UTF-8 leaves as is
+    tagHeader(TAG_STRING, name);
+    putBigEndian(value.size(), 2);
+    bytes += value;
+}
+
+void NbtWriter::writeLongArray(const std::string& name, const std::vector<int64_t>& values) {
+    tagHeader(TAG_LONG_ARRAY, name);
+    putBigEndian(static_cast<uint32_t>(values.size()), 4);
+    for (int64_t value : values) {
+        putBigEndian(static_cast<uint64_t>(value), 8);
+    }
+}
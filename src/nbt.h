@@ -0,0 +1,53 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// NBT tag types, as numbered in the binary format
+enum NbtTag : uint8_t {
+    TAG_END = 0,
+    TAG_BYTE = 1,
+    TAG_SHORT = 2,
+    TAG_INT = 3,
+    TAG_LONG = 4,
+    TAG_FLOAT = 5,
+    TAG_DOUBLE = 6,
+    TAG_BYTE_ARRAY = 7,
+    TAG_STRING = 8,
+    TAG_LIST = 9,
+    TAG_COMPOUND = 10,
+    TAG_INT_ARRAY = 11,
+    TAG_LONG_ARRAY = 12
+};
+
+// Writes uncompressed big-endian NBT straight into a byte string, with no
+// tree of tag objects in between. Tags inside a compound carry a name;
+// elements of a list are written with the same calls, and their names are
+// ignored. Lists are told their length up front, as the format requires.
+class NbtWriter {
+public:
+    // The root compound; every file has exactly one
+    void beginRoot(const std::string& name = "");
+    void endRoot() { endCompound(); }
+
+    void beginCompound(const std::string& name = "");
+    void endCompound();
+    void beginList(const std::string& name, NbtTag elementType, int32_t count);
+    void endList();
+
+    void writeByte(const std::string& name, int8_t value);
+    void writeInt(const std::string& name, int32_t value);
+    void writeLong(const std::string& name, int64_t value);
+    void writeString(const std::string& name, const std::string& value);
+    void writeLongArray(const std::string& name, const std::vector<int64_t>& values);
+
+    const std::string& data() const { return bytes; }
+
+private:
+    std::string bytes;
+    std::vector<bool> inList;  // For each open compound or list: is it a list?
+
+    void tagHeader(NbtTag type, const std::string& name);
+    void putBigEndian(uint64_t value, int size);
+};
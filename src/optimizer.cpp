@@ -0,0 +1,368 @@
+#include "optimizer.h"
+#include <algorithm>
+
+const size_t PeepholeOptimizer::INSTRUCTION_MULTIPLE;
+const int PeepholeOptimizer::TICKS_PER_INSTRUCTION;
+const size_t PeepholeOptimizer::MAX_WINDOW;
+const int PeepholeOptimizer::MAX_ROUNDS;
+
+bool PeepholeOptimizer::optimize(std::vector<Opcode>& program) {
+    stats = Stats();
+    stats.instructionsBefore = stats.instructionsAfter = program.size();
+    if (program.empty()) {
+        return false;
+    }
+
+    // Each removal can expose more, e.g. "NOT NOT NOT NOT", a select made
+    // dead by removing the only read after it, or an SKZ left with nothing
+    // to do once a write to the SKIP flag is gone
+    std::vector<Opcode> work = program;
+    while (stats.rounds < MAX_ROUNDS) {
+        stats.rounds++;
+        size_t removed = removeRedundant(work) + removeDead(work);
+        removed += removeNoEffect(work) + applyRewrites(work);
+        if (removed == 0) {
+            break;
+        }
+    }
+    if (!pad(work) || work.size() >= program.size()) {
+        stats.redundant = stats.dead = stats.noEffect = stats.rewritten = stats.padding = 0;
+        return false;
+    }
+    program.swap(work);
+    stats.instructionsAfter = program.size();
+    return true;
+}
+
+bool PeepholeOptimizer::pure(Opcode opcode) {
+    // Only the register and the selected line change; the local passes
+    // leave SKZ and OUT to removeNoEffect()
+    return opcode != OP_SKZ && opcode != OP_OUT && opcode != OP_NONE;
+}
+
+bool PeepholeOptimizer::alwaysLoads(int line) {
+    // In tape mode LD from a tape shift line leaves the register alone; the
+    // assembler cannot tell whether the program runs in tape mode
+    return line == OP_DA1 - OP_DA1 || line == OP_DA2 - OP_DA1 || line == OP_DA4 - OP_DA1 || line == OP_DA7 - OP_DA1;
+}
+
+bool PeepholeOptimizer::apply(State& state, Opcode opcode) {
+    Value& reg = state.reg;
+    int8_t line = state.selected;
+    switch (opcode) {
+        case OP_NOT:
+            reg.bit = !reg.bit;
+            break;
+        case OP_LD:
+            if (line >= 0 && alwaysLoads(line)) {
+                reg = Value();
+                reg.known = true;
+                reg.line = line;
+            } else {
+                reg.known = false;
+            }
+            break;
+        case OP_XOR:
+            if (line < 0 || (reg.line >= 0 && reg.line != line)) {
+                reg.known = false;
+            } else {
+                reg.line = reg.line < 0 ? line : -1;  // x ^ x cancels
+            }
+            break;
+        case OP_AND:
+        case OP_OR: {
+            bool absorbing = opcode == OP_OR;  // 0 for AND, 1 for OR
+            if (reg.entry) {
+                reg.known = false;
+            } else if (reg.line < 0) {
+                if (reg.bit != absorbing) {
+                    // 1 & x and 0 | x are just x
+                    reg.line = line;
+                    reg.bit = false;
+                    reg.known = reg.known && line >= 0;
+                }
+            } else if (reg.line == line) {
+                if (reg.bit) {
+                    // x & !x is 0 and x | !x is 1
+                    reg.line = -1;
+                    reg.bit = absorbing;
+                }
+            } else {
+                reg.known = false;
+            }
+            break;
+        }
+        case OP_OUT:
+            // A write may change what any line reads next: memory, or a tape cell or head
+            if (reg.line >= 0) {
+                reg.known = false;
+            }
+            break;
+        case OP_SKZ:
+            break;
+        default:
+            state.selected = static_cast<int8_t>(opcode - OP_DA1);
+            break;
+    }
+    if (!reg.known) {
+        reg = Value();
+    }
+    return reg.known;
+}
+
+bool PeepholeOptimizer::afterSkz(const std::vector<Opcode>& program, size_t index) {
+    // The first instruction follows the last one of the previous pass. Only
+    // instructions after an SKZ are never removed, so a program ends in SKZ
+    // after optimizing exactly when it did before.
+    return program[index > 0 ? index - 1 : program.size() - 1] == OP_SKZ;
+}
+
+bool PeepholeOptimizer::beforeSkz(const std::vector<Opcode>& program, size_t index) {
+    // Keeping the instruction before each SKZ keeps an SKZ from landing
+    // right after a write to the SKIP flag, which the hardware cannot do
+    return program[index + 1 < program.size() ? index + 1 : 0] == OP_SKZ;
+}
+
+PeepholeOptimizer::State PeepholeOptimizer::join(const State& a, const State& b) {
+    State state;
+    if (a.reg == b.reg) {
+        state.reg = a.reg;
+    }
+    if (a.selected == b.selected) {
+        state.selected = a.selected;
+    }
+    return state;
+}
+
+size_t PeepholeOptimizer::removeRedundant(std::vector<Opcode>& program) {
+    // Walks forward with what is known about the register and the selected
+    // line, and drops the shortest run of pure instructions after which both
+    // are provably as they were. An instruction after SKZ may not run at all,
+    // so it is never removed and leaves behind only what holds either way.
+    // Runs end before the instruction ahead of an SKZ.
+    std::vector<Opcode> kept;
+    kept.reserve(program.size());
+    State state;
+    size_t removed = 0;
+    size_t i = 0;
+    while (i < program.size()) {
+        bool guarded = afterSkz(program, i);
+        if (!guarded) {
+            State start = state;
+            if (!start.reg.known) {
+                start.reg.known = true;
+                start.reg.entry = true;
+            }
+            State sim = start;
+            size_t end = 0;
+            for (size_t j = i; j < program.size() && j < i + MAX_WINDOW && pure(program[j]); ++j) {
+                if (!apply(sim, program[j])) {
+                    break;
+                }
+                if (sim == start && !beforeSkz(program, j)) {
+                    end = j + 1;
+                    break;
+                }
+            }
+            if (end > 0) {
+                removed += end - i;
+                i = end;
+                continue;
+            }
+        }
+        State next = state;
+        apply(next, program[i]);
+        state = guarded ? join(state, next) : next;
+        kept.push_back(program[i]);
+        i++;
+    }
+    stats.redundant += removed;
+    program.swap(kept);
+    return removed;
+}
+
+std::vector<int8_t> PeepholeOptimizer::selectedLines(const std::vector<Opcode>& program) {
+    // The line selected before each instruction, -1 where it is not known;
+    // the last entry is the line selected once the program has run
+    std::vector<int8_t> selected(program.size() + 1, -1);
+    for (size_t i = 0; i < program.size(); ++i) {
+        selected[i + 1] = selected[i];
+        if (isa::isDataLine(program[i])) {
+            int8_t line = static_cast<int8_t>(program[i] - OP_DA1);
+            bool guarded = afterSkz(program, i);
+            selected[i + 1] = !guarded || selected[i] == line ? line : -1;
+        }
+    }
+    return selected;
+}
+
+size_t PeepholeOptimizer::removeDead(std::vector<Opcode>& program) {
+    // Walks backward tracking whether the register and the selected line are
+    // read before being overwritten. Both carry over into the next pass, so
+    // both are live at the end.
+    std::vector<int8_t> selected = selectedLines(program);
+    std::vector<bool> keep(program.size(), true);
+    bool registerLive = true;
+    bool lineLive = true;
+    size_t removed = 0;
+    for (size_t i = program.size(); i-- > 0; ) {
+        Opcode opcode = program[i];
+        bool guarded = afterSkz(program, i);
+        bool writesLine = isa::isDataLine(opcode);
+        if (!guarded && !beforeSkz(program, i) && pure(opcode) && !(writesLine ? lineLive : registerLive)) {
+            keep[i] = false;
+            removed++;
+            continue;
+        }
+        switch (opcode) {
+            case OP_NOT:
+            case OP_SKZ:
+                break;
+            case OP_LD:
+                lineLive = lineLive || registerLive;
+                if (!guarded && selected[i] >= 0 && alwaysLoads(selected[i])) {
+                    registerLive = false;
+                }
+                break;
+            case OP_OR:
+            case OP_XOR:
+            case OP_AND:
+                lineLive = lineLive || registerLive;
+                break;
+            case OP_OUT:
+                registerLive = lineLive = true;
+                break;
+            default:
+                if (writesLine && !guarded) {
+                    lineLive = false;
+                }
+                break;
+        }
+    }
+    if (removed > 0) {
+        size_t out = 0;
+        for (size_t i = 0; i < program.size(); ++i) {
+            if (keep[i]) {
+                program[out++] = program[i];
+            }
+        }
+        program.resize(out);
+    }
+    stats.dead += removed;
+    return removed;
+}
+
+size_t PeepholeOptimizer::removeNoEffect(std::vector<Opcode>& program) {
+    // Each removal leaves every later state as the analysis found it, so all
+    // of them can be made from one analysis. A removal that would put an SKZ
+    // right after an OUT is not made.
+    if (program.empty()) {
+        return 0;
+    }
+    DataflowAnalysis flow(program);
+    std::vector<Opcode> kept;
+    kept.reserve(program.size());
+    size_t removed = 0;
+    for (size_t i = 0; i < program.size(); ++i) {
+        const DataflowAnalysis::FlowState& state = flow.before(i);
+        size_t span = 0;
+        if (state.reachable && !afterSkz(program, i)) {
+            if (program[i] != OP_SKZ) {
+                span = DataflowAnalysis::hasNoEffect(program[i], state) ? 1 : 0;
+            } else if (state.memory[0] == 0) {
+                span = 1;
+            } else if (state.memory[0] == 1 && i + 1 < program.size() && !flow.reachable(i + 1)) {
+                span = 2;  // Always skips, so it and what it skips go together
+            }
+        }
+        if (span > 0) {
+            Opcode previous = kept.empty() ? program.back() : kept.back();
+            Opcode next = program[(i + span) % program.size()];
+            if (previous != OP_OUT || next != OP_SKZ) {
+                removed += span;
+                i += span - 1;
+                continue;
+            }
+        }
+        kept.push_back(program[i]);
+    }
+    stats.noEffect += removed;
+    program.swap(kept);
+    return removed;
+}
+
+size_t PeepholeOptimizer::applyRewrites(std::vector<Opcode>& program) {
+    // Replaces the longest window the table holds at each position. Windows
+    // never start after an SKZ or take in the instruction before one, so
+    // every SKZ skips the same instruction and never ends up after an OUT.
+    if (rewrites == nullptr || rewrites->size() == 0) {
+        return 0;
+    }
+    size_t longest = static_cast<size_t>(rewrites->maxLength());
+    std::vector<Opcode> kept;
+    kept.reserve(program.size());
+    size_t saved = 0;
+    size_t i = 0;
+    while (i < program.size()) {
+        const std::vector<Opcode>* replacement = nullptr;
+        size_t length = 0;
+        if (!afterSkz(program, i)) {
+            while (length < longest && i + length < program.size() && program[i + length] != OP_SKZ &&
+                   !beforeSkz(program, i + length)) {
+                length++;
+            }
+            for (; length > 0; --length) {
+                replacement = rewrites->find(&program[i], length);
+                if (replacement != nullptr) {
+                    break;
+                }
+            }
+        }
+        if (replacement != nullptr) {
+            kept.insert(kept.end(), replacement->begin(), replacement->end());
+            saved += length - replacement->size();
+            i += length;
+        } else {
+            kept.push_back(program[i]);
+            i++;
+        }
+    }
+    stats.rewritten += saved;
+    program.swap(kept);
+    return saved;
+}
+
+bool PeepholeOptimizer::pad(std::vector<Opcode>& program) {
+    // Fill the last shulker box with pairs of NOTs, plus one reselect of the
+    // line already selected if an odd number is needed. The HALT flag must
+    // not be written in the last two instructions, so any OUT is kept that
+    // far from the end. Padding after a trailing SKZ would be skipped instead
+    // of the next pass's first instruction, so that case is left unoptimized.
+    size_t padding = (INSTRUCTION_MULTIPLE - program.size() % INSTRUCTION_MULTIPLE) % INSTRUCTION_MULTIPLE;
+    if (program.empty()) {
+        padding = INSTRUCTION_MULTIPLE;  // Everything cancelled out, but a program needs one box
+    }
+    const size_t HALT_DISTANCE = 2;
+    size_t afterOut = HALT_DISTANCE;
+    auto lastOut = std::find(program.rbegin(), program.rend(), OP_OUT);
+    if (lastOut != program.rend()) {
+        afterOut = lastOut - program.rbegin();
+    }
+    if (padding == 0 && afterOut >= HALT_DISTANCE) {
+        return true;
+    }
+    if (!program.empty() && program.back() == OP_SKZ) {
+        return false;
+    }
+    int8_t lastLine = selectedLines(program).back();
+    while (afterOut + padding < HALT_DISTANCE || (padding % 2 == 1 && lastLine < 0)) {
+        padding += INSTRUCTION_MULTIPLE;
+    }
+    stats.padding = padding;
+    if (padding % 2 == 1) {
+        program.push_back(static_cast<Opcode>(OP_DA1 + lastLine));
+        padding--;
+    }
+    program.insert(program.end(), padding, OP_NOT);
+    return true;
+}
@@ -0,0 +1,98 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+#include "dataflow.h"
+#include "isa.h"
+#include "superopt.h"
+
+// Peephole optimizer for assembled programs. It removes three kinds of
+// waste that macro expansion leaves behind:
+//  - runs of instructions that leave the register and the selected data
+//    line as they found them: "NOT NOT", a DAx that reselects the line
+//    already selected, "LD XOR NOT" when the register already holds 1;
+//  - instructions whose result nothing reads: a DAx replaced by another
+//    before any operation, a LD or NOT overwritten by a later LD;
+//  - instructions that DataflowAnalysis shows do nothing in any pass: an SKZ
+//    whose SKIP flag is always low, an SKZ that always skips together with
+//    the instruction it skips, a select of the line every path has already
+//    selected, an OUT that writes a flag the value it already holds.
+// Given a RewriteTable from the superoptimizer, it also replaces any window
+// the table holds with its shorter equivalent.
+// Outputs and tapes are only touched by OUT, which is never removed unless
+// it provably does nothing. Only provably useless SKZs are removed, and
+// never the instruction after an SKZ, so the instruction an SKZ skips stays
+// the same. No SKZ ends up directly after an OUT, where it could follow a
+// write to the SKIP flag. Inputs are assumed to hold still while a pass
+// runs, as they do in the emulator.
+//
+// The program wraps around between passes, so everything is live at its
+// end. Padding NOTs are part of what a pass executes, so the whole padded
+// program is optimized and then padded again with instructions that change
+// nothing. Only whole shulker boxes can be saved.
+class PeepholeOptimizer {
+public:
+    static const size_t INSTRUCTION_MULTIPLE = 27;  // Discs per shulker box
+    static const int TICKS_PER_INSTRUCTION = 12;
+
+    struct Stats {
+        size_t instructionsBefore = 0;  // Padded program lengths
+        size_t instructionsAfter = 0;
+        size_t redundant = 0;           // Removed from sequences that changed nothing
+        size_t dead = 0;                // Removed because nothing read their result
+        size_t noEffect = 0;            // Removed because the values they saw made them do nothing
+        size_t rewritten = 0;           // Saved by replacing windows from the rewrite table
+        size_t padding = 0;             // Neutral instructions added to fill the last shulker box
+        int rounds = 0;
+
+        size_t instructionsSaved() const { return instructionsBefore - instructionsAfter; }
+        uint64_t ticksSaved() const { return uint64_t(instructionsSaved()) * TICKS_PER_INSTRUCTION; }
+        size_t shulkersSaved() const { return instructionsSaved() / INSTRUCTION_MULTIPLE; }
+    };
+
+    // Rewrites a padded program in place. Returns false, leaving it as it
+    // was, when no shorter program could be found.
+    bool optimize(std::vector<Opcode>& program);
+    const Stats& getStats() const { return stats; }
+    // Rewrites to apply as well; the table must outlive the optimizer's use
+    void setRewrites(const RewriteTable* table) { rewrites = table; }
+
+private:
+    // The register as far as it is known: a XOR of the value it held when a
+    // sequence started, the value a data line reads, and a constant bit
+    struct Value {
+        bool known = false;
+        bool entry = false;  // Includes the register's value at the start of the sequence
+        int8_t line = -1;    // Includes what this data line reads, -1 for none
+        bool bit = false;
+        bool operator==(const Value& other) const {
+            return known == other.known && entry == other.entry && line == other.line && bit == other.bit;
+        }
+    };
+
+    struct State {
+        Value reg;
+        int8_t selected = -1;  // Selected data line, -1 if unknown
+        bool operator==(const State& other) const { return reg == other.reg && selected == other.selected; }
+    };
+
+    static const size_t MAX_WINDOW = 8;  // Longest sequence tried for removal
+    static const int MAX_ROUNDS = 16;
+
+    Stats stats;
+    const RewriteTable* rewrites = nullptr;
+
+    static bool apply(State& state, Opcode opcode);
+    static State join(const State& a, const State& b);
+    static bool pure(Opcode opcode);
+    static bool alwaysLoads(int line);
+    static bool afterSkz(const std::vector<Opcode>& program, size_t index);
+    static bool beforeSkz(const std::vector<Opcode>& program, size_t index);
+    size_t removeRedundant(std::vector<Opcode>& program);
+    size_t removeDead(std::vector<Opcode>& program);
+    size_t removeNoEffect(std::vector<Opcode>& program);
+    size_t applyRewrites(std::vector<Opcode>& program);
+    static std::vector<int8_t> selectedLines(const std::vector<Opcode>& program);
+    bool pad(std::vector<Opcode>& program);
+};
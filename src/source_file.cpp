@@ -0,0 +1,99 @@
+#include "source_file.h"
+#include <algorithm>
+#include <fstream>
+#include <sstream>
+
+#if defined(__unix__) || defined(__APPLE__)
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#define SOURCE_FILE_MMAP 1
+#endif
+
+SourceFile::~SourceFile() {
+    close();
+}
+
+void SourceFile::close() {
+#ifdef SOURCE_FILE_MMAP
+    if (mapped) {
+        munmap(const_cast<char*>(data), size);
+    }
+#endif
+    data = nullptr;
+    size = 0;
+    mapped = false;
+    buffer.clear();
+}
+
+bool SourceFile::open(const std::string& path) {
+    close();
+    filePath = path;
+#ifdef SOURCE_FILE_MMAP
+    int fd = ::open(path.c_str(), O_RDONLY);
+    if (fd < 0) {
+        return false;
+    }
+    struct stat info;
+    if (fstat(fd, &info) == 0 && S_ISREG(info.st_mode) && info.st_size > 0) {
+        void* view = mmap(nullptr, static_cast<size_t>(info.st_size), PROT_READ, MAP_PRIVATE, fd, 0);
+        if (view != MAP_FAILED) {
+            data = static_cast<const char*>(view);
+            size = static_cast<size_t>(info.st_size);
+            mapped = true;
+            madvise(view, size, MADV_SEQUENTIAL);
+        }
+    }
+    ::close(fd);
+    if (mapped) {
+        return true;
+    }
+#endif
+    // Empty files, pipes and platforms without mmap are read into memory
+    std::ifstream file(path, std::ios::binary);
+    if (!file) {
+        return false;
+    }
+    std::ostringstream contents;
+    contents << file.rdbuf();
+    buffer = contents.str();
+    data = buffer.data();
+    size = buffer.size();
+    return true;
+}
+
+void SourceFile::scanLines(std::string_view text, std::vector<SourceLine>& lines, const SourceFile* file) {
+    size_t pos = 0;
+    int lineNumber = 1;
+    while (pos < text.size()) {
+        size_t lineStart = pos;
+        size_t first = std::string_view::npos;
+        size_t last = 0;
+        while (pos < text.size() && text[pos] != '\n') {
+            char c = text[pos];
+            if (c == ';') {
+                // The rest of the line is a comment
+                pos = std::min(text.find('\n', pos), text.size());
+                break;
+            }
+            if (c != ' ' && c != '\t') {
+                if (first == std::string_view::npos) {
+                    first = pos;
+                }
+                last = pos;
+            }
+            ++pos;
+        }
+        if (first != std::string_view::npos) {
+            SourceLine line;
+            line.text = text.substr(first, last - first + 1);
+            line.line = lineNumber;
+            line.column = static_cast<int>(first - lineStart) + 1;
+            line.file = file;
+            lines.push_back(line);
+        }
+        ++pos;  // Past the newline
+        ++lineNumber;
+    }
+}
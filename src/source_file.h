@@ -0,0 +1,46 @@
+#pragma once
+
+#include <cstddef>
+#include <string>
+#include <string_view>
+#include <vector>
+
+// One non-empty source line with its comment and surrounding whitespace
+// already stripped; text points into the SourceFile it came from
+class SourceFile;
+
+struct SourceLine {
+    std::string_view text;
+    int line;    // 1-based line number
+    int column;  // 1-based column of the first character of text
+    const SourceFile* file = nullptr;  // Where the line came from, if known
+};
+
+// Read-only view of a whole source file. The file is memory-mapped where the
+// platform allows it, and read into a buffer otherwise, so slices of text()
+// stay valid for as long as the SourceFile lives.
+class SourceFile {
+public:
+    SourceFile() = default;
+    ~SourceFile();
+    SourceFile(const SourceFile&) = delete;
+    SourceFile& operator=(const SourceFile&) = delete;
+
+    bool open(const std::string& path);
+    std::string_view text() const { return std::string_view(data, size); }
+    bool isMapped() const { return mapped; }
+    const std::string& path() const { return filePath; }
+
+    // Split text into SourceLines in one scan: ';' starts a comment, and
+    // spaces and tabs around the remaining text are dropped
+    static void scanLines(std::string_view text, std::vector<SourceLine>& lines, const SourceFile* file = nullptr);
+
+private:
+    const char* data = nullptr;
+    size_t size = 0;
+    bool mapped = false;
+    std::string filePath;
+    std::string buffer;  // Contents when the file could not be mapped
+
+    void close();
+};
@@ -0,0 +1,426 @@
+#include "superopt.h"
+#include <algorithm>
+#include <chrono>
+#include <fstream>
+#include <iostream>
+#include <random>
+#include <sstream>
+
+const int RewriteTable::MAX_LENGTH;
+const int Superoptimizer::ALPHABET_SIZE;
+const int Superoptimizer::FINGERPRINT_STATES;
+const int Superoptimizer::TAPE_CENTER;
+const int Superoptimizer::FIRST_CELL;
+const int Superoptimizer::CELL_BITS;
+
+const Opcode Superoptimizer::ALPHABET[ALPHABET_SIZE] = {
+    OP_NOT, OP_OR, OP_LD, OP_XOR, OP_OUT, OP_AND,
+    OP_DA1, OP_DA2, OP_DA3, OP_DA4, OP_DA5, OP_DA6, OP_DA7, OP_DA8
+};
+
+namespace {
+
+uint64_t mix(uint64_t value) {
+    // splitmix64 finalizer
+    value = (value ^ (value >> 30)) * 0xbf58476d1ce4e5b9ULL;
+    value = (value ^ (value >> 27)) * 0x94d049bb133111ebULL;
+    return value ^ (value >> 31);
+}
+
+bool validOpcode(Opcode opcode) {
+    return opcode != OP_NONE && opcode != OP_SKZ;
+}
+
+void writeWindow(std::ostream& out, const std::vector<Opcode>& window) {
+    for (size_t i = 0; i < window.size(); ++i) {
+        out << (i > 0 ? " " : "") << isa::mnemonic(window[i]);
+    }
+}
+
+}  // namespace
+
+void Superoptimizer::Environment::set(int bit, bool value) {
+    if (bit < FIRST_CELL) {
+        inputsKnown |= 1 << bit;
+        inputs |= value << bit;
+    } else {
+        int tape = (bit - FIRST_CELL) / CELL_BITS;
+        int cell = (bit - FIRST_CELL) % CELL_BITS;
+        cellsKnown[tape] |= 1u << cell;
+        cells[tape] |= uint32_t(value) << cell;
+    }
+}
+
+uint64_t RewriteTable::packKey(const Opcode* window, size_t length) {
+    uint64_t key = uint64_t(length) << (4 * MAX_LENGTH);
+    for (size_t i = 0; i < length; ++i) {
+        key |= uint64_t(window[i]) << (4 * i);
+    }
+    return key;
+}
+
+bool RewriteTable::add(const std::vector<Opcode>& pattern, const std::vector<Opcode>& replacement) {
+    if (pattern.empty() || pattern.size() > size_t(MAX_LENGTH) || replacement.size() >= pattern.size() ||
+        !std::all_of(pattern.begin(), pattern.end(), validOpcode) ||
+        !std::all_of(replacement.begin(), replacement.end(), validOpcode)) {
+        return false;
+    }
+    Rewrite rewrite = {pattern, replacement};
+    if (!rewrites.emplace(packKey(pattern.data(), pattern.size()), rewrite).second) {
+        return false;
+    }
+    longest = std::max(longest, static_cast<int>(pattern.size()));
+    return true;
+}
+
+const std::vector<Opcode>* RewriteTable::find(const Opcode* window, size_t length) const {
+    if (length == 0 || length > size_t(longest)) {
+        return nullptr;
+    }
+    auto found = rewrites.find(packKey(window, length));
+    return found != rewrites.end() ? &found->second.replacement : nullptr;
+}
+
+bool RewriteTable::parseRewrite(const std::string& line, std::vector<Opcode>& pattern,
+                                std::vector<Opcode>& replacement) {
+    size_t arrow = line.find("->");
+    if (arrow == std::string::npos) {
+        std::cerr << "Error: Rewrite needs '->': " << line << std::endl;
+        return false;
+    }
+    pattern.clear();
+    replacement.clear();
+    std::vector<Opcode>* side[2] = {&pattern, &replacement};
+    std::string text[2] = {line.substr(0, arrow), line.substr(arrow + 2)};
+    for (int i = 0; i < 2; ++i) {
+        std::istringstream words(text[i]);
+        std::string word;
+        while (words >> word) {
+            Opcode opcode = isa::findOpcode(word);
+            if (!validOpcode(opcode)) {
+                std::cerr << "Error: Invalid instruction in rewrite: " << word << std::endl;
+                return false;
+            }
+            side[i]->push_back(opcode);
+        }
+    }
+    return true;
+}
+
+bool RewriteTable::load(const std::string& file) {
+    std::ifstream input(file);
+    if (!input) {
+        std::cerr << "File not found: " << file << std::endl;
+        return false;
+    }
+    std::string line;
+    int lineNumber = 0;
+    while (std::getline(input, line)) {
+        lineNumber++;
+        line = line.substr(0, line.find(';'));
+        if (line.find_first_not_of(" \t\r") == std::string::npos) {
+            continue;
+        }
+        std::vector<Opcode> pattern;
+        std::vector<Opcode> replacement;
+        if (!parseRewrite(line, pattern, replacement)) {
+            return false;
+        }
+        // A wrong rewrite would silently change programs, so every one is proven
+        if (!Superoptimizer::checkEquivalent(pattern, replacement)) {
+            std::cerr << "Error: Rewrite on line " << lineNumber << " of " << file
+                      << " does not preserve behavior: " << line << std::endl;
+            return false;
+        }
+        if (!add(pattern, replacement)) {
+            std::cerr << "Error: Invalid or repeated rewrite on line " << lineNumber << " of " << file << std::endl;
+            return false;
+        }
+    }
+    return true;
+}
+
+bool RewriteTable::save(const std::string& file) const {
+    // Sorted by pattern length, then opcode, so runs give identical files
+    std::vector<const Rewrite*> sorted;
+    sorted.reserve(rewrites.size());
+    for (const auto& entry : rewrites) {
+        sorted.push_back(&entry.second);
+    }
+    std::sort(sorted.begin(), sorted.end(), [](const Rewrite* a, const Rewrite* b) {
+        if (a->pattern.size() != b->pattern.size()) {
+            return a->pattern.size() < b->pattern.size();
+        }
+        return a->pattern < b->pattern;
+    });
+
+    std::ofstream output(file);
+    if (!output) {
+        std::cerr << "Error: Could not write " << file << std::endl;
+        return false;
+    }
+    output << "; " << rewrites.size() << " rewrites, patterns up to " << longest << " instructions" << std::endl;
+    for (const Rewrite* rewrite : sorted) {
+        writeWindow(output, rewrite->pattern);
+        output << " ->";
+        if (!rewrite->replacement.empty()) {
+            output << " ";
+            writeWindow(output, rewrite->replacement);
+        }
+        output << std::endl;
+    }
+    return static_cast<bool>(output);
+}
+
+Superoptimizer::Superoptimizer(int maxLength)
+    : maxLength(std::max(1, std::min(maxLength, RewriteTable::MAX_LENGTH))) {
+    // Fixed seed: the same states, hence the same table, on every run
+    std::mt19937_64 random(0x5eed);
+    for (int i = 0; i < FINGERPRINT_STATES; ++i) {
+        uint64_t bits = random();
+        Machine machine;
+        machine.tapeMode = i % 2 == 1;
+        machine.reg = bits & 1;
+        machine.selected = (bits >> 1) & 7;
+        machine.memory = (bits >> 4) & 3;
+        Environment environment;
+        environment.inputsKnown = 0xff;
+        environment.inputs = static_cast<uint8_t>(bits >> 8);
+        for (int tape = 0; tape < 2; ++tape) {
+            environment.cellsKnown[tape] = ~0u;
+            environment.cells[tape] = static_cast<uint32_t>(random());
+        }
+        fingerprintStates.push_back(machine);
+        fingerprintEnvironments.push_back(environment);
+    }
+}
+
+int Superoptimizer::step(Machine& machine, Opcode opcode, const Environment& environment) {
+    // Mirrors Emulator::lineHandlers: DA1/DA2 are memory, DA3-DA8 are inputs
+    // and outputs, or in tape mode move the heads and read or toggle cells
+    int line = machine.selected;
+    const isa::InstructionInfo& info = isa::INSTRUCTIONS[OP_DA1 + line];
+    bool tapeLine = machine.tapeMode && line >= 2;
+    bool headLine = tapeLine && info.role == isa::ROLE_TAPE_HEAD;
+    bool value = false;
+    if (opcode == OP_LD || opcode == OP_XOR || opcode == OP_AND || opcode == OP_OR) {
+        if (opcode == OP_LD && tapeLine && !headLine) {
+            return -1;  // LD from a tape shift line leaves the register alone
+        }
+        if (line < 2) {
+            value = (machine.memory >> line) & 1;
+        } else if (headLine) {
+            int cell = machine.heads[info.tape] + TAPE_CENTER;
+            if (!((environment.cellsKnown[info.tape] >> cell) & 1)) {
+                return FIRST_CELL + info.tape * CELL_BITS + cell;
+            }
+            value = ((environment.cells[info.tape] ^ machine.toggled[info.tape]) >> cell) & 1;
+        } else {
+            if (!((environment.inputsKnown >> line) & 1)) {
+                return line;
+            }
+            value = (environment.inputs >> line) & 1;
+        }
+    }
+    switch (opcode) {
+        case OP_NOT: machine.reg = !machine.reg; break;
+        case OP_OR: machine.reg = machine.reg || value; break;
+        case OP_LD: machine.reg = value; break;
+        case OP_XOR: machine.reg = machine.reg != value; break;
+        case OP_AND: machine.reg = machine.reg && value; break;
+        case OP_OUT:
+            if (line < 2) {
+                machine.memory = static_cast<uint8_t>((machine.memory & ~(1 << line)) | (machine.reg << line));
+            } else if (!machine.tapeMode) {
+                machine.written |= 1 << line;
+                machine.outputs = static_cast<uint8_t>((machine.outputs & ~(1 << line)) | (machine.reg << line));
+            } else if (machine.reg && headLine) {
+                machine.toggled[info.tape] ^= 1u << (machine.heads[info.tape] + TAPE_CENTER);
+            } else if (machine.reg) {
+                machine.heads[info.tape] += info.role == isa::ROLE_TAPE_LEFT ? -1 : 1;
+            }
+            break;
+        default:
+            machine.selected = static_cast<uint8_t>(opcode - OP_DA1);
+            break;
+    }
+    return -1;
+}
+
+int Superoptimizer::run(const std::vector<Opcode>& window, Machine& machine, const Environment& environment) {
+    for (Opcode opcode : window) {
+        int needed = step(machine, opcode, environment);
+        if (needed >= 0) {
+            return needed;
+        }
+    }
+    return -1;
+}
+
+bool Superoptimizer::equivalentFrom(const std::vector<Opcode>& a, const std::vector<Opcode>& b,
+                                    const Machine& start, const Environment& environment) {
+    // Runs both windows until one reads something not fixed yet, then tries
+    // it both ways; reads the windows never make are never enumerated
+    Machine endA = start;
+    int needed = run(a, endA, environment);
+    Machine endB = start;
+    if (needed < 0) {
+        needed = run(b, endB, environment);
+        if (needed < 0) {
+            return endA == endB;
+        }
+    }
+    for (int value = 0; value < 2; ++value) {
+        Environment next = environment;
+        next.set(needed, value);
+        if (!equivalentFrom(a, b, start, next)) {
+            return false;
+        }
+    }
+    return true;
+}
+
+bool Superoptimizer::checkEquivalent(const std::vector<Opcode>& a, const std::vector<Opcode>& b) {
+    if (a.size() > size_t(RewriteTable::MAX_LENGTH) || b.size() > size_t(RewriteTable::MAX_LENGTH) ||
+        !std::all_of(a.begin(), a.end(), validOpcode) || !std::all_of(b.begin(), b.end(), validOpcode)) {
+        return false;
+    }
+    for (int mode = 0; mode < 2; ++mode) {
+        for (int line = 0; line < 8; ++line) {
+            for (int bits = 0; bits < 8; ++bits) {
+                Machine start;
+                start.tapeMode = mode == 1;
+                start.selected = static_cast<uint8_t>(line);
+                start.reg = bits & 1;
+                start.memory = static_cast<uint8_t>(bits >> 1);
+                if (!equivalentFrom(a, b, start, Environment())) {
+                    return false;
+                }
+            }
+        }
+    }
+    return true;
+}
+
+uint64_t Superoptimizer::fingerprint(const std::vector<Machine>& states) {
+    uint64_t hash = 0;
+    for (const Machine& machine : states) {
+        uint64_t packed = uint64_t(machine.reg) | uint64_t(machine.selected) << 1 | uint64_t(machine.memory) << 4 |
+                          uint64_t(machine.written) << 6 | uint64_t(machine.outputs) << 14 |
+                          uint64_t(uint8_t(machine.heads[0])) << 22 | uint64_t(uint8_t(machine.heads[1])) << 30;
+        hash = mix(hash ^ packed);
+        hash = mix(hash ^ (uint64_t(machine.toggled[0]) | uint64_t(machine.toggled[1]) << 32));
+    }
+    return hash;
+}
+
+bool Superoptimizer::isIrreducible(const Opcode* window, size_t length) const {
+    return irreducible.count(RewriteTable::packKey(window, length)) > 0;
+}
+
+void Superoptimizer::classify(const std::vector<Opcode>& window, uint64_t print, Found& found) const {
+    // Shortest candidate first, ties broken by opcode, so the table does not
+    // depend on hash order
+    std::vector<const std::vector<Opcode>*> candidates;
+    auto range = classes.equal_range(print);
+    for (auto it = range.first; it != range.second; ++it) {
+        candidates.push_back(&it->second);
+    }
+    std::sort(candidates.begin(), candidates.end(), [](const std::vector<Opcode>* a, const std::vector<Opcode>* b) {
+        return a->size() != b->size() ? a->size() < b->size() : *a < *b;
+    });
+    for (const std::vector<Opcode>* candidate : candidates) {
+        if (checkEquivalent(window, *candidate)) {
+            found.rewrites.emplace_back(window, *candidate);
+            return;
+        }
+        found.collisions++;
+    }
+    found.irreducible.emplace_back(print, window);
+}
+
+void Superoptimizer::searchFrom(std::vector<Opcode>& window, int length, std::vector<std::vector<Machine>>& states,
+                                Found& found) const {
+    // states[d] holds every fingerprint machine after the first d opcodes
+    size_t depth = window.size();
+    if (static_cast<int>(depth) == length) {
+        found.windows++;
+        if (isIrreducible(window.data() + 1, depth - 1)) {
+            classify(window, fingerprint(states[depth]), found);
+        }
+        return;
+    }
+    for (Opcode opcode : ALPHABET) {
+        window.push_back(opcode);
+        if (static_cast<int>(depth) + 1 == length || isIrreducible(window.data(), window.size())) {
+            for (int i = 0; i < FINGERPRINT_STATES; ++i) {
+                states[depth + 1][i] = states[depth][i];
+                step(states[depth + 1][i], opcode, fingerprintEnvironments[i]);
+            }
+            searchFrom(window, length, states, found);
+        }
+        window.pop_back();
+    }
+}
+
+void Superoptimizer::run(ThreadPool& pool) {
+    table = RewriteTable();
+    stats.clear();
+    classes.clear();
+    irreducible.clear();
+    classes.emplace(fingerprint(fingerprintStates), std::vector<Opcode>());
+    irreducible.insert(RewriteTable::packKey(nullptr, 0));
+
+    for (int length = 1; length <= maxLength; ++length) {
+        auto started = std::chrono::steady_clock::now();
+        // One task per irreducible prefix of up to two opcodes
+        std::vector<std::vector<Opcode>> prefixes;
+        for (Opcode first : ALPHABET) {
+            if (length == 1) {
+                prefixes.push_back({first});
+                continue;
+            }
+            for (Opcode second : ALPHABET) {
+                std::vector<Opcode> prefix = {first, second};
+                if (length == 2 || isIrreducible(prefix.data(), 2)) {
+                    prefixes.push_back(prefix);
+                }
+            }
+        }
+        std::vector<Found> found(prefixes.size());
+        for (size_t task = 0; task < prefixes.size(); ++task) {
+            pool.submit([this, task, length, &prefixes, &found] {
+                std::vector<Opcode> window = prefixes[task];
+                std::vector<std::vector<Machine>> states(length + 1, fingerprintStates);
+                for (size_t depth = 0; depth < window.size(); ++depth) {
+                    states[depth + 1] = states[depth];
+                    for (int i = 0; i < FINGERPRINT_STATES; ++i) {
+                        step(states[depth + 1][i], window[depth], fingerprintEnvironments[i]);
+                    }
+                }
+                searchFrom(window, length, states, found[task]);
+            });
+        }
+        pool.wait();
+
+        // Merged in task order, after the level, so results never depend on
+        // which thread finished first
+        LevelStats level;
+        level.length = length;
+        for (const Found& part : found) {
+            level.windows += part.windows;
+            level.collisions += part.collisions;
+            level.irreducible += part.irreducible.size();
+            level.rewrites += part.rewrites.size();
+            for (const auto& entry : part.irreducible) {
+                classes.emplace(entry.first, entry.second);
+                irreducible.insert(RewriteTable::packKey(entry.second.data(), entry.second.size()));
+            }
+            for (const auto& rewrite : part.rewrites) {
+                table.add(rewrite.first, rewrite.second);
+            }
+        }
+        level.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - started).count();
+        stats.push_back(level);
+    }
+}
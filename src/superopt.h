@@ -0,0 +1,139 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+#include "isa.h"
+#include "thread_pool.h"
+
+// Window rewrites: each pattern runs exactly like its replacement, which is
+// shorter, from every machine state in both normal and tape mode. Patterns
+// never contain SKZ. Stored one per line as "LD LD -> LD", with ';' comments.
+class RewriteTable {
+public:
+    static const int MAX_LENGTH = 8;
+
+    // False if the pattern is too long, holds SKZ, or is already present
+    bool add(const std::vector<Opcode>& pattern, const std::vector<Opcode>& replacement);
+    // The replacement for exactly this window, or nullptr
+    const std::vector<Opcode>* find(const Opcode* window, size_t length) const;
+    size_t size() const { return rewrites.size(); }
+    int maxLength() const { return longest; }
+
+    bool load(const std::string& file);
+    bool save(const std::string& file) const;
+    static bool parseRewrite(const std::string& line, std::vector<Opcode>& pattern, std::vector<Opcode>& replacement);
+    // A window of up to MAX_LENGTH opcodes packed into one map key
+    static uint64_t packKey(const Opcode* window, size_t length);
+
+private:
+    struct Rewrite {
+        std::vector<Opcode> pattern;
+        std::vector<Opcode> replacement;
+    };
+    std::unordered_map<uint64_t, Rewrite> rewrites;  // Keyed by packKey() of the pattern
+    int longest = 0;
+};
+
+// Finds every shortest rewrite of SKZ-free windows up to a given length by
+// enumerating them in order of length. A window is only tried when every
+// shorter window inside it is already as short as it gets, so the table
+// holds the minimal patterns; any longer window that can be shortened
+// contains one of them. Candidates are matched by a fingerprint over random
+// states, then proven equal over every state with checkEquivalent().
+class Superoptimizer {
+public:
+    struct LevelStats {
+        int length = 0;
+        size_t windows = 0;      // Windows enumerated at this length
+        size_t irreducible = 0;  // Windows nothing shorter matches
+        size_t rewrites = 0;     // Windows with a proven shorter equivalent
+        size_t collisions = 0;   // Fingerprint matches that turned out to differ
+        double seconds = 0.0;
+    };
+
+    explicit Superoptimizer(int maxLength);
+
+    void run(ThreadPool& pool);
+    const RewriteTable& getTable() const { return table; }
+    const std::vector<LevelStats>& getStats() const { return stats; }
+
+    // Whether two SKZ-free windows leave every machine the same, starting
+    // from any register, selected line, flags, inputs, outputs and tapes, in
+    // either mode. Inputs and tape cells are only enumerated once read.
+    static bool checkEquivalent(const std::vector<Opcode>& a, const std::vector<Opcode>& b);
+
+private:
+    // Every opcode but SKZ
+    static const int ALPHABET_SIZE = OPCODE_COUNT - 2;
+    static const Opcode ALPHABET[ALPHABET_SIZE];
+    static const int FINGERPRINT_STATES = 64;
+
+    // Heads start in the middle of the cells a window can reach
+    static const int TAPE_CENTER = RewriteTable::MAX_LENGTH;
+    // Bits of the environment: inputs by line, then the cells of each tape
+    static const int FIRST_CELL = 8;
+    static const int CELL_BITS = 32;
+
+    // The machine a window runs on. Heads and toggles are relative to where
+    // the window started, so windows compare without knowing the tapes.
+    struct Machine {
+        bool tapeMode = false;
+        bool reg = false;
+        uint8_t selected = 0;
+        uint8_t memory = 0;            // Bit 0 SKIP flag, bit 1 HALT flag
+        uint8_t written = 0;           // Output lines some OUT wrote
+        uint8_t outputs = 0;           // What they were written last
+        int8_t heads[2] = {0, 0};
+        uint32_t toggled[2] = {0, 0};  // Bit TAPE_CENTER + position per toggled cell
+
+        bool operator==(const Machine& other) const {
+            return tapeMode == other.tapeMode && reg == other.reg && selected == other.selected &&
+                   memory == other.memory && written == other.written && outputs == other.outputs &&
+                   heads[0] == other.heads[0] && heads[1] == other.heads[1] &&
+                   toggled[0] == other.toggled[0] && toggled[1] == other.toggled[1];
+        }
+    };
+
+    // Inputs and tape cells as far as they have been fixed
+    struct Environment {
+        uint8_t inputsKnown = 0;
+        uint8_t inputs = 0;
+        uint32_t cellsKnown[2] = {0, 0};
+        uint32_t cells[2] = {0, 0};
+
+        void set(int bit, bool value);
+    };
+
+    int maxLength;
+    RewriteTable table;
+    std::vector<LevelStats> stats;
+    std::vector<Machine> fingerprintStates;
+    std::vector<Environment> fingerprintEnvironments;
+    // Windows shorter than the level being searched, by fingerprint, and
+    // the set of every irreducible window found so far
+    std::unordered_multimap<uint64_t, std::vector<Opcode>> classes;
+    std::unordered_set<uint64_t> irreducible;
+
+    struct Found {
+        std::vector<std::pair<uint64_t, std::vector<Opcode>>> irreducible;  // With their fingerprints
+        std::vector<std::pair<std::vector<Opcode>, std::vector<Opcode>>> rewrites;
+        size_t windows = 0;
+        size_t collisions = 0;
+    };
+
+    void searchFrom(std::vector<Opcode>& window, int length, std::vector<std::vector<Machine>>& states, Found& found) const;
+    void classify(const std::vector<Opcode>& window, uint64_t fingerprint, Found& found) const;
+    bool isIrreducible(const Opcode* window, size_t length) const;
+    static uint64_t fingerprint(const std::vector<Machine>& states);
+
+    // Runs one instruction or a whole window. Returns -1, or the input or
+    // tape cell the environment does not know yet and the run needs next.
+    static int step(Machine& machine, Opcode opcode, const Environment& environment);
+    static int run(const std::vector<Opcode>& window, Machine& machine, const Environment& environment);
+    static bool equivalentFrom(const std::vector<Opcode>& a, const std::vector<Opcode>& b, const Machine& start,
+                               const Environment& environment);
+};
@@ -0,0 +1,83 @@
+#include <iomanip>
+#include <iostream>
+#include <string>
+#include "cli_args.h"
+#include "superopt.h"
+#include "thread_pool.h"
+
+void printUsage(const char* programName) {
+    std::cout << "Usage: " << programName << " [options]" << std::endl;
+    std::cout << "Searches every SKZ-free instruction window for a shorter equivalent and" << std::endl;
+    std::cout << "writes them as a rewrite table for the assembler's --rewrites option." << std::endl;
+    std::cout << "Options:" << std::endl;
+    std::cout << "  -l, --length <n>      Longest window searched, 1-" << RewriteTable::MAX_LENGTH
+              << " (default: 6)" << std::endl;
+    std::cout << "  -j, --jobs <n>        Worker threads (default: all cores)" << std::endl;
+    std::cout << "  -o, --output <file>   Rewrite table file (default: rewrites.txt)" << std::endl;
+    std::cout << "  -h, --help            Show this help message" << std::endl;
+}
+
+int main(int argc, char* argv[]) {
+    int maxLength = 6;
+    unsigned jobs = 0;
+    std::string outputFile = "rewrites.txt";
+
+    for (int i = 1; i < argc; ++i) {
+        std::string arg = argv[i];
+        if (arg == "-l" || arg == "--length") {
+            uint64_t length = 0;
+            if (i + 1 < argc && parseCount(argv[++i], INT32_MAX, length)) {
+                maxLength = static_cast<int>(length);
+            } else {
+                std::cerr << "Error: -l/--length requires a window length" << std::endl;
+                printUsage(argv[0]);
+                return 1;
+            }
+            if (maxLength < 1 || maxLength > RewriteTable::MAX_LENGTH) {
+                std::cerr << "Error: Window length must be between 1 and " << RewriteTable::MAX_LENGTH << std::endl;
+                return 1;
+            }
+        } else if (arg == "-j" || arg == "--jobs") {
+            uint64_t threads = 0;
+            if (i + 1 < argc && parseCount(argv[++i], UINT32_MAX, threads)) {
+                jobs = static_cast<unsigned>(threads);
+            } else {
+                std::cerr << "Error: -j/--jobs requires a thread count" << std::endl;
+                printUsage(argv[0]);
+                return 1;
+            }
+        } else if (arg == "-o" || arg == "--output") {
+            if (i + 1 < argc) {
+                outputFile = argv[++i];
+            } else {
+                std::cerr << "Error: -o/--output requires a filename" << std::endl;
+                printUsage(argv[0]);
+                return 1;
+            }
+        } else if (arg == "-h" || arg == "--help") {
+            printUsage(argv[0]);
+            return 0;
+        } else {
+            std::cerr << "Error: Unknown option " << arg << std::endl;
+            printUsage(argv[0]);
+            return 1;
+        }
+    }
+
+    ThreadPool pool(jobs);
+    Superoptimizer superoptimizer(maxLength);
+    superoptimizer.run(pool);
+
+    std::cout << "LENGTH    WINDOWS  IRREDUCIBLE   REWRITES COLLISIONS   SECONDS" << std::endl;
+    for (const Superoptimizer::LevelStats& level : superoptimizer.getStats()) {
+        std::cout << std::setw(6) << level.length << std::setw(11) << level.windows << std::setw(13)
+                  << level.irreducible << std::setw(11) << level.rewrites << std::setw(11) << level.collisions
+                  << std::setw(10) << std::fixed << std::setprecision(2) << level.seconds << std::endl;
+    }
+    const RewriteTable& table = superoptimizer.getTable();
+    if (!table.save(outputFile)) {
+        return 1;
+    }
+    std::cout << table.size() << " rewrites written to " << outputFile << std::endl;
+    return 0;
+}
@@ -0,0 +1,168 @@
+#include "sweep.h"
+#include "batch_emulator.h"
+#include <algorithm>
+#include <fstream>
+#include <iomanip>
+#include <sstream>
+
+const int InputSweep::INPUT_LINES;
+const int InputSweep::COMBINATIONS;
+
+InputSweep::InputSweep(const std::vector<uint8_t>& program, bool tapeMode, uint64_t maxCycles)
+    : program(program), tapeMode(tapeMode), maxCycles(maxCycles) {
+    // A sweep with no tape list runs once on blank tapes
+    tapeCases.push_back(TapeCase());
+    tapeCases.back().description = "blank";
+}
+
+bool InputSweep::parseTapeCase(const std::string& line, TapeCase& tapeCase) {
+    std::istringstream specs(line);
+    std::string spec;
+    int tapeIndex = 0;
+    tapeCase = TapeCase();
+    tapeCase.description = line;
+
+    while (specs >> spec) {
+        if (tapeIndex >= 2) {
+            std::cerr << "Error: More than two tapes in tape case: " << line << std::endl;
+            return false;
+        }
+        size_t colonPos = spec.find(':');
+        std::string bits = spec;
+        if (colonPos != std::string::npos) {
+            try {
+                tapeCase.start[tapeIndex] = std::stoi(spec.substr(0, colonPos));
+            } catch (const std::exception&) {
+                std::cerr << "Error: Invalid tape start position in: " << spec << std::endl;
+                return false;
+            }
+            bits = spec.substr(colonPos + 1);
+        }
+        for (char bit : bits) {
+            if (bit != '0' && bit != '1') {
+                std::cerr << "Error: Tape contents must be 0/1 digits: " << spec << std::endl;
+                return false;
+            }
+            tapeCase.cells[tapeIndex].push_back(bit == '1');
+        }
+        ++tapeIndex;
+    }
+    return true;
+}
+
+bool InputSweep::readTapeCases(const std::string& file, std::vector<TapeCase>& cases) {
+    std::ifstream input(file);
+    if (!input) {
+        std::cerr << "File not found: " << file << std::endl;
+        return false;
+    }
+    std::string line;
+    while (std::getline(input, line)) {
+        line = line.substr(0, line.find(';'));
+        if (line.find_first_not_of(" \t\r") == std::string::npos) {
+            continue;
+        }
+        TapeCase tapeCase;
+        if (!parseTapeCase(line, tapeCase)) {
+            return false;
+        }
+        cases.push_back(tapeCase);
+    }
+    return true;
+}
+
+void InputSweep::run(ThreadPool& pool) {
+    results.assign(tapeCases.size(), std::vector<LaneResult>(COMBINATIONS));
+    for (size_t i = 0; i < tapeCases.size(); ++i) {
+        pool.submit([this, i] { runCase(i); });
+    }
+    pool.wait();
+}
+
+void InputSweep::runCase(size_t index) {
+    const TapeCase& tapeCase = tapeCases[index];
+    BatchEmulator batch(COMBINATIONS);
+    batch.loadProgram(program);
+    batch.enableTapeMode(tapeMode);
+
+    // One lane per input combination, every lane starting from the same tapes
+    for (int lane = 0; lane < COMBINATIONS; ++lane) {
+        for (int line = 2; line < 8; ++line) {
+            batch.setDataInput(lane, line, inputBit(lane, line));
+        }
+        for (int tape = 0; tape < 2; ++tape) {
+            for (size_t cell = 0; cell < tapeCase.cells[tape].size(); ++cell) {
+                if (tapeCase.cells[tape][cell]) {
+                    batch.setTapeCell(lane, tape, tapeCase.start[tape] + static_cast<int>(cell), true);
+                }
+            }
+        }
+    }
+
+    batch.run(maxCycles);
+
+    for (int lane = 0; lane < COMBINATIONS; ++lane) {
+        LaneResult& result = results[index][lane];
+        result.halted = batch.isHalted(lane);
+        result.cycles = result.halted ? batch.getHaltCycle(lane) : batch.getCycleCount();
+        result.registerValue = batch.getRegisterValue(lane);
+        result.memory[0] = batch.getMemoryValue(lane, 0);
+        result.memory[1] = batch.getMemoryValue(lane, 1);
+        for (int line = 0; line < 8; ++line) {
+            result.outputs[line] = batch.getDataOutput(lane, line);
+        }
+        for (int tape = 0; tape < 2; ++tape) {
+            // Report the initial tape range widened to include the final head
+            int head = batch.getTapeHead(lane, tape);
+            int low = std::min(tapeCase.start[tape], head);
+            int high = std::max(tapeCase.start[tape] + static_cast<int>(tapeCase.cells[tape].size()) - 1, head);
+            result.heads[tape] = head;
+            result.tapeLow[tape] = low;
+            result.tape[tape].clear();
+            for (int position = low; position <= high; ++position) {
+                result.tape[tape].push_back(batch.getTapeCell(lane, tape, position));
+            }
+        }
+    }
+}
+
+void InputSweep::printTable(std::ostream& out) const {
+    std::ostringstream table;
+    for (size_t index = 0; index < results.size(); ++index) {
+        table << "=== Tape case " << (index + 1) << ": " << tapeCases[index].description << " ===" << std::endl;
+        table << "DA3 DA4 DA5 DA6 DA7 DA8 | STATUS  CYCLES     | REG DA1 DA2 |";
+        if (tapeMode) {
+            table << " TAPE 1 / TAPE 2 (start:cells, [head])";
+        } else {
+            table << " OUT3 OUT4 OUT5 OUT6 OUT7 OUT8";
+        }
+        table << std::endl;
+
+        for (int combination = 0; combination < COMBINATIONS; ++combination) {
+            const LaneResult& result = results[index][combination];
+            for (int line = 2; line < 8; ++line) {
+                table << "  " << inputBit(combination, line) << " ";
+            }
+            table << "| " << (result.halted ? "HALTED " : "RUNNING") << " "
+                  << std::left << std::setw(10) << result.cycles << std::right << " |"
+                  << "  " << result.registerValue
+                  << "   " << result.memory[0]
+                  << "   " << result.memory[1] << "  |";
+            if (tapeMode) {
+                for (int tape = 0; tape < 2; ++tape) {
+                    table << (tape == 0 ? " " : " / ") << result.tapeLow[tape] << ":";
+                    for (size_t cell = 0; cell < result.tape[tape].size(); ++cell) {
+                        bool isHead = result.tapeLow[tape] + static_cast<int>(cell) == result.heads[tape];
+                        table << (isHead ? "[" : "") << result.tape[tape][cell] << (isHead ? "]" : "");
+                    }
+                }
+            } else {
+                for (int line = 2; line < 8; ++line) {
+                    table << "    " << result.outputs[line];
+                }
+            }
+            table << std::endl;
+        }
+    }
+    out << table.str();
+}
@@ -0,0 +1,59 @@
+#pragma once
+
+#include <cstdint>
+#include <iostream>
+#include <string>
+#include <vector>
+#include "thread_pool.h"
+
+// Exhaustive input sweep: runs one program over all 64 combinations of the
+// DA3-DA8 inputs for every initial tape configuration, one BatchEmulator pass
+// per tape case, spread over a ThreadPool. Results print as a truth table.
+class InputSweep {
+public:
+    static const int INPUT_LINES = 6;                     // DA3-DA8
+    static const int COMBINATIONS = 1 << INPUT_LINES;
+
+    // Initial tape contents, written as "[start:]bits" for each tape
+    struct TapeCase {
+        std::string description;
+        int start[2] = {0, 0};
+        std::vector<bool> cells[2];
+    };
+
+    struct LaneResult {
+        bool halted = false;
+        uint64_t cycles = 0;
+        bool registerValue = false;
+        bool memory[2] = {false, false};
+        bool outputs[8] = {};
+        int heads[2] = {0, 0};
+        int tapeLow[2] = {0, 0};
+        std::vector<bool> tape[2];
+    };
+
+    InputSweep(const std::vector<uint8_t>& program, bool tapeMode, uint64_t maxCycles);
+
+    static bool parseTapeCase(const std::string& line, TapeCase& tapeCase);
+    static bool readTapeCases(const std::string& file, std::vector<TapeCase>& cases);
+    void setTapeCases(const std::vector<TapeCase>& cases) { tapeCases = cases; }
+
+    void run(ThreadPool& pool);
+    void printTable(std::ostream& out) const;
+
+    // Input bit for DA3-DA8 in a row; DA3 is the most significant bit
+    static bool inputBit(int combination, int dataLine) {
+        return (combination >> (7 - dataLine)) & 1;
+    }
+    const std::vector<LaneResult>& getResults(size_t tapeCase) const { return results[tapeCase]; }
+    size_t getCaseCount() const { return tapeCases.size(); }
+
+private:
+    std::vector<uint8_t> program;
+    bool tapeMode;
+    uint64_t maxCycles;
+    std::vector<TapeCase> tapeCases;
+    std::vector<std::vector<LaneResult>> results;
+
+    void runCase(size_t index);
+};
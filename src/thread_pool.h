@@ -0,0 +1,50 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// Work-stealing thread pool. Each worker owns a deque: it pops its own work
+// from the back and, when empty, steals from the front of the other queues.
+// Tasks submitted from inside a worker go to that worker's own queue.
+class ThreadPool {
+public:
+    typedef std::function<void()> Task;
+
+    // threadCount 0 uses std::thread::hardware_concurrency()
+    explicit ThreadPool(unsigned threadCount = 0);
+    ~ThreadPool();
+
+    ThreadPool(const ThreadPool&) = delete;
+    ThreadPool& operator=(const ThreadPool&) = delete;
+
+    void submit(Task task);
+    // Block until every submitted task (including nested ones) has finished
+    void wait();
+    unsigned size() const { return static_cast<unsigned>(threads.size()); }
+
+private:
+    struct WorkQueue {
+        std::deque<Task> tasks;
+        std::mutex mutex;
+    };
+
+    std::vector<std::unique_ptr<WorkQueue>> queues;
+    std::vector<std::thread> threads;
+    std::atomic<size_t> queued;
+    std::atomic<size_t> pending;
+    std::atomic<unsigned> nextQueue;
+    bool stopping;
+    std::mutex stateMutex;
+    std::condition_variable workAvailable;
+    std::condition_variable allDone;
+
+    void workerLoop(unsigned index);
+    bool popLocal(unsigned index, Task& task);
+    bool steal(unsigned thief, Task& task);
+};
@@ -1,13 +1,34 @@
 #include <catch2/catch_test_macros.hpp>
 #include "assembler.h"
+#include "thread_pool.h"
+#include <algorithm>
+#include <cstdio>
 #include <fstream>
+#include <sstream>
 #include <string>
+#include <vector>
 
 std::string getTestFilePath(const std::string& filename) {
     // When running from project root, test files are in tests/
     return "tests/" + filename;
 }
 
+// Collects std::cerr for as long as it lives, restoring it even if a check fails
+struct CerrCapture {
+    std::ostringstream text;
+    std::streambuf* previous;
+    CerrCapture() : previous(std::cerr.rdbuf(text.rdbuf())) {}
+    ~CerrCapture() { std::cerr.rdbuf(previous); }
+};
+
+// Notes and traces go to std::cout
+struct CoutCapture {
+    std::ostringstream text;
+    std::streambuf* previous;
+    CoutCapture() : previous(std::cout.rdbuf(text.rdbuf())) {}
+    ~CoutCapture() { std::cout.rdbuf(previous); }
+};
+
 TEST_CASE("Assembler can parse basic opcodes", "[assembler]") {
     
     SECTION("Single opcode file") {
@@ -191,4 +212,469 @@ TEST_CASE("Recursive SKZ Macro Expansion", "[assembler][skz][macro]") {
         }
         REQUIRE(hasProperSKZInterleaving);
     }
-}
\ No newline at end of file
+}
+TEST_CASE("Deeply nested macros expand in a single pass", "[assembler][macro]") {
+    const std::string generatedFile = "deep_nesting.generated.asm";
+
+    SECTION("A long chain of nested macros expands fully") {
+        {
+            std::ofstream file(generatedFile);
+            file << "def level0(a)\n    a\nend\n";
+            for (int level = 1; level < 600; ++level) {
+                file << "def level" << level << "(a)\n    level" << (level - 1) << "(a)\n    NOT\nend\n";
+            }
+            file << "level599(DA3)\n";
+        }
+        Assembler assembler(generatedFile);
+        auto instructions = assembler.getInstructions();
+        REQUIRE(instructions.size() == 621);  // 600 lines padded to a multiple of 27
+        REQUIRE(instructions[0] == "DA3");
+        REQUIRE(instructions[1] == "NOT");
+        REQUIRE(instructions[599] == "NOT");
+    }
+
+    SECTION("Runaway recursion is refused before expanding") {
+        {
+            std::ofstream file(generatedFile);
+            file << "def forever()\n    LD\n    forever()\n    forever()\nend\n";
+            file << "forever()\nXOR\n";
+        }
+        Assembler assembler(generatedFile);
+        auto instructions = assembler.getInstructions();
+        // The recursive invocation yields nothing; the rest of the program stays
+        REQUIRE(instructions.size() == 27);
+        REQUIRE(instructions[0] == "XOR");
+    }
+
+    SECTION("Chains deeper than the nesting limit are refused whole") {
+        {
+            std::ofstream file(generatedFile);
+            file << "def level0()\n    NOT\nend\n";
+            for (int level = 1; level < 1100; ++level) {
+                file << "def level" << level << "()\n    level" << (level - 1) << "()\nend\n";
+            }
+            file << "level1099()\nlevel1000()\n";
+        }
+        Assembler assembler(generatedFile);
+        auto instructions = assembler.getInstructions();
+        // level1000() nests 1001 frames, within the limit of 1024
+        REQUIRE(instructions.size() == 27);
+        REQUIRE(instructions[0] == "NOT");
+        REQUIRE(instructions[1] == "NOT");
+        REQUIRE(assembler.getExpandedSize() == 27);
+    }
+
+    std::remove(generatedFile.c_str());
+}
+
+TEST_CASE("Compiled macro bodies bind parameter slots", "[assembler][macro]") {
+    const std::string generatedFile = "macro_slots.generated.asm";
+    {
+        std::ofstream file(generatedFile);
+        file << "def HIGH()\n    LD\n    XOR\n    NOT\nend\n";
+        file << "def pair(x, y)\n    x\n    y\nend\n";
+        file << "def mixed(first, value)\n    pair(DA5, first)\n    value()\n    missing(first)\n    pair(first, DA8)\nend\n";
+        file << "mixed(DA3, HIGH)\nmixed(OR, HIGH)\n";
+    }
+    Assembler assembler(generatedFile);
+    auto instructions = assembler.getInstructions();
+    std::vector<std::string> expected = {
+        "DA5", "DA3", "LD", "XOR", "NOT", "DA3", "DA8",
+        "DA5", "OR", "LD", "XOR", "NOT", "OR", "DA8"
+    };
+    REQUIRE(instructions.size() == 27);
+    for (size_t i = 0; i < expected.size(); ++i) {
+        REQUIRE(instructions[i] == expected[i]);
+    }
+    std::remove(generatedFile.c_str());
+}
+
+TEST_CASE("Repeated invocations are copied from the expansion cache", "[assembler][macro][cache]") {
+    const std::string generatedFile = "macro_cache.generated.asm";
+    {
+        std::ofstream file(generatedFile);
+        file << "def step(a, b)\n    a\n    LD\n    b\n    OUT\nend\n";
+        file << "def twice(a)\n    step(a, DA4)\n    step(a, DA4)\nend\n";
+        file << "twice(DA3)\ntwice(DA3)\nSKZ\ntwice(DA3)\ntwice(DA5)\n";
+    }
+    Assembler assembler(generatedFile);
+    auto instructions = assembler.getInstructions();
+
+    std::vector<std::string> plain = {"DA3", "LD", "DA4", "OUT"};
+    std::vector<std::string> interleaved = {"DA3", "SKZ", "LD", "SKZ", "DA4", "SKZ", "OUT"};
+    std::vector<std::string> expected;
+    for (int i = 0; i < 4; ++i) {
+        expected.insert(expected.end(), plain.begin(), plain.end());
+    }
+    expected.insert(expected.end(), interleaved.begin(), interleaved.end());
+    expected.push_back("SKZ");
+    expected.insert(expected.end(), interleaved.begin(), interleaved.end());
+    expected.insert(expected.end(), {"DA5", "LD", "DA4", "OUT", "DA5", "LD", "DA4", "OUT"});
+    REQUIRE(instructions.size() == 54);
+    for (size_t i = 0; i < expected.size(); ++i) {
+        REQUIRE(instructions[i] == expected[i]);
+    }
+
+    // Each macro misses once per distinct (arguments, SKZ mode) and hits after
+    const auto& stats = assembler.getExpansionCacheStats();
+    REQUIRE(stats.hits == 4);
+    REQUIRE(stats.misses == 6);
+    REQUIRE(stats.copiedInstructions == 4 + 8 + 7 + 4);
+    std::remove(generatedFile.c_str());
+}
+
+TEST_CASE("ISA table decodes and encodes every instruction", "[assembler][isa]") {
+    static_assert(isa::findOpcode("DA8") == OP_DA8, "lookup runs at compile time");
+    for (int i = OP_NOT; i < OPCODE_COUNT; ++i) {
+        Opcode opcode = static_cast<Opcode>(i);
+        REQUIRE(isa::findOpcode(isa::mnemonic(opcode)) == opcode);
+    }
+    REQUIRE(isa::findOpcode("HIGH") == OP_NONE);
+    REQUIRE(isa::findOpcode("") == OP_NONE);
+    REQUIRE(isa::findOpcode("DA9") == OP_NONE);
+    REQUIRE(isa::findOpcode("NOTT") == OP_NONE);
+    REQUIRE(std::string(isa::discName(OP_NOT)) == "13");
+    REQUIRE(isa::INSTRUCTIONS[OP_DA7].role == isa::ROLE_TAPE_HEAD);
+    REQUIRE(isa::INSTRUCTIONS[OP_DA7].tape == 1);
+}
+
+TEST_CASE("Assembled programs are carried as opcodes", "[assembler][opcodes]") {
+    const std::string generatedFile = "opcodes.generated.asm";
+    {
+        std::ofstream file(generatedFile);
+        file << "def HIGH()\n    LD\nend\n";
+        file << "def wrap(x)\n    x\n    OUT\nend\n";
+        // A macro name without parentheses is not an instruction
+        file << "wrap(DA4)\nwrap(HIGH)\nHIGH()\n";
+    }
+    Assembler assembler(generatedFile);
+    std::vector<Opcode> expected = {OP_DA4, OP_OUT, OP_OUT, OP_LD, OP_NOT};
+    const auto& opcodes = assembler.getOpcodes();
+    REQUIRE(opcodes.size() == 27);
+    for (size_t i = 0; i < expected.size(); ++i) {
+        REQUIRE(opcodes[i] == expected[i]);
+        REQUIRE(assembler.getInstructions()[i] == isa::mnemonic(expected[i]));
+    }
+    std::remove(generatedFile.c_str());
+}
+
+TEST_CASE("Source files are scanned into trimmed line views", "[assembler][source]") {
+    std::string text = "  XOR ; comment\n\n;only a comment\n\tdef f(a)\t\nLD;x\nAND";
+    std::vector<SourceLine> lines;
+    SourceFile::scanLines(text, lines);
+    REQUIRE(lines.size() == 4);
+    REQUIRE(lines[0].text == "XOR");
+    REQUIRE(lines[0].line == 1);
+    REQUIRE(lines[0].column == 3);
+    REQUIRE(lines[1].text == "def f(a)");
+    REQUIRE(lines[1].line == 4);
+    REQUIRE(lines[1].column == 2);
+    REQUIRE(lines[2].text == "LD");
+    REQUIRE(lines[3].text == "AND");
+    REQUIRE(lines[3].line == 6);
+    // Views point into the scanned text rather than copies
+    REQUIRE(lines[3].text.data() == text.data() + text.size() - 3);
+
+    const std::string emptyFile = "empty.generated.asm";
+    { std::ofstream file(emptyFile); }
+    SourceFile source;
+    REQUIRE(source.open(emptyFile));
+    REQUIRE(source.text().empty());
+    REQUIRE_FALSE(source.open("missing.generated.asm"));
+    std::remove(emptyFile.c_str());
+
+    SourceFile mapped;
+    REQUIRE(mapped.open(getTestFilePath("test_single_opcode.asm")));
+    REQUIRE_FALSE(mapped.text().empty());
+}
+
+TEST_CASE("Streamed expansion matches the assembled program", "[assembler][stream]") {
+    for (const char* name : {"test_nested_macros.asm", "test_recursive_skz.asm", "test_turing_complete.asm"}) {
+        Assembler assembled(getTestFilePath(name));
+        const auto& expected = assembled.getOpcodes();
+
+        Assembler streamed;
+        REQUIRE(streamed.readAssemblyFile(getTestFilePath(name)));
+        auto stream = streamed.streamInstructions();
+        std::vector<Opcode> opcodes;
+        Opcode opcode;
+        while (stream.next(opcode)) {
+            opcodes.push_back(opcode);
+        }
+        REQUIRE(opcodes == expected);
+        REQUIRE(opcodes.size() % 27 == 0);
+        // Nothing was materialized or cached along the way
+        REQUIRE(streamed.getOpcodes().empty());
+        REQUIRE(streamed.getExpansionCacheStats().misses == 0);
+
+        // After assemble() the stream walks the stored program
+        auto replay = assembled.streamInstructions();
+        size_t count = 0;
+        while (replay.next(opcode)) {
+            REQUIRE(opcode == expected[count++]);
+        }
+        REQUIRE(count == expected.size());
+    }
+}
+
+TEST_CASE("Parallel expansion matches a serial run", "[assembler][parallel]") {
+    const std::string generatedFile = "parallel.generated.asm";
+    {
+        std::ofstream file(generatedFile);
+        file << "def step(a, b)\n    a\n    LD\n    b\n    OUT\nend\n";
+        file << "def twice(a)\n    step(a, DA4)\n    step(a, DA4)\nend\n";
+        for (int i = 0; i < 6000; ++i) {
+            switch (i % 7) {
+                case 0: file << "SKZ\ntwice(DA" << (i % 8 + 1) << ")\n"; break;
+                case 1: file << "step(DA" << (i % 5 + 1) << ", OR)\n"; break;
+                case 2: file << "SKZ\n"; break;
+                case 3: file << (i % 300 == 3 ? "twice(bogus)\n" : "XOR\n"); break;
+                default: file << "twice(DA3)\n"; break;
+            }
+        }
+    }
+
+    // Diagnostics are compared too, so capture std::cerr and std::cout for both runs
+    auto assembleWith = [&](ThreadPool* pool, Severity threshold, std::string& errors, std::string& notes) {
+        CerrCapture capturedErrors;
+        CoutCapture capturedNotes;
+        Assembler assembler;
+        assembler.getDiagnostics().setThreshold(threshold);
+        assembler.readAssemblyFile(generatedFile);
+        if (pool) {
+            assembler.assemble(*pool);
+        } else {
+            assembler.assemble();
+        }
+        errors = capturedErrors.text.str();
+        notes = capturedNotes.text.str();
+        return assembler.getOpcodes();
+    };
+    ThreadPool pool(4);
+    for (Severity threshold : {SEVERITY_WARNING, SEVERITY_TRACE}) {
+        std::string serialErrors;
+        std::string serialNotes;
+        std::string parallelErrors;
+        std::string parallelNotes;
+        std::vector<Opcode> serial = assembleWith(nullptr, threshold, serialErrors, serialNotes);
+        std::vector<Opcode> parallel = assembleWith(&pool, threshold, parallelErrors, parallelNotes);
+
+        REQUIRE(serial.size() % 27 == 0);
+        REQUIRE(parallel == serial);
+        REQUIRE_FALSE(serialErrors.empty());
+        REQUIRE(parallelErrors == serialErrors);
+        // Cached spans are replayed without tracing, so tracing expands everything
+        REQUIRE((threshold == SEVERITY_TRACE) == (serialNotes.find("Adding line") != std::string::npos));
+        REQUIRE(parallelNotes == serialNotes);
+    }
+    std::remove(generatedFile.c_str());
+}
+
+TEST_CASE("Expansion sizes are counted without expanding", "[assembler][size]") {
+    const std::string generatedFile = "sizes.generated.asm";
+    {
+        std::ofstream file(generatedFile);
+        file << "def step(a, b)\n    a\n    LD\n    b\n    OUT\nend\n";
+        file << "def twice(a)\n    step(a, DA4)\n    step(a, DA4)\nend\n";
+        file << "def call(f)\n    f()\n    f\nend\n";
+        file << "def ping()\n    pong()\nend\n";
+        file << "def pong()\n    NOT\n    ping()\nend\n";
+        file << "def unit()\n    LD\n    NOT\nend\n";
+        file << "twice(DA3)\nSKZ\ntwice(DA3)\n";
+    }
+    CerrCapture captured;
+    Assembler assembler;
+    assembler.readAssemblyFile(generatedFile);
+    REQUIRE(assembler.measureInvocation("step(DA3, DA4)") == 4);
+    REQUIRE(assembler.measureInvocation("twice(DA3)") == 8);
+    // SKZ between every body line, nested bodies included
+    REQUIRE(assembler.measureInvocation("twice(DA3)", true) == 15);
+    REQUIRE(assembler.measureInvocation("call(twice)") == 0);  // twice() lacks its argument
+    REQUIRE(assembler.measureInvocation("call(unit)") == 2);  // A bare macro name is no instruction
+    REQUIRE(assembler.measureInvocation("ping()") == UINT64_MAX);
+    REQUIRE(assembler.measureInvocation("twice(DA3, DA4)") == 0);
+    REQUIRE(assembler.getExpandedSize() == 27);
+    REQUIRE(captured.text.str().find("warning: Recursive macro: ping -> pong -> ping") != std::string::npos);
+
+    REQUIRE(assembler.assemble());
+    REQUIRE(assembler.getOpcodes().size() == assembler.getExpandedSize());
+
+    SECTION("Budgets refuse oversized programs before expanding") {
+        Assembler limited;
+        limited.readAssemblyFile(generatedFile);
+        limited.setInstructionBudget(26);
+        REQUIRE_FALSE(limited.assemble());
+        REQUIRE(limited.getOpcodes().empty());
+
+        Assembler lowMemory;
+        lowMemory.readAssemblyFile(generatedFile);
+        lowMemory.setMemoryBudget(20);
+        auto stream = lowMemory.streamInstructions();
+        Opcode opcode;
+        // Streaming holds no program, so only the instruction budget applies
+        REQUIRE(stream.next(opcode));
+        REQUIRE_FALSE(lowMemory.assemble());
+        REQUIRE(captured.text.str().find("over the budget of 26") != std::string::npos);
+    }
+
+    SECTION("Programs too large to store are refused without a budget") {
+        const std::string hugeFile = "huge.generated.asm";
+        {
+            // Each macro calls the one before it twice: 2^50 instructions
+            std::ofstream file(hugeFile);
+            file << "def m0()\n    NOT\nend\n";
+            for (int level = 1; level <= 50; ++level) {
+                file << "def m" << level << "()\n    m" << level - 1 << "()\n    m" << level - 1 << "()\nend\n";
+            }
+            file << "m50()\n";
+        }
+        Assembler huge;
+        huge.readAssemblyFile(hugeFile);
+        REQUIRE(huge.getExpandedSize() >= (uint64_t(1) << 50));
+        REQUIRE_FALSE(huge.assemble());
+        REQUIRE(huge.getOpcodes().empty());
+        REQUIRE(captured.text.str().find("needs more memory than this machine has") != std::string::npos);
+        std::remove(hugeFile.c_str());
+    }
+    std::remove(generatedFile.c_str());
+}
+
+TEST_CASE("Diagnostics are located and traced through expansions", "[assembler][diagnostics]") {
+    const std::string generatedFile = "diagnostics.generated.asm";
+    {
+        std::ofstream file(generatedFile);
+        file << "def inner(a)\n    a\n    missing(a)\nend\n";
+        file << "def outer(a)\n    LD\n    inner(a)\nend\n";
+        file << "XOR\n  outer(DA3)\n";
+    }
+    CerrCapture captured;
+    Assembler assembler;
+    assembler.readAssemblyFile(generatedFile);
+    REQUIRE(assembler.assemble());
+    REQUIRE(assembler.getErrorCount() == 1);
+    // The error sits on the body line, with each invocation beneath it
+    REQUIRE(captured.text.str() ==
+            generatedFile + ":3:5: error: Invalid opcode or macro invocation: missing(a)\n"
+            "  " + generatedFile + ":7:5: in expansion of macro inner\n"
+            "  " + generatedFile + ":10:3: in expansion of macro outer\n");
+
+    SECTION("Notes and tracing are kept only when asked for") {
+        std::ostringstream errors;
+        std::ostringstream notes;
+        DiagnosticSink sink(&errors, &notes);
+        sink.report(SEVERITY_NOTE, "quiet by default");
+        sink.report(SEVERITY_WARNING, "kept", SourceLocation());
+        REQUIRE(sink.pending().size() == 1);
+        REQUIRE(sink.count(SEVERITY_NOTE) == 1);
+        sink.setThreshold(SEVERITY_TRACE);
+        sink.report(SEVERITY_TRACE, "traced");
+        // Nothing is written until the sink is flushed
+        REQUIRE(errors.str().empty());
+        sink.flush();
+        REQUIRE(errors.str() == "warning: kept\n");
+        REQUIRE(notes.str() == "traced\n");
+        REQUIRE(sink.errorCount() == 0);
+
+        Assembler verbose;
+        std::ostringstream traced;
+        DiagnosticSink& diagnostics = verbose.getDiagnostics();
+        diagnostics.setThreshold(SEVERITY_TRACE);
+        verbose.readAssemblyFile(generatedFile);
+        verbose.assemble();
+        REQUIRE(diagnostics.count(SEVERITY_TRACE) == 4);
+        REQUIRE(diagnostics.count(SEVERITY_NOTE) == 4);
+    }
+    std::remove(generatedFile.c_str());
+}
+
+TEST_CASE("Emitters write every output format from one stream", "[assembler][emitter]") {
+    const std::string generatedFile = "emitter.generated.asm";
+    {
+        std::ofstream file(generatedFile);
+        file << "def pair(a)\n    a\n    OUT\nend\n";
+        for (int i = 0; i < 20; ++i) {
+            file << "pair(DA" << (i % 8 + 1) << ")\n";
+        }
+    }
+    Assembler assembler;
+    assembler.readAssemblyFile(generatedFile);
+    REQUIRE(assembler.assemble());
+    const std::vector<Opcode>& program = assembler.getOpcodes();
+    REQUIRE(program.size() == 54);
+
+    SECTION("Numeric output lists one disc per line") {
+        std::ostringstream out;
+        NumericEmitter emitter(out);
+        REQUIRE(assembler.emit(emitter));
+        std::istringstream lines(out.str());
+        std::string line;
+        size_t count = 0;
+        while (std::getline(lines, line)) {
+            REQUIRE(line == isa::discName(program[count++]));
+        }
+        REQUIRE(count == program.size());
+    }
+
+    SECTION("Commands fill one shulker box per 27 instructions") {
+        std::ostringstream out;
+        CommandEmitter emitter(out);
+        REQUIRE(assembler.emit(emitter));
+        std::string text = out.str();
+        REQUIRE(text.find("Program_Part_1") != std::string::npos);
+        REQUIRE(text.find("Program_Part_2") != std::string::npos);
+        REQUIRE(text.find("Program_Part_3") == std::string::npos);
+        REQUIRE(std::count(text.begin(), text.end(), '\n') == 2);
+        REQUIRE(text.find("{Slot:26b,id:\"minecraft:music_disc_") != std::string::npos);
+    }
+
+    SECTION("The packed image round-trips") {
+        std::ostringstream out;
+        PackedEmitter emitter(out);
+        REQUIRE(assembler.emit(emitter));
+        std::string image = out.str();
+        REQUIRE(image.size() == PackedProgram::HEADER_BYTES + program.size() / 2);
+        REQUIRE(image.substr(0, 4) == "MCPK");
+        REQUIRE(static_cast<uint8_t>(image[5]) == 27);
+        REQUIRE(static_cast<uint8_t>(image[8]) == 54);   // Instruction count
+        REQUIRE(static_cast<uint8_t>(image[16]) == 2);   // Shulker boxes
+
+        std::istringstream in(image);
+        std::vector<Opcode> decoded;
+        REQUIRE(PackedProgram::read(in, decoded));
+        REQUIRE(decoded == program);
+
+        CerrCapture captured;
+        std::istringstream truncated(image.substr(0, image.size() - 1));
+        REQUIRE_FALSE(PackedProgram::read(truncated, decoded));
+
+        // A corrupt header fails cleanly rather than allocating its count
+        std::string huge = image;
+        for (int i = 8; i < 24; ++i) {
+            huge[i] = static_cast<char>(0xff);
+        }
+        std::istringstream hugeCount(huge);
+        REQUIRE_FALSE(PackedProgram::read(hugeCount, decoded));
+        std::string unboxed = image;
+        unboxed[16] = 0x7f;  // Shulker boxes no longer match the count
+        std::istringstream mismatched(unboxed);
+        REQUIRE_FALSE(PackedProgram::read(mismatched, decoded));
+        std::string noSlots = image;
+        noSlots[5] = 0;
+        std::istringstream zeroSlots(noSlots);
+        REQUIRE_FALSE(PackedProgram::read(zeroSlots, decoded));
+        std::string lying = image;
+        lying[8] = 0;
+        lying[12] = 0x10;  // 2^36 instructions, about 2^35 bytes beyond the header
+        const unsigned char boxes[4] = {0xee, 0x25, 0xb4, 0x97};  // ...in the matching 2545165806 boxes
+        for (int i = 0; i < 4; ++i) {
+            lying[16 + i] = static_cast<char>(boxes[i]);
+        }
+        std::istringstream longCount(lying);
+        REQUIRE_FALSE(PackedProgram::read(longCount, decoded));
+        std::istringstream garbage(std::string("MCPK\x01garbage"));
+        REQUIRE_FALSE(PackedProgram::read(garbage, decoded));
+        REQUIRE(captured.text.str().find("truncated") != std::string::npos);
+        REQUIRE(captured.text.str().find("inconsistent") != std::string::npos);
+    }
+    std::remove(generatedFile.c_str());
+}
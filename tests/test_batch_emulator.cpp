@@ -0,0 +1,102 @@
+#include <catch2/catch_test_macros.hpp>
+#include "batch_emulator.h"
+#include "emulator.h"
+#include <string>
+
+// Runs each lane against a scalar Emulator with the same inputs and compares the final state
+static void requireLanesMatchScalar(const std::string& file, bool tapeMode, uint64_t cycles) {
+    Emulator scalar;
+    REQUIRE(scalar.loadProgram("tests/" + file));
+
+    BatchEmulator batch(128);
+    REQUIRE(batch.getLaneCount() == 128);
+    REQUIRE(batch.loadProgram(scalar.getProgram()));
+    batch.enableTapeMode(tapeMode);
+    for (int lane = 0; lane < batch.getLaneCount(); ++lane) {
+        for (int line = 2; line < 8; ++line) {
+            batch.setDataInput(lane, line, (lane >> (line - 2)) & 1);
+        }
+        batch.setTapeCell(lane, 0, 0, lane >= 64);
+        batch.setTapeCell(lane, 1, -1, lane & 1);
+    }
+    batch.run(cycles);
+
+    for (int lane = 0; lane < batch.getLaneCount(); ++lane) {
+        scalar.reset();
+        scalar.enableTapeMode(tapeMode);
+        for (int line = 2; line < 8; ++line) {
+            scalar.setDataInput(line, (lane >> (line - 2)) & 1);
+        }
+        scalar.setTapeCell(0, 0, lane >= 64);
+        scalar.setTapeCell(1, -1, lane & 1);
+        scalar.runHeadless(cycles);
+
+        REQUIRE(batch.isHalted(lane) == scalar.isHalted());
+        REQUIRE(batch.getRegisterValue(lane) == scalar.getRegisterValue());
+        for (int line = 0; line < 8; ++line) {
+            REQUIRE(batch.getDataOutput(lane, line) == scalar.getDataOutput(line));
+        }
+        for (int tape = 0; tape < 2; ++tape) {
+            REQUIRE(batch.getTapeHead(lane, tape) == scalar.getTapeHead(tape));
+            for (int position = -8; position <= 8; ++position) {
+                REQUIRE(batch.getTapeCell(lane, tape, position) == scalar.getTapeCell(tape, position));
+            }
+        }
+    }
+}
+
+TEST_CASE("Batch lanes match the scalar emulator", "[batch]") {
+    SECTION("Input-driven program without tape") {
+        requireLanesMatchScalar("test.asm", false, 1000);
+    }
+
+    SECTION("Tape program with per-lane head divergence") {
+        requireLanesMatchScalar("test_increment_tape.asm", true, 5000);
+    }
+
+    SECTION("SKZ-heavy tape program") {
+        requireLanesMatchScalar("test_turing_complete.asm", true, 2000);
+    }
+}
+
+TEST_CASE("Batch lanes halt independently", "[batch]") {
+    // Lanes with DA3 high set the HALT flag, the others keep looping
+    BatchEmulator batch(64);
+    REQUIRE(batch.loadProgram({10, 4, 9, 6, 1}));  // DA3 LD DA2 OUT NOT
+    batch.setDataInput(5, 2, true);
+    batch.run(100);
+
+    REQUIRE(batch.isHalted(5));
+    REQUIRE(batch.getHaltCycle(5) == 5);
+    REQUIRE_FALSE(batch.isHalted(4));
+    REQUIRE_FALSE(batch.allHalted());
+    REQUIRE(batch.getCycleCount() == 100);
+}
+
+TEST_CASE("Batch lanes start from any state and are compared per lane", "[batch]") {
+    // DA5 OR OUT against DA5 OUT: the OR only matters where it reads a high
+    // input into a low register
+    std::vector<uint8_t> program = {12, 3, 6};
+    BatchEmulator first(64);
+    BatchEmulator second(64);
+    REQUIRE(first.loadProgram(program));
+    REQUIRE(second.loadProgram({12, 6}));  // DA5 OUT
+    for (BatchEmulator* batch : {&first, &second}) {
+        batch->setRegisterValue(1, true);
+        batch->setDataInput(2, 4, true);
+        batch->setSkipNext(3, true);
+        batch->setSelectedDataLine(3, 1);
+        batch->setMemoryValue(3, 1, true);
+        batch->run(3);
+    }
+    REQUIRE(first.getDataOutput(1, 4));
+    REQUIRE(first.getMemoryValue(3, 1));  // DA5 skipped, so OR and OUT went to DA2
+    REQUIRE_FALSE(first.getSkipNext(3));
+
+    std::vector<BatchEmulator::Word> differ;
+    first.diffLanes(second, differ);
+    REQUIRE(differ.size() == 1);
+    // Lane 2 reads its input; in lane 3 the skipped select leaves the OR
+    // reading DA2's memory
+    REQUIRE(differ[0] == 0xcULL);
+}
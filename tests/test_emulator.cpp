@@ -0,0 +1,288 @@
+#include <catch2/catch_test_macros.hpp>
+#include "emulator.h"
+#include <cstdio>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+TEST_CASE("Emulator decodes the program once at load", "[emulator]") {
+    Emulator emulator;
+    std::vector<std::string> program = {"DA3", "LD", "NOT", "DA1", "OUT", "SKZ", "NOT", "XOR"};
+    REQUIRE(emulator.loadInstructions(program));
+
+    const auto& decoded = emulator.getProgram();
+    REQUIRE(decoded.size() == program.size());
+    REQUIRE(decoded[0] == 10);
+    REQUIRE(decoded[1] == 4);
+    REQUIRE(decoded[2] == 1);
+    REQUIRE(decoded[5] == 2);
+
+    SECTION("Decoded program executes with the original semantics") {
+        emulator.setDataInput(2, false);
+        for (int i = 0; i < 5; ++i) {
+            REQUIRE(emulator.step());
+        }
+        // DA3 LD NOT -> reg 1, stored in DA1 (SKIP flag)
+        REQUIRE(emulator.getRegisterValue());
+        REQUIRE(emulator.step());  // SKZ with SKIP flag high
+        REQUIRE(emulator.step());  // NOT is skipped
+        REQUIRE(emulator.getRegisterValue());
+        REQUIRE(emulator.getCurrentPC() == 7);
+    }
+
+    SECTION("Unknown mnemonics halt at runtime") {
+        REQUIRE(emulator.loadInstructions({"NOT", "BOGUS"}));
+        REQUIRE(emulator.getProgram()[1] == 0);
+        REQUIRE(emulator.step());
+        REQUIRE_FALSE(emulator.step());
+        REQUIRE(emulator.isHalted());
+    }
+}
+
+TEST_CASE("Programs with assembly errors are not loaded", "[emulator]") {
+    const std::string generatedFile = "errors.generated.asm";
+    {
+        std::ofstream file(generatedFile);
+        file << "DA3\nLD\nundefined_macro(DA3)\nFOO\nDA1\nOUT\n";
+    }
+    std::ostringstream errors;
+    std::streambuf* previous = std::cerr.rdbuf(errors.rdbuf());
+    Emulator emulator;
+    bool loaded = emulator.loadProgram(generatedFile);
+    bool optimized = emulator.loadProgram(generatedFile, true);
+    std::cerr.rdbuf(previous);
+    std::remove(generatedFile.c_str());
+
+    REQUIRE_FALSE(loaded);
+    REQUIRE_FALSE(optimized);
+    REQUIRE(errors.str().find("error: ") != std::string::npos);
+    REQUIRE(errors.str().find("2 error(s) while assembling") != std::string::npos);
+}
+
+TEST_CASE("Headless run honours the cycle budget and counts passes", "[emulator][headless]") {
+    Emulator emulator;
+    // SKIP flag is set on the first pass, so every later SKZ skips the NOT
+    REQUIRE(emulator.loadInstructions({"DA3", "LD", "NOT", "DA1", "OUT", "SKZ", "NOT", "XOR", "AND"}));
+
+    const Emulator::RunStats& stats = emulator.runHeadless(90);
+    REQUIRE(stats.cycles == 90);
+    REQUIRE(stats.passes == 9);
+    REQUIRE(stats.skipped == 10);
+    REQUIRE_FALSE(emulator.isHalted());
+
+    SECTION("Program halts once the HALT flag is set at the end of a pass") {
+        REQUIRE(emulator.loadInstructions({"DA3", "LD", "NOT", "DA2", "OUT"}));
+        emulator.runHeadless(1000);
+        REQUIRE(emulator.isHalted());
+        REQUIRE(emulator.getRunStats().cycles == 5);
+        REQUIRE(emulator.getRunStats().passes == 1);
+    }
+}
+
+TEST_CASE("Tape memory grows in both directions across pages", "[emulator][tape]") {
+    Emulator emulator;
+    // Toggle the cell under tape 1's head, then move the head left
+    REQUIRE(emulator.loadInstructions({"DA1", "LD", "NOT", "DA4", "OUT", "DA3", "OUT"}));
+    emulator.enableTapeMode(true);
+
+    const int passes = 5000;  // Crosses more than one 4096-cell page
+    emulator.runHeadless(7 * passes);
+    REQUIRE(emulator.getTapeHead(0) == -passes);
+    REQUIRE(emulator.getTapeCell(0, 0));
+    REQUIRE(emulator.getTapeCell(0, -1));
+    REQUIRE(emulator.getTapeCell(0, -(passes - 1)));
+    REQUIRE_FALSE(emulator.getTapeCell(0, -passes));
+    REQUIRE_FALSE(emulator.getTapeCell(0, 1));
+    REQUIRE_FALSE(emulator.getTapeCell(1, 0));
+    REQUIRE(emulator.getTapeMemoryFootprint() >= 2 * 4096 / 8);
+
+    SECTION("Reset clears the tape and keeps reading zeros") {
+        emulator.reset();
+        REQUIRE(emulator.getTapeHead(0) == 0);
+        REQUIRE_FALSE(emulator.getTapeCell(0, -1));
+        REQUIRE_FALSE(emulator.getTapeCell(0, -(passes - 1)));
+    }
+}
+
+// Runs the same program with and without block fusion and the pass cache and
+// compares the machine state
+static void requireFusionMatchesInterpreter(const std::string& file, bool tapeMode, uint64_t cycles) {
+    Emulator fused;
+    Emulator plain;
+    REQUIRE(fused.loadProgram("tests/" + file));
+    REQUIRE(plain.loadProgram("tests/" + file));
+    fused.enableTapeMode(tapeMode);
+    plain.enableTapeMode(tapeMode);
+    plain.enableFusion(false);
+    plain.enablePassCache(false);
+    fused.setDataInput(2, true);
+    plain.setDataInput(2, true);
+    fused.setTapeCell(0, -2, true);
+    plain.setTapeCell(0, -2, true);
+
+    // Odd-sized slices make budgets end in the middle of blocks
+    for (int slice = 0; slice < 50; ++slice) {
+        fused.runHeadless(cycles / 50 + 7);
+        plain.runHeadless(cycles / 50 + 7);
+        REQUIRE(fused.getCurrentPC() == plain.getCurrentPC());
+        REQUIRE(fused.getRegisterValue() == plain.getRegisterValue());
+        REQUIRE(fused.getSelectedDataLine() == plain.getSelectedDataLine());
+        REQUIRE(fused.getMemoryValue(0) == plain.getMemoryValue(0));
+        REQUIRE(fused.getMemoryValue(1) == plain.getMemoryValue(1));
+        REQUIRE(fused.isHalted() == plain.isHalted());
+        REQUIRE(fused.getRunStats().cycles == plain.getRunStats().cycles);
+        REQUIRE(fused.getRunStats().passes == plain.getRunStats().passes);
+        REQUIRE(fused.getRunStats().skipped == plain.getRunStats().skipped);
+        for (int line = 2; line < 8; ++line) {
+            REQUIRE(fused.getDataOutput(line) == plain.getDataOutput(line));
+        }
+        for (int tape = 0; tape < 2; ++tape) {
+            REQUIRE(fused.getTapeHead(tape) == plain.getTapeHead(tape));
+            for (int position = -10; position <= 10; ++position) {
+                REQUIRE(fused.getTapeCell(tape, position) == plain.getTapeCell(tape, position));
+            }
+        }
+    }
+}
+
+TEST_CASE("Fused basic blocks match the per-instruction interpreter", "[emulator][fusion]") {
+    requireFusionMatchesInterpreter("test.asm", false, 20000);
+    requireFusionMatchesInterpreter("test.asm", true, 20000);
+    requireFusionMatchesInterpreter("test_increment_tape.asm", true, 200000);
+    requireFusionMatchesInterpreter("test_turing_complete.asm", true, 20000);
+    requireFusionMatchesInterpreter("test_jump_to_skz.asm", true, 20000);
+}
+
+TEST_CASE("Fused head moves do not wrap on long runs", "[emulator][fusion][tape]") {
+    // One block of more moves than a 16-bit delta holds
+    const int moves = 40000;
+    std::vector<std::string> program = {"DA1", "LD", "XOR", "NOT", "DA5"};  // Register known high
+    program.insert(program.end(), moves, "OUT");
+    program.push_back("DA2");
+    program.push_back("OUT");  // HALT after the first pass
+
+    Emulator fused;
+    Emulator plain;
+    REQUIRE(fused.loadInstructions(program));
+    REQUIRE(plain.loadInstructions(program));
+    fused.enableTapeMode(true);
+    plain.enableTapeMode(true);
+    plain.enableFusion(false);
+    fused.runHeadless(program.size());
+    plain.runHeadless(program.size());
+    REQUIRE(plain.getTapeHead(0) == moves);
+    REQUIRE(fused.getTapeHead(0) == plain.getTapeHead(0));
+}
+
+TEST_CASE("Repeating states are detected and fast-forwarded", "[emulator][passcache]") {
+    Emulator emulator;
+    // DA1 flips every pass and is copied to OUT3, so the state repeats every 2 passes
+    REQUIRE(emulator.loadInstructions({"DA1", "LD", "NOT", "OUT", "DA3", "OUT"}));
+
+    emulator.runHeadless();
+    REQUIRE(emulator.getLastStopReason() == Emulator::STOP_LOOP);
+    REQUIRE(emulator.getLoopPeriod() == 2);
+    REQUIRE_FALSE(emulator.isHalted());
+
+    SECTION("A cycle budget jumps over whole periods") {
+        Emulator fast;
+        Emulator plain;
+        REQUIRE(fast.loadInstructions({"DA1", "LD", "NOT", "OUT", "DA3", "OUT"}));
+        REQUIRE(plain.loadInstructions({"DA1", "LD", "NOT", "OUT", "DA3", "OUT"}));
+        plain.enablePassCache(false);
+
+        // Both budgets end 5 cycles into the 12-cycle period
+        fast.runHeadless(1000000001);
+        plain.runHeadless(1000001);
+        REQUIRE(fast.getRunStats().cycles == 1000000001);
+        REQUIRE(fast.getRunStats().passes == 1000000001 / 6);
+        REQUIRE(fast.getCurrentPC() == plain.getCurrentPC());
+        REQUIRE(fast.getRegisterValue() == plain.getRegisterValue());
+        REQUIRE(fast.getMemoryValue(0) == plain.getMemoryValue(0));
+        REQUIRE(fast.getDataOutput(2) == plain.getDataOutput(2));
+    }
+
+    SECTION("Tape contents are part of the repeating state") {
+        // Toggles tape 1 cell 0 every pass: the tape repeats every 2 passes
+        REQUIRE(emulator.loadInstructions({"DA1", "LD", "NOT", "DA4", "OUT"}));
+        emulator.enableTapeMode(true);
+        emulator.runHeadless();
+        REQUIRE(emulator.getLastStopReason() == Emulator::STOP_LOOP);
+        REQUIRE(emulator.getLoopPeriod() == 2);
+
+        // A head that keeps moving never repeats, so only the budget stops it
+        REQUIRE(emulator.loadInstructions({"DA1", "LD", "NOT", "DA5", "OUT"}));
+        emulator.enableTapeMode(true);
+        emulator.runHeadless(100000);
+        REQUIRE(emulator.getLastStopReason() == Emulator::STOP_CYCLES);
+        REQUIRE(emulator.getLoopPeriod() == 0);
+    }
+}
+
+TEST_CASE("Tape passes replay from the window cache", "[emulator][passcache][tape]") {
+    // Tape 1 walks left across cell 0, stepping twice past set cells and
+    // marking where it did; tape 2 walks right setting every cell it reaches.
+    // Windows keep repeating over blank tape but the machine state never does.
+    std::vector<std::string> program = {
+        "DA1", "LD", "NOT", "DA3", "OUT", "DA4", "LD", "DA3", "OUT", "DA4", "OUT",
+        "DA1", "LD", "NOT", "DA8", "OUT", "DA7", "LD", "NOT", "DA7", "OUT"
+    };
+    Emulator cached;
+    Emulator plain;
+    REQUIRE(cached.loadInstructions(program));
+    REQUIRE(plain.loadInstructions(program));
+    cached.enableTapeMode(true);
+    plain.enableTapeMode(true);
+    plain.enablePassCache(false);
+    for (int position : {40, 37, 36, 12, 3, -5}) {
+        cached.setTapeCell(0, -position, true);
+        plain.setTapeCell(0, -position, true);
+        cached.setTapeCell(1, position, true);
+        plain.setTapeCell(1, position, true);
+    }
+
+    for (int slice = 0; slice < 40; ++slice) {
+        cached.runHeadless(1001);
+        plain.runHeadless(1001);
+        REQUIRE(cached.getCurrentPC() == plain.getCurrentPC());
+        REQUIRE(cached.getRegisterValue() == plain.getRegisterValue());
+        REQUIRE(cached.getSelectedDataLine() == plain.getSelectedDataLine());
+        REQUIRE(cached.getRunStats().skipped == plain.getRunStats().skipped);
+        for (int tape = 0; tape < 2; ++tape) {
+            REQUIRE(cached.getTapeHead(tape) == plain.getTapeHead(tape));
+            for (int position = -120; position <= 120; ++position) {
+                REQUIRE(cached.getTapeCell(tape, position) == plain.getTapeCell(tape, position));
+            }
+        }
+    }
+    REQUIRE(cached.getTapeHead(0) < -120);
+    REQUIRE(cached.getTapeHead(1) > 120);
+    REQUIRE(cached.getRunStats().replayed > 0);
+}
+
+TEST_CASE("Headless run stops at breakpoints and resumes past them", "[emulator][breakpoint]") {
+    Emulator emulator;
+    REQUIRE(emulator.loadInstructions({"DA3", "LD", "NOT", "DA1", "OUT", "SKZ", "NOT", "XOR", "AND"}));
+    emulator.setBreakpoint(6);
+
+    emulator.runHeadless(1000);
+    REQUIRE(emulator.getLastStopReason() == Emulator::STOP_BREAKPOINT);
+    REQUIRE(emulator.getCurrentPC() == 6);
+    REQUIRE(emulator.getRunStats().cycles == 6);
+
+    // Resuming steps off the breakpoint and stops there again one pass later
+    emulator.runHeadless(1000);
+    REQUIRE(emulator.getLastStopReason() == Emulator::STOP_BREAKPOINT);
+    REQUIRE(emulator.getCurrentPC() == 6);
+    REQUIRE(emulator.getRunStats().cycles == 15);
+
+    SECTION("Clearing the breakpoint lets the run use the whole budget") {
+        emulator.reset();
+        emulator.setBreakpoint(6, false);
+        REQUIRE_FALSE(emulator.hasBreakpoint(6));
+        emulator.runHeadless(500);
+        REQUIRE(emulator.getLastStopReason() == Emulator::STOP_CYCLES);
+    }
+}
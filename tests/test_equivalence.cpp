@@ -0,0 +1,96 @@
+#include <catch2/catch_test_macros.hpp>
+#include "assembler.h"
+#include "equivalence.h"
+#include "thread_pool.h"
+#include <sstream>
+#include <string>
+#include <vector>
+
+namespace {
+
+// Decoded and padded with NOTs the way the assembler leaves programs
+std::vector<uint8_t> program(const std::string& text) {
+    std::vector<uint8_t> decoded;
+    std::istringstream words(text);
+    std::string word;
+    while (words >> word) {
+        decoded.push_back(isa::findOpcode(word));
+    }
+    while (decoded.size() % 27 != 0) {
+        decoded.push_back(OP_NOT);
+    }
+    return decoded;
+}
+
+}  // namespace
+
+TEST_CASE("Equivalence checker proves optimized programs", "[equivalence]") {
+    Assembler assembler;
+    REQUIRE(assembler.readAssemblyFile("tests/test_increment_tape.asm"));
+    REQUIRE(assembler.assemble());
+    std::vector<uint8_t> original(assembler.getOpcodes().begin(), assembler.getOpcodes().end());
+    REQUIRE(assembler.optimize());
+    std::vector<uint8_t> optimized(assembler.getOpcodes().begin(), assembler.getOpcodes().end());
+    REQUIRE(optimized.size() < original.size());
+
+    ThreadPool pool(2);
+    for (bool tapeMode : {false, true}) {
+        EquivalenceChecker checker(original, optimized);
+        checker.setTapeMode(tapeMode);
+        REQUIRE(checker.check(pool));
+        REQUIRE(checker.getStats().startStates >= 1);
+        REQUIRE(checker.getStats().cases == (tapeMode ? 128u * 16 * 64 : 128u * 64 * 2));
+    }
+}
+
+TEST_CASE("Equivalence checker finds the earliest difference", "[equivalence]") {
+    ThreadPool pool(2);
+
+    // The SKIP flag flips every pass; the OR only matters once it went back
+    // low, which takes one pass from reset
+    EquivalenceChecker flips(program("DA1 LD NOT OUT DA5 OUT DA5"), program("DA1 LD NOT OUT DA5 OR OUT"));
+    REQUIRE_FALSE(flips.check(pool));
+    const EquivalenceChecker::Counterexample& example = flips.getCounterexample();
+    REQUIRE(example.passes == 1);
+    REQUIRE(example.path == std::vector<uint8_t>{0});
+    REQUIRE(example.start.memory[0]);
+    REQUIRE(example.inputs == 1 << 4);  // DA5 high
+    REQUIRE_FALSE((example.first.outputs >> 4) & 1);
+    REQUIRE((example.second.outputs >> 4) & 1);
+
+    std::ostringstream report;
+    flips.printReport(report);
+    REQUIRE(report.str().find("Result: DIFFERENT") != std::string::npos);
+    REQUIRE(report.str().find("Their Inputs (DA3-DA8): 000000") != std::string::npos);
+}
+
+TEST_CASE("Equivalence depends on the mode and the start states", "[equivalence]") {
+    ThreadPool pool(2);
+
+    // LD from DA3 only does nothing in tape mode
+    std::vector<uint8_t> load = program("DA3 LD DA1 OUT");
+    std::vector<uint8_t> reselect = program("DA3 DA3 DA1 OUT");
+    EquivalenceChecker normal(load, reselect);
+    REQUIRE_FALSE(normal.check(pool));
+    EquivalenceChecker tape(load, reselect);
+    tape.setTapeMode(true);
+    REQUIRE(tape.check(pool));
+
+    // A toggle of the cell under the head shows up on the tape
+    EquivalenceChecker toggle(program("NOT DA4 OUT DA1"), program("NOT DA4 DA4 DA1"));
+    toggle.setTapeMode(true, 0);
+    REQUIRE_FALSE(toggle.check(pool));
+    REQUIRE(toggle.getCounterexample().first.tapes[0] != toggle.getCounterexample().second.tapes[0]);
+
+    // Nothing writes the SKIP flag, so the SKZ never skips after a reset
+    std::vector<uint8_t> skz = program("SKZ NOT DA5 OUT DA1");
+    std::vector<uint8_t> plain = program("DA1 NOT DA5 OUT DA1");
+    EquivalenceChecker reachable(skz, plain);
+    REQUIRE(reachable.check(pool));
+    EquivalenceChecker every(skz, plain);
+    every.setAllStates(true);
+    REQUIRE_FALSE(every.check(pool));
+    REQUIRE(every.getCounterexample().passes == -1);
+    REQUIRE(every.getCounterexample().start.memory[0]);
+    REQUIRE(every.getStats().startStates == EquivalenceChecker::START_STATES);
+}
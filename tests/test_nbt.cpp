@@ -0,0 +1,101 @@
+#include <catch2/catch_test_macros.hpp>
+#include "emitter.h"
+#include "gzip.h"
+#include "nbt.h"
+#include <sstream>
+#include <string>
+#include <vector>
+
+namespace {
+
+size_t countOf(const std::string& text, const std::string& needle) {
+    size_t count = 0;
+    for (size_t at = text.find(needle); at != std::string::npos; at = text.find(needle, at + 1)) {
+        ++count;
+    }
+    return count;
+}
+
+}  // namespace
+
+TEST_CASE("gzip round-trips through the in-tree DEFLATE", "[nbt][gzip]") {
+    REQUIRE(gzip::crc32("123456789") == 0xCBF43926u);
+    REQUIRE(gzip::crc32("") == 0);
+
+    std::string repetitive;
+    for (int i = 0; i < 20000; ++i) {
+        repetitive += "minecraft:music_disc_" + std::to_string(i % 13);
+    }
+    std::string noisy;
+    uint32_t state = 12345;
+    for (int i = 0; i < 100000; ++i) {
+        state = state * 1103515245u + 12345u;
+        noisy += static_cast<char>(state >> 24);
+    }
+
+    for (const std::string& input : {std::string(), std::string("a"), std::string(70000, 'z'), repetitive, noisy}) {
+        std::string compressed = gzip::compress(input);
+        std::string restored;
+        REQUIRE(gzip::decompress(compressed, restored));
+        REQUIRE(restored == input);
+    }
+    REQUIRE(gzip::compress(repetitive).size() < repetitive.size() / 20);
+
+    // A damaged trailer is caught by the CRC
+    std::string compressed = gzip::compress(repetitive);
+    compressed[compressed.size() - 5] ^= 1;
+    std::string restored;
+    REQUIRE_FALSE(gzip::decompress(compressed, restored));
+}
+
+TEST_CASE("NBT is written big-endian with bare list elements", "[nbt]") {
+    NbtWriter nbt;
+    nbt.beginRoot();
+    nbt.writeInt("v", 0x01020304);
+    nbt.beginList("l", TAG_SHORT, 0);
+    nbt.endList();
+    nbt.beginList("s", TAG_STRING, 1);
+    nbt.writeString("ignored", "ab");
+    nbt.endList();
+    nbt.endRoot();
+
+    const char bytes[] =
+        "\x0a\x00\x00"                                   // Root compound, empty name
+        "\x03\x00\x01v\x01\x02\x03\x04"                  // Int v
+        "\x09\x00\x01l\x00\x00\x00\x00\x00"              // Empty list: element type TAG_END
+        "\x09\x00\x01s\x08\x00\x00\x00\x01\x00\x02" "ab"  // One string, no name
+        "\x00";                                          // End of root
+    const std::string expected(bytes, sizeof(bytes) - 1);
+    REQUIRE(nbt.data() == expected);
+}
+
+TEST_CASE("Structures pack shulker boxes into double chests", "[nbt][emitter]") {
+    // 60 boxes: a full double chest, then 6 boxes in a second one
+    std::vector<Opcode> program(60 * 27 - 5, OP_XOR);
+    program[0] = OP_DA1;
+
+    auto render = [&](bool litematic) {
+        std::ostringstream out;
+        StructureEmitter emitter(out, litematic);
+        for (Opcode opcode : program) {
+            emitter.emit(opcode);
+        }
+        REQUIRE(emitter.finish());
+        std::string nbt;
+        REQUIRE(gzip::decompress(out.str(), nbt));
+        return nbt;
+    };
+
+    std::string structure = render(false);
+    REQUIRE(countOf(structure, "minecraft:purple_shulker_box") == 60);
+    REQUIRE(countOf(structure, "minecraft:music_disc_") == program.size());
+    REQUIRE(countOf(structure, "minecraft:music_disc_stal") == 1);  // DA1
+    REQUIRE(countOf(structure, std::string("\x00\x04size\x03\x00\x00\x00\x03\x00\x00\x00\x04", 14)) == 1);
+    REQUIRE(countOf(structure, "DataVersion") == 1);
+
+    std::string schematic = render(true);
+    REQUIRE(countOf(schematic, "minecraft:purple_shulker_box") == 60);
+    REQUIRE(countOf(schematic, "MinecraftDataVersion") == 1);
+    REQUIRE(countOf(schematic, "BlockStatePalette") == 1);
+    REQUIRE(countOf(schematic, "minecraft:air") == 1);
+}
@@ -0,0 +1,221 @@
+#include <catch2/catch_test_macros.hpp>
+#include "assembler.h"
+#include "dataflow.h"
+#include "emulator.h"
+#include "optimizer.h"
+#include "test_programs.h"
+#include <algorithm>
+#include <string>
+#include <vector>
+
+namespace {
+
+std::vector<std::string> mnemonics(const std::vector<Opcode>& program) {
+    std::vector<std::string> text;
+    for (Opcode opcode : program) {
+        text.push_back(isa::mnemonic(opcode));
+    }
+    return text;
+}
+
+// Pads with NOTs the way the assembler does
+std::vector<Opcode> padded(std::vector<Opcode> program) {
+    while (program.size() % PeepholeOptimizer::INSTRUCTION_MULTIPLE != 0) {
+        program.push_back(OP_NOT);
+    }
+    return program;
+}
+
+MachineSnapshot run(const std::vector<Opcode>& program, bool tapeMode, int inputs, int passes) {
+    Emulator emulator;
+    REQUIRE(emulator.loadInstructions(mnemonics(program)));
+    emulator.enableTapeMode(tapeMode);
+    for (int line = 2; line < 8; ++line) {
+        emulator.setDataInput(line, (inputs >> (line - 2)) & 1);
+    }
+    emulator.runHeadless(program.size() * passes);
+
+    return snapshot(emulator, 4);
+}
+
+}  // namespace
+
+TEST_CASE("Peephole optimizer removes redundant and dead instructions", "[optimizer]") {
+    PeepholeOptimizer optimizer;
+
+    SECTION("Cancelling pairs, reselects and overwritten loads go") {
+        std::vector<std::string> body = {"DA4", "LD", "DA1", "OUT", "NOT", "NOT", "DA3", "DA4", "DA4", "LD", "LD", "DA2", "OUT"};
+        for (int i = 0; i < 27; ++i) {
+            body.push_back(i % 2 ? "DA5" : "DA6");
+        }
+        std::vector<Opcode> program = padded(opcodes(body));
+        REQUIRE(program.size() == 54);
+        REQUIRE(optimizer.optimize(program));
+        REQUIRE(program.size() == 27);
+        std::vector<Opcode> expected = opcodes({"DA4", "LD", "DA1", "OUT", "DA4", "LD", "DA2", "OUT", "DA6"});
+        REQUIRE(std::vector<Opcode>(program.begin(), program.begin() + expected.size()) == expected);
+        const PeepholeOptimizer::Stats& stats = optimizer.getStats();
+        REQUIRE(stats.instructionsSaved() == 27);
+        REQUIRE(stats.ticksSaved() == 27 * 12);
+        REQUIRE(stats.shulkersSaved() == 1);
+    }
+
+    SECTION("LD XOR NOT goes when the register already holds 1") {
+        std::vector<Opcode> program = opcodes({"DA1", "LD", "XOR", "NOT", "DA7", "OUT"});
+        for (int i = 0; i < 9; ++i) {
+            program.insert(program.end(), {OP_LD, OP_XOR, OP_NOT});
+        }
+        program = padded(program);
+        REQUIRE(program.size() == 54);
+        REQUIRE(optimizer.optimize(program));
+        REQUIRE(program.size() == 27);
+    }
+
+    SECTION("Nothing after an SKZ is merged away") {
+        std::vector<Opcode> program = padded(opcodes({"DA1", "SKZ", "NOT", "NOT", "SKZ", "DA3", "DA3"}));
+        std::vector<Opcode> original = program;
+        REQUIRE_FALSE(optimizer.optimize(program));
+        REQUIRE(program == original);
+
+        // The skipped NOT stays; only the unguarded pair after it goes
+        // An input decides the SKIP flag, so whether SKZ skips is not known
+        program = opcodes({"DA3", "LD", "DA1", "OUT", "NOT", "SKZ", "NOT", "NOT", "NOT"});
+        for (int i = 0; i < 18; ++i) {
+            program.push_back(OP_OUT);
+        }
+        program.push_back(OP_LD);  // Keeps the last OUT clear of the end, as HALT needs
+        REQUIRE(program.size() == 28);
+        program = padded(program);
+        REQUIRE(optimizer.optimize(program));
+        REQUIRE(program.size() == 27);
+        std::vector<Opcode> expected = opcodes({"DA3", "LD", "DA1", "OUT", "NOT", "SKZ", "NOT", "OUT"});
+        REQUIRE(std::vector<Opcode>(program.begin(), program.begin() + expected.size()) == expected);
+        REQUIRE(program.back() == OP_DA1);  // One neutral reselect fills the box
+    }
+
+    SECTION("Programs that cannot lose a shulker box are left alone") {
+        std::vector<Opcode> program = padded(opcodes({"DA3", "LD", "NOT", "NOT", "DA1", "OUT"}));
+        std::vector<Opcode> original = program;
+        REQUIRE_FALSE(optimizer.optimize(program));
+        REQUIRE(program == original);
+        REQUIRE(optimizer.getStats().instructionsSaved() == 0);
+    }
+}
+
+TEST_CASE("Dataflow follows SKZ edges and the wrap between passes", "[optimizer][dataflow]") {
+    SECTION("Known flags decide which edges are taken") {
+        std::vector<Opcode> program = opcodes({"DA2", "LD", "NOT", "DA1", "OUT", "SKZ", "NOT", "DA2", "OUT"});
+        DataflowAnalysis flow(program);
+        REQUIRE(flow.successors(5) == std::vector<size_t>{6, 7});
+        REQUIRE(flow.successors(flow.endNode()) == std::vector<size_t>{0});
+        REQUIRE(flow.successors(flow.endSkipNode()) == std::vector<size_t>{1});
+
+        // The HALT flag is low whenever a pass starts, so LD from DA2 reads 0
+        REQUIRE(flow.before(2).reg == 0);
+        REQUIRE(flow.before(5).memory[0] == 1);
+        REQUIRE_FALSE(flow.reachable(6));  // Always skipped
+        REQUIRE(flow.reachable(7));
+        // HALT is set by the end of the first pass, so nothing wraps around
+        REQUIRE(flow.before(flow.endNode()).memory[1] == 1);
+        REQUIRE(flow.before(0).selected == 0);
+    }
+
+    SECTION("Values that change between passes become unknown") {
+        std::vector<Opcode> program = opcodes({"DA1", "LD", "NOT", "OUT", "DA3"});
+        DataflowAnalysis flow(program);
+        REQUIRE(flow.getSweeps() >= 2);
+        REQUIRE(flow.before(1).memory[0] == DataflowAnalysis::UNKNOWN);
+        REQUIRE(flow.before(0).selected == DataflowAnalysis::UNKNOWN);  // DA1 at reset, DA3 after a pass
+        REQUIRE(flow.before(1).selected == 0);
+        REQUIRE(flow.before(4).reg == DataflowAnalysis::UNKNOWN);
+        REQUIRE(DataflowAnalysis::hasNoEffect(OP_DA1, flow.before(1)));
+        REQUIRE_FALSE(DataflowAnalysis::hasNoEffect(OP_DA1, flow.before(0)));
+    }
+}
+
+TEST_CASE("Known flags let the optimizer drop SKZs and selects", "[optimizer][dataflow]") {
+    PeepholeOptimizer optimizer;
+
+    SECTION("An SKZ whose flag is never set goes") {
+        std::vector<Opcode> program;
+        for (int i = 0; i < 5; ++i) {
+            program.insert(program.end(), {OP_DA4, OP_LD, OP_DA5, OP_OUT, OP_SKZ, OP_NOT});
+        }
+        program = padded(program);
+        REQUIRE(program.size() == 54);
+        REQUIRE(optimizer.optimize(program));
+        REQUIRE(program.size() == 27);
+        REQUIRE(std::count(program.begin(), program.end(), OP_SKZ) == 0);
+        REQUIRE(optimizer.getStats().noEffect >= 5);
+    }
+
+    SECTION("An SKZ that always skips goes with what it skips") {
+        // DA2 reads 0 at the start of a pass, so the SKIP flag is always set
+        std::vector<Opcode> program = opcodes({"DA2", "LD", "NOT", "DA1", "OUT", "DA1", "SKZ", "DA6", "DA8", "OUT"});
+        for (int i = 0; i < 9; ++i) {
+            program.insert(program.end(), {OP_DA1, OP_SKZ, OP_OUT});
+        }
+        program = padded(program);
+        REQUIRE(program.size() == 54);
+        REQUIRE(optimizer.optimize(program));
+        REQUIRE(program.size() == 27);
+        REQUIRE(std::count(program.begin(), program.end(), OP_SKZ) == 0);
+        // Every pass also starts with the register low and DA1 selected, as
+        // after reset, so "DA2 LD" and the first DA1 go too
+        std::vector<Opcode> expected = opcodes({"NOT", "OUT", "DA8", "OUT"});
+        REQUIRE(std::vector<Opcode>(program.begin(), program.begin() + expected.size()) == expected);
+    }
+}
+
+TEST_CASE("Optimized programs behave like the originals", "[optimizer][emulator]") {
+    // Random programs built from the idioms macros tend to leave behind
+    const std::vector<std::vector<std::string>> pieces = {
+        {"NOT"}, {"NOT", "NOT"}, {"SKZ"}, {"OR"}, {"LD"}, {"XOR"}, {"OUT"}, {"AND"},
+        {"DA1"}, {"DA2"}, {"DA3"}, {"DA4"}, {"DA5"}, {"DA6"}, {"DA7"}, {"DA8"},
+        {"LD", "XOR"}, {"LD", "XOR", "NOT"}, {"DA4", "DA4"}, {"DA1", "LD"}, {"DA1", "OUT"},
+        {"LD", "LD"}, {"XOR", "XOR"}, {"SKZ", "NOT", "NOT"}, {"DA2", "LD", "NOT", "DA2", "OUT"}
+    };
+    PeepholeOptimizer optimizer;
+    uint32_t state = 2024;
+    auto random = [&state](uint32_t range) {
+        state = state * 1103515245u + 12345u;
+        return (state >> 8) % range;
+    };
+
+    int shortened = 0;
+    for (int trial = 0; trial < 300; ++trial) {
+        std::vector<std::string> body;
+        size_t length = 20 + random(100);
+        while (body.size() < length) {
+            const std::vector<std::string>& piece = pieces[random(pieces.size())];
+            body.insert(body.end(), piece.begin(), piece.end());
+        }
+        std::vector<Opcode> original = padded(opcodes(body));
+        std::vector<Opcode> optimized = original;
+        if (!optimizer.optimize(optimized)) {
+            continue;
+        }
+        shortened++;
+        REQUIRE(optimized.size() % PeepholeOptimizer::INSTRUCTION_MULTIPLE == 0);
+        for (bool tapeMode : {false, true}) {
+            for (int inputs : {0, 0x15, 0x2A, 0x3F}) {
+                INFO("trial " << trial << " tape " << tapeMode << " inputs " << inputs);
+                REQUIRE(run(original, tapeMode, inputs, 7) == run(optimized, tapeMode, inputs, 7));
+            }
+        }
+    }
+    REQUIRE(shortened > 30);
+}
+
+TEST_CASE("Assembler optimizes the expanded program", "[optimizer][assembler]") {
+    Assembler assembler;
+    REQUIRE(assembler.readAssemblyFile("tests/test_multiple_macros.asm"));
+    REQUIRE_FALSE(assembler.optimize());  // Nothing assembled yet
+    REQUIRE(assembler.assemble());
+    std::vector<Opcode> before = assembler.getOpcodes();
+    assembler.optimize();
+    const PeepholeOptimizer::Stats& stats = assembler.getOptimizationStats();
+    REQUIRE(stats.instructionsBefore == before.size());
+    REQUIRE(stats.instructionsAfter == assembler.getOpcodes().size());
+    REQUIRE(assembler.getInstructions().size() == assembler.getOpcodes().size());
+}
@@ -0,0 +1,61 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <vector>
+#include "emulator.h"
+#include "isa.h"
+
+// Opcodes for a list of mnemonics, shared by the optimizer tests
+inline std::vector<Opcode> opcodes(const std::vector<std::string>& mnemonics) {
+    std::vector<Opcode> program;
+    for (const std::string& text : mnemonics) {
+        program.push_back(isa::findOpcode(text));
+    }
+    return program;
+}
+
+// Everything a run can leave behind, for comparing a program with its
+// optimized or rewritten form; tapes are kept within reach of cell 0
+struct MachineSnapshot {
+    bool halted = false;
+    uint64_t passes = 0;
+    bool registerValue = false;
+    int selected = 0;
+    bool memory[2] = {false, false};
+    bool outputs[8] = {};
+    int heads[2] = {0, 0};
+    std::vector<bool> cells[2];
+
+    bool operator==(const MachineSnapshot& other) const {
+        if (halted != other.halted || passes != other.passes || registerValue != other.registerValue ||
+            selected != other.selected || heads[0] != other.heads[0] || heads[1] != other.heads[1]) {
+            return false;
+        }
+        for (int line = 0; line < 8; ++line) {
+            if (outputs[line] != other.outputs[line] || (line < 2 && memory[line] != other.memory[line])) {
+                return false;
+            }
+        }
+        return cells[0] == other.cells[0] && cells[1] == other.cells[1];
+    }
+};
+
+inline MachineSnapshot snapshot(const Emulator& emulator, int reach) {
+    MachineSnapshot machine;
+    machine.halted = emulator.isHalted();
+    machine.passes = emulator.getRunStats().passes;
+    machine.registerValue = emulator.getRegisterValue();
+    machine.selected = emulator.getSelectedDataLine();
+    for (int line = 0; line < 8; ++line) {
+        machine.outputs[line] = emulator.getDataOutput(line);
+    }
+    for (int tape = 0; tape < 2; ++tape) {
+        machine.memory[tape] = emulator.getMemoryValue(tape);
+        machine.heads[tape] = emulator.getTapeHead(tape);
+        for (int cell = -reach; cell <= reach; ++cell) {
+            machine.cells[tape].push_back(emulator.getTapeCell(tape, cell));
+        }
+    }
+    return machine;
+}
@@ -0,0 +1,195 @@
+#include <catch2/catch_test_macros.hpp>
+#include "emulator.h"
+#include "optimizer.h"
+#include "superopt.h"
+#include "test_programs.h"
+#include "thread_pool.h"
+#include <cstdio>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+namespace {
+
+std::string readFile(const std::string& file) {
+    std::ifstream input(file);
+    std::stringstream text;
+    text << input.rdbuf();
+    return text.str();
+}
+
+// Runs a window once on the emulator after instructions that set up the
+// flags, the register and the selected line from the reset state
+MachineSnapshot runWindow(const std::vector<Opcode>& window, bool tapeMode, int start, uint32_t environment) {
+    std::vector<std::string> program;
+    for (int flag = 0; flag < 2; ++flag) {
+        if ((start >> (1 + flag)) & 1) {
+            program.insert(program.end(), {flag == 0 ? "DA1" : "DA2", "NOT", "OUT", "NOT"});
+        }
+    }
+    if (start & 1) {
+        program.push_back("NOT");
+    }
+    program.push_back(isa::mnemonic(static_cast<Opcode>(OP_DA1 + (start >> 3))));
+    for (Opcode opcode : window) {
+        program.push_back(isa::mnemonic(opcode));
+    }
+
+    Emulator emulator;
+    REQUIRE(emulator.loadInstructions(program));
+    emulator.enableTapeMode(tapeMode);
+    for (int line = 2; line < 8; ++line) {
+        emulator.setDataInput(line, (environment >> line) & 1);
+    }
+    for (int cell = -4; cell <= 4; ++cell) {
+        emulator.setTapeCell(0, cell, (environment >> (8 + cell + 4)) & 1);
+        emulator.setTapeCell(1, cell, (environment >> (17 + cell + 4)) & 1);
+    }
+    emulator.runHeadless(program.size());
+
+    return snapshot(emulator, 8);
+}
+
+}  // namespace
+
+TEST_CASE("Window equivalence covers both modes and every line", "[superopt]") {
+    REQUIRE(Superoptimizer::checkEquivalent(opcodes({"NOT", "NOT"}), {}));
+    REQUIRE(Superoptimizer::checkEquivalent(opcodes({"XOR", "OR"}), opcodes({"OR"})));
+    REQUIRE(Superoptimizer::checkEquivalent(opcodes({"NOT", "DA1", "XOR", "AND"}), opcodes({"DA1", "AND"})));
+    // A tape cell toggled twice is back, but outside tape mode DA4 is an output
+    REQUIRE_FALSE(Superoptimizer::checkEquivalent(opcodes({"DA4", "OUT", "OUT"}), opcodes({"DA4"})));
+    // LD from a tape shift line only does nothing in tape mode
+    REQUIRE_FALSE(Superoptimizer::checkEquivalent(opcodes({"DA3", "LD"}), opcodes({"DA3"})));
+    REQUIRE_FALSE(Superoptimizer::checkEquivalent(opcodes({"SKZ"}), opcodes({"SKZ"})));
+
+    RewriteTable table;
+    std::vector<Opcode> pattern;
+    std::vector<Opcode> replacement;
+    REQUIRE(RewriteTable::parseRewrite("LD LD XOR -> LD XOR", pattern, replacement));
+    REQUIRE(table.add(pattern, replacement));
+    REQUIRE_FALSE(table.add(pattern, replacement));
+    REQUIRE_FALSE(table.add(opcodes({"NOT", "SKZ"}), {}));
+    REQUIRE_FALSE(table.add(opcodes({"NOT"}), opcodes({"LD"})));
+    REQUIRE(table.find(pattern.data(), pattern.size()) != nullptr);
+    REQUIRE(*table.find(pattern.data(), pattern.size()) == replacement);
+    REQUIRE(table.find(pattern.data(), 2) == nullptr);
+    REQUIRE_FALSE(RewriteTable::parseRewrite("LD LD", pattern, replacement));
+    REQUIRE_FALSE(RewriteTable::parseRewrite("LD JMP -> LD", pattern, replacement));
+}
+
+TEST_CASE("Superoptimizer finds the same table on any number of threads", "[superopt]") {
+    Superoptimizer serial(4);
+    ThreadPool one(1);
+    serial.run(one);
+    Superoptimizer parallel(4);
+    ThreadPool four(4);
+    parallel.run(four);
+
+    const std::vector<Superoptimizer::LevelStats>& stats = serial.getStats();
+    REQUIRE(stats.size() == 4);
+    REQUIRE(stats[0].windows == 14);  // Every opcode but SKZ
+    REQUIRE(stats[0].rewrites == 0);
+    for (const Superoptimizer::LevelStats& level : stats) {
+        REQUIRE(level.irreducible + level.rewrites <= level.windows);
+    }
+
+    REQUIRE(serial.getTable().save("temp_rewrites_serial.txt"));
+    REQUIRE(parallel.getTable().save("temp_rewrites_parallel.txt"));
+    std::string text = readFile("temp_rewrites_serial.txt");
+    REQUIRE(text == readFile("temp_rewrites_parallel.txt"));
+    REQUIRE(text.find("\nNOT NOT ->\n") != std::string::npos);
+    REQUIRE(text.find("\nLD LD -> LD\n") != std::string::npos);
+
+    // A saved table loads back whole, proving every rewrite again
+    RewriteTable loaded;
+    REQUIRE(loaded.load("temp_rewrites_serial.txt"));
+    REQUIRE(loaded.size() == serial.getTable().size());
+    REQUIRE(loaded.maxLength() == 4);
+
+    std::ofstream wrong("temp_rewrites_wrong.txt");
+    wrong << "; LD does not always load\nDA3 LD -> DA3\n";
+    wrong.close();
+    RewriteTable rejected;
+    REQUIRE_FALSE(rejected.load("temp_rewrites_wrong.txt"));
+
+    std::remove("temp_rewrites_serial.txt");
+    std::remove("temp_rewrites_parallel.txt");
+    std::remove("temp_rewrites_wrong.txt");
+}
+
+TEST_CASE("Rewrites match the emulator from every start", "[superopt][emulator]") {
+    Superoptimizer superoptimizer(3);
+    ThreadPool pool(2);
+    superoptimizer.run(pool);
+    REQUIRE(superoptimizer.getTable().save("temp_rewrites_check.txt"));
+
+    std::ifstream input("temp_rewrites_check.txt");
+    std::string line;
+    int checked = 0;
+    while (std::getline(input, line)) {
+        if (line.empty() || line[0] == ';') {
+            continue;
+        }
+        std::vector<Opcode> pattern;
+        std::vector<Opcode> replacement;
+        REQUIRE(RewriteTable::parseRewrite(line, pattern, replacement));
+        // Flags, register and line; inputs and cells from one of two patterns
+        for (bool tapeMode : {false, true}) {
+            for (int start = 0; start < 64; ++start) {
+                for (uint32_t environment : {0x2d5a9c3cu, 0x1c3a65a4u}) {
+                    INFO(line << " tape " << tapeMode << " start " << start);
+                    REQUIRE(runWindow(pattern, tapeMode, start, environment) ==
+                            runWindow(replacement, tapeMode, start, environment));
+                }
+            }
+        }
+        checked++;
+    }
+    input.close();
+    std::remove("temp_rewrites_check.txt");
+    REQUIRE(checked == static_cast<int>(superoptimizer.getTable().size()));
+}
+
+TEST_CASE("Peephole optimizer applies a rewrite table", "[superopt][optimizer]") {
+    RewriteTable table;
+    for (const char* text : {"NOT DA4 XOR AND -> DA4 AND", "NOT DA7 XOR AND -> DA7 AND"}) {
+        std::vector<Opcode> pattern;
+        std::vector<Opcode> replacement;
+        REQUIRE(RewriteTable::parseRewrite(text, pattern, replacement));
+        REQUIRE(table.add(pattern, replacement));
+    }
+
+    // Nine windows after an input read: 41 instructions, two shulker boxes
+    std::vector<Opcode> program = opcodes({"DA3", "LD", "DA2", "OUT"});
+    for (int i = 0; i < 9; ++i) {
+        std::vector<Opcode> window = opcodes({"NOT", i % 2 ? "DA4" : "DA7", "XOR", "AND"});
+        program.insert(program.end(), window.begin(), window.end());
+    }
+    program.push_back(OP_OUT);
+    while (program.size() % PeepholeOptimizer::INSTRUCTION_MULTIPLE != 0) {
+        program.push_back(OP_NOT);
+    }
+    REQUIRE(program.size() == 54);
+
+    PeepholeOptimizer plain;
+    std::vector<Opcode> unchanged = program;
+    REQUIRE_FALSE(plain.optimize(unchanged));
+
+    PeepholeOptimizer optimizer;
+    optimizer.setRewrites(&table);
+    REQUIRE(optimizer.optimize(program));
+    REQUIRE(program.size() == 27);
+    REQUIRE(optimizer.getStats().rewritten == 18);
+
+    // No window starts after an SKZ or takes in the instruction before one
+    std::vector<Opcode> guarded = opcodes({"DA3", "LD", "DA1", "OUT", "DA1", "SKZ", "NOT", "DA7", "XOR", "AND",
+                                           "NOT", "DA4", "XOR", "AND", "SKZ", "DA2", "OUT"});
+    program = guarded;
+    while (program.size() % PeepholeOptimizer::INSTRUCTION_MULTIPLE != 0) {
+        program.push_back(OP_NOT);
+    }
+    optimizer.optimize(program);
+    REQUIRE(optimizer.getStats().rewritten == 0);
+    REQUIRE(std::vector<Opcode>(program.begin(), program.begin() + guarded.size()) == guarded);
+}
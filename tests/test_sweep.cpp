@@ -0,0 +1,69 @@
+#include <catch2/catch_test_macros.hpp>
+#include "sweep.h"
+#include "thread_pool.h"
+#include <atomic>
+#include <sstream>
+
+TEST_CASE("Thread pool runs nested tasks to completion", "[sweep][pool]") {
+    ThreadPool pool(4);
+    std::atomic<int> counter(0);
+    for (int i = 0; i < 100; ++i) {
+        pool.submit([&pool, &counter] {
+            counter++;
+            // Tasks submitted from a worker land on its own queue and can be stolen
+            pool.submit([&counter] { counter++; });
+        });
+    }
+    pool.wait();
+    REQUIRE(counter == 200);
+}
+
+TEST_CASE("Input sweep produces a truth table", "[sweep]") {
+    // DA3 LD DA4 XOR DA5 OUT DA4 LD DA2 OUT -> OUT5 = DA3 ^ DA4, halts with HALT = DA4
+    std::vector<uint8_t> program = {10, 4, 11, 5, 12, 6, 11, 4, 9, 6};
+    InputSweep sweep(program, false, 1000);
+    ThreadPool pool(2);
+    sweep.run(pool);
+
+    const auto& results = sweep.getResults(0);
+    REQUIRE(results.size() == InputSweep::COMBINATIONS);
+    for (int combination = 0; combination < InputSweep::COMBINATIONS; ++combination) {
+        bool da3 = InputSweep::inputBit(combination, 2);
+        bool da4 = InputSweep::inputBit(combination, 3);
+        REQUIRE(results[combination].outputs[4] == (da3 != da4));
+        REQUIRE(results[combination].halted == da4);
+        if (da4) {
+            REQUIRE(results[combination].cycles == program.size());
+        }
+    }
+
+    std::ostringstream table;
+    sweep.printTable(table);
+    REQUIRE(table.str().find("OUT3 OUT4 OUT5") != std::string::npos);
+}
+
+TEST_CASE("Tape cases parse start offsets and bits", "[sweep]") {
+    InputSweep::TapeCase tapeCase;
+    REQUIRE(InputSweep::parseTapeCase("-3:1010 011", tapeCase));
+    REQUIRE(tapeCase.start[0] == -3);
+    REQUIRE(tapeCase.cells[0].size() == 4);
+    REQUIRE(tapeCase.cells[0][0]);
+    REQUIRE_FALSE(tapeCase.cells[0][1]);
+    REQUIRE(tapeCase.start[1] == 0);
+    REQUIRE(tapeCase.cells[1].size() == 3);
+    REQUIRE_FALSE(InputSweep::parseTapeCase("10x1", tapeCase));
+
+    SECTION("Each tape case is swept in tape mode") {
+        // DA4 LD DA2 OUT -> halts immediately, register holds tape 1 cell 0
+        InputSweep sweep({11, 4, 9, 6, 9, 6}, true, 100);
+        InputSweep::TapeCase one, zero;
+        REQUIRE(InputSweep::parseTapeCase("1", one));
+        REQUIRE(InputSweep::parseTapeCase("0", zero));
+        sweep.setTapeCases({one, zero});
+        ThreadPool pool(2);
+        sweep.run(pool);
+        REQUIRE(sweep.getCaseCount() == 2);
+        REQUIRE(sweep.getResults(0)[0].halted);
+        REQUIRE_FALSE(sweep.getResults(1)[0].halted);
+    }
+}